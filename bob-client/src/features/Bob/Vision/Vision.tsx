@@ -35,12 +35,16 @@ type ImageObject = z.infer<typeof ImageObjectSchema>;
 
 const VISION_PROMPT: string = getPrompt('capture');
 
+// MJPEG stream, the robot caps it at this frame rate
+const LIVE_VIEW_URL = '/bob/stream?fps=10';
+
 const Vision = ({ children }: VisionProps): React.JSX.Element => {
     const [description, setDescription] = useState<ImageObject[]>([]);
     const [error, setError] = useState<string>('');
     const [isLoading, setIsLoading] = useState<boolean>(false);
     const [capturedImage, setCapturedImage] = useState<string>('');
     const [captureKey, setCaptureKey] = useState<number>(0);
+    const [isLiveView, setIsLiveView] = useState<boolean>(false);
     const isDebug = useAppSelector(selectIsDebug);
 
     const [triggerCapture, { isFetching: isCaptureLoading }] =
@@ -158,6 +162,29 @@ const Vision = ({ children }: VisionProps): React.JSX.Element => {
                     alignItems: 'flex-start',
                 }}
             >
+                {isDebug && (
+                    <Button
+                        color="secondary"
+                        disabled={isHealthcheckLoading || !isBobUp}
+                        onClick={() => {
+                            setIsLiveView((prev) => !prev);
+                        }}
+                        variant="contained"
+                    >
+                        {isLiveView ? 'Stop Live View' : 'Live View'}
+                    </Button>
+                )}
+
+                {isDebug && isLiveView && (
+                    <Box sx={{ mt: 2, textAlign: 'center' }}>
+                        <img
+                            alt="Live view from Bob"
+                            src={LIVE_VIEW_URL}
+                            style={{ maxWidth: '60%' }}
+                        />
+                    </Box>
+                )}
+
                 {isDebug && (
                     <Button
                         color="secondary"
@@ -22,7 +22,27 @@ export type HealthcheckResponse = {
 
 export type AudioUploadResponse = {
     status: string;
-    size: number;
+    size?: number;
+    hash?: string;
+};
+
+/**
+ * Hash the robot stores a clip under: the first 16 hex digits of the SHA-256
+ * of the whole WAV file. Null where `crypto.subtle` is not available, i.e.
+ * outside secure contexts such as plain http on a LAN address.
+ */
+const hashClip = async (wavBlob: Blob): Promise<string | null> => {
+    // eslint-disable-next-line @typescript-eslint/no-unnecessary-condition
+    if (!globalThis.crypto?.subtle) {
+        return null;
+    }
+    const digest = await crypto.subtle.digest(
+        'SHA-256',
+        await wavBlob.arrayBuffer(),
+    );
+    return Array.from(new Uint8Array(digest).slice(0, 8))
+        .map((byte) => byte.toString(16).padStart(2, '0'))
+        .join('');
 };
 
 export type MoveCommandRequest = {
@@ -46,36 +66,57 @@ export const bobApi = createApi({
             query: () => `health-check`,
         }),
         /**
-         * Capture photo query.
+         * Capture photo query. The vision model does not need more than VGA,
+         * anything larger only slows the upload down.
          */
         capture: builder.query<string, void>({
             query: () => ({
-                url: 'capture',
+                url: 'capture?profile=vision',
                 responseHandler: (response) => response.blob(),
             }),
             transformResponse: (blob: Blob) => URL.createObjectURL(blob),
             forceRefetch: () => true,
         }),
         /**
-         * Upload and play audio mutation.
+         * Upload and play audio mutation. Clips the robot has already stored
+         * are played by hash, only new ones are uploaded.
          * @param audioData - Int16Array containing the audio data
          */
         uploadAudio: builder.mutation<AudioUploadResponse, Int16Array>({
-            query: (audioData) => {
+            queryFn: async (audioData, _api, _extraOptions, baseQuery) => {
                 // Convert the Int16Array to WAV format
                 const wavBlob = convertToWav(audioData);
 
+                const hash = await hashClip(wavBlob);
+                if (hash) {
+                    const played = await baseQuery({
+                        url: 'audio/play',
+                        method: 'POST',
+                        body: { hash },
+                    });
+                    const ack = played.data as AudioUploadResponse | undefined;
+                    // Anything but the clip echoed back means it was not
+                    // played, e.g. a firmware without /audio/play
+                    if (!played.error && ack?.hash === hash) {
+                        return { data: ack };
+                    }
+                }
+
                 // Create FormData and append the WAV file
                 const formData = new FormData();
                 formData.append('file', wavBlob, 'audio.wav');
 
-                return {
-                    url: 'audio',
+                const uploaded = await baseQuery({
+                    // Start playback while the upload is still arriving
+                    url: 'audio?stream=1',
                     method: 'POST',
                     body: formData,
                     // Don't set Content-Type header - browser will set it with boundary for multipart/form-data
                     formData: true,
-                };
+                });
+                return uploaded.error
+                    ? { error: uploaded.error }
+                    : { data: uploaded.data as AudioUploadResponse };
             },
         }),
         /**
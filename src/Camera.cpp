@@ -1,5 +1,7 @@
 #include "Camera.h"
 #include "Globals.h"
+#include "camera/FrameCache.h"
+#include "camera/RateControl.h"
 #include <Arduino.h>
 #include <driver/i2c.h>
 
@@ -47,9 +49,10 @@ bool initializeCamera() {
         Serial.println("PSRAM found.");
         Serial.printf("Total PSRAM Size: %u bytes\n", ESP.getPsramSize());
         Serial.printf("Free PSRAM: %u bytes\n", ESP.getFreePsram());
-        config.frame_size = FRAMESIZE_UXGA;
-        config.jpeg_quality = 12; // 0-63 lower number means higher quality
-        config.fb_count = 2;
+        // Frame buffers are sized for this, other profiles only shrink
+        config.frame_size = defaultCaptureProfile.settings.frameSize;
+        config.jpeg_quality = defaultCaptureProfile.settings.quality;
+        config.fb_count = CAMERA_FB_COUNT;
         config.grab_mode = CAMERA_GRAB_LATEST;
     } else {
         logger.println("Camera initialization FAILURE. PSRAM not found, "
@@ -65,6 +68,9 @@ bool initializeCamera() {
         Serial.println(err, HEX);
         return false;
     }
+    if (!frameCache.begin(defaultCaptureProfile.settings)) {
+        return false;
+    }
     Serial.println("Camera initialization SUCCESSFUL.");
     return true;
 }
@@ -101,25 +107,75 @@ camera_fb_t *capturePhoto() {
 
 void processCaptureRequest(AsyncWebServerRequest *request,
                            const JsonDocument &doc) {
-    camera_fb_t *fb = capturePhoto();
-    if (!fb) {
+    const CaptureProfile *profile = &defaultCaptureProfile;
+    if (request->hasParam("profile")) {
+        profile = findCaptureProfile(request->getParam("profile")->value());
+        if (!profile) {
+            request->send(400, "text/plain", "Unknown capture profile.");
+            return;
+        }
+    }
+
+    int maxBytes = 0;
+    if (request->hasParam("maxBytes")) {
+        maxBytes = request->getParam("maxBytes")->value().toInt();
+        if (maxBytes <= 0) {
+            request->send(400, "text/plain", "Invalid maxBytes.");
+            return;
+        }
+    }
+
+    // With a budget the settings are only known after capturing
+    if (!maxBytes && request->hasHeader("If-None-Match") &&
+        frameCache.isCurrent(request->header("If-None-Match"),
+                             &profile->settings)) {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", request->header("If-None-Match"));
+        request->send(response);
+        return;
+    }
+
+    std::shared_ptr<CameraFrame> frame;
+    int iterations = 0;
+    if (maxBytes) {
+        frame = rateControl.capture(maxBytes, profile->settings, iterations);
+    } else {
+        frame = frameCache.get(FRAME_CACHE_MAX_AGE_MS, &profile->settings);
+    }
+    if (!frame) {
         request->send(500, "text/plain", "Camera capture failed.");
         return;
     }
 
+    // The filler owns a reference, so the frame buffer goes back to the
+    // driver once the last chunk is out or the response is dropped
+    size_t length = frame->length();
     AsyncWebServerResponse *response = request->beginResponse(
-        "image/jpeg", fb->len,
-        [fb](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
-            size_t len = fb->len - index;
+        "image/jpeg", length,
+        [frame, length](uint8_t *buffer, size_t maxLen,
+                        size_t index) mutable -> size_t {
+            size_t len = length - index;
             if (len > maxLen) {
                 len = maxLen;
             }
-            memcpy(buffer, fb->buf + index, len);
-            if (len + index == fb->len) {
-                esp_camera_fb_return(fb);
+            memcpy(buffer, frame->data() + index, len);
+            if (len + index == length) {
+                frame.reset();
             }
             return len;
         });
     response->addHeader("Content-Disposition", "inline; filename=capture.jpg");
+    response->addHeader("Cache-Control", "no-cache");
+    response->addHeader("ETag", frame->etag());
+    response->addHeader("X-Frame-Seq", String(frame->seq()));
+    response->addHeader("X-Frame-Timestamp", String(frame->timestampMs()));
+    response->addHeader("X-Capture-Profile", profile->name);
+    if (maxBytes) {
+        response->addHeader("X-JPEG-Quality",
+                            String(frame->settings().quality));
+        response->addHeader("X-Frame-Size", String(frame->width()) + "x" +
+                                                String(frame->height()));
+        response->addHeader("X-Rate-Control-Iterations", String(iterations));
+    }
     request->send(response);
 }
@@ -25,6 +25,12 @@
 #define HREF_GPIO_NUM 42
 #define PCLK_GPIO_NUM 5
 
+/**
+ * @brief Number of frame buffers the camera driver captures into. Frames
+ * handed out by `capturePhoto` hold one until they are returned.
+ */
+#define CAMERA_FB_COUNT 2
+
 /**
  * @brief Initializes the camera module.
  *
@@ -65,6 +71,21 @@ camera_fb_t *capturePhoto();
  * Handles HTTP requests to capture photos, retrieves the image from the camera,
  * and sends it back to the client as a JPEG image.
  *
+ * The frame comes from `frameCache`, so requests arriving together share one
+ * capture. The response carries the frame's sequence number and timestamp in
+ * `X-Frame-Seq` and `X-Frame-Timestamp` and the sequence number as `ETag`.
+ * An `If-None-Match` naming a frame that would be shared answers 304 without
+ * touching the camera.
+ *
+ * The `profile` query parameter picks the resolution, JPEG quality and color
+ * mode, see `findCaptureProfile`. Without it the full resolution profile is
+ * used.
+ *
+ * With `maxBytes` the profile only sets the largest frame size and best
+ * quality, `rateControl` lowers both until the JPEG fits the budget. The
+ * chosen quality, frame size and number of frames it took come back in
+ * `X-JPEG-Quality`, `X-Frame-Size` and `X-Rate-Control-Iterations`.
+ *
  * @param request Pointer to the AsyncWebServerRequest object representing the
  * incoming request.
  * @param doc     Reference to the JsonDocument containing request data (unused
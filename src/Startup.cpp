@@ -3,12 +3,22 @@
 #include "Env.h"
 #include "Globals.h"
 #include "Servos.h"
+#include "audio/AudioEngine.h"
+#include "audio/ClipCache.h"
+#include "audio/ClipStore.h"
+#include "audio/DecodeAhead.h"
+#include "audio/FlashClipTable.h"
 #include "audio/WAVFileReader.h"
+#include "camera/ChangeDetector.h"
+#include "camera/PresenceDetector.h"
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <HTTPClient.h>
 #include <SPIFFS.h>
 
+// Clips loaded into the PSRAM clip cache at boot so they start instantly
+static const char *PRELOADED_CLIPS[] = {"/sample_voice.wav"};
+
 void initializeStartup() {
     logger.begin();
     logger.println("Starting...");
@@ -24,17 +34,34 @@ void initializeStartup() {
     const int totalSubsystems = 5;
     int successCount = 0;
 
+    // Optional, clips fall back to SPIFFS without the partition
+    if (flashClips.begin()) {
+        Serial.println("Mapped " + String(flashClips.clipCount()) +
+                       " built-in clips.");
+    }
+
     if (SPIFFS.begin(true)) {
         Serial.println("Mounting SPIFFS SUCCESSFUL.");
         successCount++;
+        for (const char *clip : PRELOADED_CLIPS) {
+            // Clips in the flash partition need no PSRAM copy
+            if (flashClips.find(clip) == nullptr && !clipCache.preload(clip)) {
+                Serial.println("Preloading " + String(clip) + " FAILURE.");
+            }
+        }
+        if (!clipStore.begin()) {
+            Serial.println("Starting clip store FAILURE.");
+        }
     } else {
         logger.println("Mounting SPIFFS FAILURE.");
     }
-    // Workaround to stop speaker popping
-    // 10ms of silence
-    playAudioFile("/silence.wav", false);
-    delay(10);
-
+    if (!decodeAhead.begin()) {
+        logger.println("Decode ahead initialization FAILURE.");
+    }
+    i2s_pin_config_t i2sPins = getDefaultI2SPins();
+    if (!audioEngine.begin(I2S_NUM_1, i2sPins)) {
+        logger.println("Audio engine initialization FAILURE.");
+    }
     if (connectToWiFi()) {
         successCount++;
     }
@@ -85,6 +112,12 @@ void initializeStartup() {
     }
     if (initializeCamera()) {
         successCount++;
+        if (!changeDetector.begin()) {
+            logger.println("Change detector initialization FAILURE.");
+        }
+        if (!presenceDetector.begin()) {
+            logger.println("Presence detector initialization FAILURE.");
+        }
     }
     if (initializeServos()) {
         successCount++;
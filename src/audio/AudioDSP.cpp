@@ -0,0 +1,229 @@
+#include "AudioDSP.h"
+
+#if defined(ARDUINO)
+#include <sdkconfig.h>
+#endif
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+#define AUDIO_DSP_USE_PIE 1
+#else
+#define AUDIO_DSP_USE_PIE 0
+#endif
+
+static void expandMonoToStereoScalar(const int16_t *mono, int16_t *stereo,
+                                     size_t count) {
+    // Front to back, reading each sample before its slot can be overwritten
+    for (size_t i = 0; i < count; i++) {
+        int16_t sample = mono[i];
+        stereo[2 * i] = sample;
+        stereo[2 * i + 1] = sample;
+    }
+}
+
+#if AUDIO_DSP_USE_PIE
+static inline bool isAligned(const void *pointer) {
+    return ((uintptr_t)pointer & (AUDIO_DSP_ALIGNMENT - 1)) == 0;
+}
+
+/**
+ * Expands 8 samples per iteration: the same 128-bit block is loaded into q0
+ * and q1, zipping them yields s0 s0 s1 s1 ... s7 s7 across q0:q1.
+ */
+static void expandMonoToStereoPIE(const int16_t *mono, int16_t *stereo,
+                                  size_t blocks) {
+    asm volatile("loopnez %2, 1f\n"
+                 "ee.vld.128.ip q0, %0, 0\n"
+                 "ee.vld.128.ip q1, %0, 16\n"
+                 "ee.vzip.16 q0, q1\n"
+                 "ee.vst.128.ip q0, %1, 16\n"
+                 "ee.vst.128.ip q1, %1, 16\n"
+                 "1:\n"
+                 : "+r"(mono), "+r"(stereo)
+                 : "r"(blocks)
+                 : "memory");
+}
+
+/**
+ * Mixes 8 samples per iteration: every stream is multiplied by its broadcast
+ * gain into the QACC accumulators, which are then shifted back to Q0 with
+ * rounding and saturation in a single instruction.
+ */
+static void mixSaturatePIE(const int16_t *const *sources, const int16_t *gains,
+                           size_t sourceCount, int16_t *output,
+                           size_t blocks) {
+    const int shift = 15;
+    for (size_t block = 0; block < blocks; block++) {
+        asm volatile("ee.zero.qacc\n");
+        for (size_t source = 0; source < sourceCount; source++) {
+            const int16_t *samples = sources[source] + block * 8;
+            asm volatile("ee.vld.128.ip q0, %0, 0\n"
+                         "ee.vldbc.16 q1, %1\n"
+                         "ee.vmulas.s16.qacc q0, q1\n"
+                         : "+r"(samples)
+                         : "r"(&gains[source])
+                         : "memory");
+        }
+        asm volatile("ee.srcmb.s16.qacc q2, %1, 0\n"
+                     "ee.vst.128.ip q2, %0, 16\n"
+                     : "+r"(output)
+                     : "r"(shift)
+                     : "memory");
+    }
+}
+#endif
+
+void expandMonoToStereo(const int16_t *mono, int16_t *stereo, size_t count) {
+    size_t done = 0;
+#if AUDIO_DSP_USE_PIE
+    if (isAligned(mono) && isAligned(stereo)) {
+        done = count & ~(size_t)7;
+        if (done > 0) {
+            expandMonoToStereoPIE(mono, stereo, done / 8);
+        }
+    }
+#endif
+    expandMonoToStereoScalar(mono + done, stereo + 2 * done, count - done);
+}
+
+/**
+ * @brief Q15 gain `position / total` of a linear fade, clamped to unity,
+ * advanced one frame at a time.
+ *
+ * Keeps the quotient and remainder of the division and steps both, so it
+ * gives exactly `(position << 15) / total` without a 64-bit division per
+ * frame, which the Xtensa core does in software.
+ */
+class FadeGain {
+  private:
+    uint32_t m_position;
+    uint32_t m_total;
+    int32_t m_gain;
+    uint32_t m_remainder;
+    int32_t m_step;
+    uint32_t m_step_remainder;
+
+  public:
+    FadeGain(uint32_t position, uint32_t total)
+        : m_position(position), m_total(total), m_gain(32768),
+          m_remainder(0), m_step(0), m_step_remainder(0) {
+        if (position < total) {
+            uint64_t scaled = (uint64_t)position << 15;
+            m_gain = (int32_t)(scaled / total);
+            m_remainder = (uint32_t)(scaled % total);
+            m_step = 32768 / total;
+            m_step_remainder = 32768 % total;
+        }
+    }
+
+    /**
+     * @brief Gain of the current frame, then moves to the next one.
+     */
+    int32_t next() {
+        if (m_position >= m_total) {
+            return 32768;
+        }
+        int32_t gain = m_gain;
+        m_position++;
+        m_gain += m_step;
+        // Same as adding the step remainder and carrying, without overflow
+        if (m_remainder >= m_total - m_step_remainder) {
+            m_remainder -= m_total - m_step_remainder;
+            m_gain++;
+        } else {
+            m_remainder += m_step_remainder;
+        }
+        return gain;
+    }
+};
+
+void crossfadeSamples(int16_t *outgoing, const int16_t *incoming,
+                      size_t frames, int channels, uint32_t position,
+                      uint32_t total) {
+    FadeGain fade(position, total);
+    for (size_t i = 0; i < frames; i++) {
+        // Q15 gain of the incoming stream
+        int32_t gain = fade.next();
+        for (int channel = 0; channel < channels; channel++) {
+            size_t index = channels * i + channel;
+            int32_t mixed = outgoing[index] * (32768 - gain) +
+                            incoming[index] * gain;
+            outgoing[index] = (int16_t)(mixed >> 15);
+        }
+    }
+}
+
+void fadeSamples(int16_t *samples, size_t frames, int channels,
+                 uint32_t position, uint32_t total, bool fadeIn) {
+    FadeGain fade(position, total);
+    for (size_t i = 0; i < frames; i++) {
+        int32_t gain = fade.next();
+        if (!fadeIn) {
+            gain = 32768 - gain;
+        }
+        for (int channel = 0; channel < channels; channel++) {
+            size_t index = channels * i + channel;
+            samples[index] = (int16_t)((samples[index] * gain) >> 15);
+        }
+    }
+}
+
+void mixSaturate(const int16_t *const *sources, const int16_t *gains,
+                 size_t sourceCount, int16_t *output, size_t count) {
+    size_t done = 0;
+#if AUDIO_DSP_USE_PIE
+    bool aligned = isAligned(output);
+    for (size_t source = 0; source < sourceCount; source++) {
+        aligned = aligned && isAligned(sources[source]);
+    }
+    if (aligned) {
+        done = count & ~(size_t)7;
+        if (done > 0) {
+            mixSaturatePIE(sources, gains, sourceCount, output, done / 8);
+        }
+    }
+#endif
+    for (size_t i = done; i < count; i++) {
+        int32_t accumulator = 0;
+        for (size_t source = 0; source < sourceCount; source++) {
+            accumulator += (sources[source][i] * gains[source]) >> 15;
+        }
+        if (accumulator > INT16_MAX) {
+            accumulator = INT16_MAX;
+        } else if (accumulator < INT16_MIN) {
+            accumulator = INT16_MIN;
+        }
+        output[i] = (int16_t)accumulator;
+    }
+}
+
+void rampGain(int16_t *samples, size_t frames, int channels, int16_t from,
+              int16_t to) {
+    if (frames == 0) {
+        return;
+    }
+    int32_t step = ((int32_t)to - from) * 256 / (int32_t)frames;
+    int32_t gain = (int32_t)from * 256; // Q15 with 8 extra fraction bits
+    for (size_t i = 0; i < frames; i++, gain += step) {
+        int32_t current = gain >> 8;
+        for (int channel = 0; channel < channels; channel++) {
+            size_t index = channels * i + channel;
+            samples[index] = (int16_t)((samples[index] * current) >> 15);
+        }
+    }
+}
+
+void softClip(int16_t *samples, size_t count) {
+    const int32_t knee = AUDIO_DSP_SOFT_CLIP_KNEE;
+    const int32_t range = INT16_MAX - knee;
+    for (size_t i = 0; i < count; i++) {
+        int32_t sample = samples[i];
+        int32_t magnitude = sample < 0 ? -sample : sample;
+        if (magnitude <= knee) {
+            continue;
+        }
+        // Quadratic knee: slope 1 at the knee, flat at full scale
+        int32_t over = magnitude - knee;
+        int32_t shaped = knee + over - over * over / (2 * range);
+        samples[i] = (int16_t)(sample < 0 ? -shaped : shaped);
+    }
+}
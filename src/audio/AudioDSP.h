@@ -0,0 +1,134 @@
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file AudioDSP.h
+ * @brief Sample-level kernels used on the I2S hot path.
+ *
+ * The kernels only depend on the C standard library so they can be compiled
+ * and measured on a host machine. On the ESP32-S3 the expand and mix kernels
+ * use the PIE vector instructions when the buffers are 16-byte aligned and
+ * fall back to portable scalar code otherwise. The fade, ramp and soft clip
+ * kernels are scalar only: their gain changes every frame or their curve
+ * depends on each sample, and they only run on gain changes or when soft
+ * clipping is on.
+ */
+
+/**
+ * @brief Alignment that lets the vector kernels take their fast path.
+ */
+#define AUDIO_DSP_ALIGNMENT 16
+
+/**
+ * @brief Duplicates each mono sample into an interleaved left/right pair.
+ *
+ * Safe to run in place when `mono` points at the upper half of `stereo`
+ * (that is, `mono == stereo + count`), which lets callers read raw samples
+ * straight into the frame buffer and expand them without a scratch buffer.
+ *
+ * @param mono   Source samples.
+ * @param stereo Destination, room for `count * 2` samples.
+ * @param count  Number of mono samples.
+ */
+void expandMonoToStereo(const int16_t *mono, int16_t *stereo, size_t count);
+
+/**
+ * @brief Blends the tail of one interleaved stream into the head of the next
+ * with a linear ramp.
+ *
+ * The incoming gain rises from `position / total` and reaches unity at
+ * `position == total`, frames past that point are taken from `incoming`
+ * as-is.
+ *
+ * @param outgoing Samples of the ending stream, overwritten with the mix.
+ * @param incoming Samples of the starting stream.
+ * @param frames   Number of frames to process.
+ * @param channels Samples per frame in both streams.
+ * @param position Frames of the fade already done before this call.
+ * @param total    Length of the whole fade in frames.
+ */
+void crossfadeSamples(int16_t *outgoing, const int16_t *incoming,
+                      size_t frames, int channels, uint32_t position,
+                      uint32_t total);
+
+/**
+ * @brief Applies a linear Q15 gain ramp to an interleaved stream.
+ *
+ * The gain moves from `position / total` towards 1 when fading in, or from
+ * `1 - position / total` towards 0 when fading out. Frames past the end of the
+ * ramp are left untouched when fading in and silenced when fading out.
+ *
+ * @param samples  Samples to scale in place.
+ * @param frames   Number of frames to process.
+ * @param channels Samples per frame.
+ * @param position Frames of the ramp already done before this call.
+ * @param total    Length of the whole ramp in frames.
+ * @param fadeIn   Direction of the ramp.
+ */
+void fadeSamples(int16_t *samples, size_t frames, int channels,
+                 uint32_t position, uint32_t total, bool fadeIn);
+
+/**
+ * @brief Q15 gain that leaves a source at (almost exactly) its own level.
+ */
+#define AUDIO_DSP_UNITY_GAIN 32767
+
+/**
+ * @brief Sums several sample streams with per-stream Q15 gains and saturates
+ * the result to 16 bits.
+ *
+ * Each product is accumulated at 32-bit (40-bit on the vector path) precision
+ * before the final clip, so any number of loud sources can be mixed without
+ * wrapping around. The vector path rounds once after summing, the scalar one
+ * truncates each product, so the two may differ in the last bit.
+ *
+ * `output` may be one of the `sources`, every sample is read before the
+ * matching output sample is written.
+ *
+ * @param sources     Pointers to `sourceCount` streams of `count` samples.
+ * @param gains       Q15 gain for each stream.
+ * @param sourceCount Number of streams.
+ * @param output      Destination, room for `count` samples.
+ * @param count       Number of samples (not frames) per stream.
+ */
+void mixSaturate(const int16_t *const *sources, const int16_t *gains,
+                 size_t sourceCount, int16_t *output, size_t count);
+
+/**
+ * @brief Scales an interleaved stream by a Q15 gain that moves linearly from
+ * `from` to `to` across the block, so gain changes do not click.
+ *
+ * For a constant gain use `mixSaturate` with a single source, which has a
+ * vector path.
+ *
+ * @param samples  Samples to scale in place.
+ * @param frames   Number of frames to process.
+ * @param channels Samples per frame.
+ * @param from     Q15 gain at the first frame.
+ * @param to       Q15 gain reached after the last frame.
+ */
+void rampGain(int16_t *samples, size_t frames, int channels, int16_t from,
+              int16_t to);
+
+/**
+ * @brief Level above which `softClip` starts bending the signal, 3/4 of
+ * full scale.
+ */
+#define AUDIO_DSP_SOFT_CLIP_KNEE 24576
+
+/**
+ * @brief Rounds off peaks above `AUDIO_DSP_SOFT_CLIP_KNEE` with a quadratic
+ * curve, so loud or saturated passages lose their hard square edges.
+ *
+ * Samples below the knee pass unchanged. Full scale maps to 7/8 of full
+ * scale.
+ *
+ * @param samples Samples to shape in place.
+ * @param count   Number of samples (not frames).
+ */
+void softClip(int16_t *samples, size_t count);
+
+#endif // AUDIO_DSP_H
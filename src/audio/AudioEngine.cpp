@@ -0,0 +1,531 @@
+#include "AudioEngine.h"
+#include "AudioDSP.h"
+#include "AudioStats.h"
+#include "Resampler.h"
+#include <esp_timer.h>
+
+#define AUDIO_ENGINE_COMMAND_QUEUE_LENGTH 8
+#define AUDIO_ENGINE_COMMAND_TIMEOUT_MS 100
+#define AUDIO_ENGINE_TASK_STACK 4096
+#define AUDIO_ENGINE_TASK_PRIORITY 5
+#define AUDIO_ENGINE_TASK_CORE 1
+#define AUDIO_ENGINE_EVENT_QUEUE_LENGTH 8
+#define AUDIO_ENGINE_EVENT_TASK_STACK 2048
+#define AUDIO_ENGINE_EVENT_TASK_PRIORITY 6
+
+AudioEngine audioEngine;
+
+AudioEngine::AudioEngine()
+    : m_i2sPort(I2S_NUM_1), m_commandQueue(nullptr), m_i2sEvents(nullptr),
+      m_taskHandle(nullptr),
+      m_channels(2), m_last_write_us(0),
+      m_is_playing(false),
+      m_queued(0), m_queued_ms(0), m_current_ms(0), m_current(nullptr),
+      m_fade_source(nullptr), m_fade_position(0), m_fade_total(0),
+      m_fade_samples(nullptr), m_current_gain(AUDIO_DSP_UNITY_GAIN),
+      m_fade_gain(AUDIO_DSP_UNITY_GAIN), m_effects(AUDIO_ENGINE_DMA_FRAMES),
+      m_master_gain(AUDIO_DSP_UNITY_GAIN),
+      m_fade_in_ms(AUDIO_ENGINE_DEFAULT_FADE_MS),
+      m_fade_out_ms(AUDIO_ENGINE_DEFAULT_FADE_MS), m_soft_clip(true),
+      m_applied_gain(AUDIO_DSP_UNITY_GAIN), m_ramp(RAMP_NONE),
+      m_ramp_position(0), m_ramp_total(0), m_barge_in({nullptr, 0, 0, 0}),
+      m_probe_source(nullptr), m_probe_start(0) {}
+
+/**
+ * @brief Converts a linear gain between 0 and 1 to Q15.
+ */
+static int16_t toQ15(float gain) {
+    return (int16_t)(constrain(gain, 0.0f, 1.0f) * AUDIO_DSP_UNITY_GAIN);
+}
+
+/**
+ * @brief Converts a source's remaining frames to milliseconds, 0 if unknown.
+ */
+static uint32_t remainingMs(AudioFile *source) {
+    int frames = source->remainingFrames();
+    if (frames <= 0 || source->sampleRate() <= 0) {
+        return 0;
+    }
+    return (uint64_t)frames * 1000 / source->sampleRate();
+}
+
+/**
+ * @brief Wraps `source` in a resampler unless it already runs at the output
+ * rate. Sources without a valid rate are left alone, they produce nothing.
+ */
+static AudioFile *atOutputRate(AudioFile *source) {
+    int sampleRate = source->sampleRate();
+    if (sampleRate <= 0 || sampleRate == AUDIO_ENGINE_OUTPUT_RATE) {
+        return source;
+    }
+    return new Resampler(source, AUDIO_ENGINE_OUTPUT_RATE);
+}
+
+bool AudioEngine::begin(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins) {
+    if (m_taskHandle != nullptr) {
+        return true;
+    }
+
+    // i2s config for writing both channels of I2S
+    i2s_config_t i2sConfig = {
+        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
+        .sample_rate = AUDIO_ENGINE_OUTPUT_RATE,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+        .communication_format = (i2s_comm_format_t)(0x01),
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = AUDIO_ENGINE_DMA_BUFFERS,
+        .dma_buf_len = AUDIO_ENGINE_DMA_FRAMES,
+        .use_apll = false,
+        // Play silence instead of repeating stale buffers when starved
+        .tx_desc_auto_clear = true};
+
+    m_i2sPort = i2sPort;
+    // The event queue only feeds the TX_DONE timing statistics
+    if (i2s_driver_install(m_i2sPort, &i2sConfig,
+                           AUDIO_ENGINE_EVENT_QUEUE_LENGTH,
+                           &m_i2sEvents) != ESP_OK) {
+        Serial.println("I2S driver installation FAILURE.");
+        return false;
+    }
+    i2s_set_pin(m_i2sPort, &i2sPins);
+    i2s_zero_dma_buffer(m_i2sPort);
+
+    m_commandQueue =
+        xQueueCreate(AUDIO_ENGINE_COMMAND_QUEUE_LENGTH, sizeof(Command));
+    if (m_commandQueue == nullptr ||
+        xTaskCreatePinnedToCore(taskEntry, "Audio Engine Task",
+                                AUDIO_ENGINE_TASK_STACK, this,
+                                AUDIO_ENGINE_TASK_PRIORITY, &m_taskHandle,
+                                AUDIO_ENGINE_TASK_CORE) != pdPASS) {
+        Serial.println("Audio engine task creation FAILURE.");
+        return false;
+    }
+    if (xTaskCreatePinnedToCore(eventTaskEntry, "I2S Event Task",
+                                AUDIO_ENGINE_EVENT_TASK_STACK, this,
+                                AUDIO_ENGINE_EVENT_TASK_PRIORITY, NULL,
+                                AUDIO_ENGINE_TASK_CORE) != pdPASS) {
+        // Playback works without it, only the TX_DONE statistics are lost
+        Serial.println("I2S event task creation FAILURE.");
+    }
+    return true;
+}
+
+bool AudioEngine::sendCommand(CommandType type, const QueuedSource &entry) {
+    Command command = {type, entry};
+    if (m_commandQueue == nullptr ||
+        xQueueSend(m_commandQueue, &command,
+                   pdMS_TO_TICKS(AUDIO_ENGINE_COMMAND_TIMEOUT_MS)) != pdPASS) {
+        Serial.println("Audio engine command queue is full.");
+        delete entry.source;
+        return false;
+    }
+    return true;
+}
+
+bool AudioEngine::play(AudioFile *source, float gain) {
+    return sendCommand(COMMAND_PLAY,
+                       {atOutputRate(source), 0, 0, toQ15(gain)});
+}
+
+bool AudioEngine::enqueue(AudioFile *source, int crossfadeMs, float gain) {
+    if (m_queued.fetch_add(1) >= AUDIO_ENGINE_MAX_QUEUED) {
+        m_queued--;
+        Serial.println("Audio engine playback queue is full.");
+        delete source;
+        return false;
+    }
+
+    // The source is not shared with the engine task yet, so it is safe to
+    // measure it here
+    source = atOutputRate(source);
+    QueuedSource entry = {source, max(crossfadeMs, 0), remainingMs(source),
+                          toQ15(gain)};
+    m_queued_ms += entry.duration_ms;
+    if (!sendCommand(COMMAND_ENQUEUE, entry)) {
+        m_queued--;
+        m_queued_ms -= entry.duration_ms;
+        return false;
+    }
+    return true;
+}
+
+bool AudioEngine::overlay(AudioFile *source, float gain) {
+    return sendCommand(COMMAND_OVERLAY,
+                       {atOutputRate(source), 0, 0, toQ15(gain)});
+}
+
+void AudioEngine::stop() { sendCommand(COMMAND_STOP, {nullptr, 0, 0, 0}); }
+
+void AudioEngine::setMasterGain(float gain) { m_master_gain = toQ15(gain); }
+
+void AudioEngine::setFades(int fadeInMs, int fadeOutMs) {
+    m_fade_in_ms = constrain(fadeInMs, 0, AUDIO_ENGINE_MAX_FADE_MS);
+    m_fade_out_ms = constrain(fadeOutMs, 0, AUDIO_ENGINE_MAX_FADE_MS);
+}
+
+void AudioEngine::taskEntry(void *param) {
+    static_cast<AudioEngine *>(param)->run();
+}
+
+void AudioEngine::eventTaskEntry(void *param) {
+    static_cast<AudioEngine *>(param)->watchEvents();
+}
+
+void AudioEngine::watchEvents() {
+    i2s_event_t event;
+    for (;;) {
+        if (xQueueReceive(m_i2sEvents, &event, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        if (event.type == I2S_EVENT_TX_DONE) {
+            audioStats.recordTxDone(esp_timer_get_time());
+        } else if (event.type == I2S_EVENT_TX_Q_OVF && m_is_playing) {
+            // Idle output runs dry all the time, only count it mid-clip
+            audioStats.dmaUnderruns++;
+        }
+    }
+}
+
+void AudioEngine::run() {
+    // Aligned so the sample kernels can use the vector instructions
+    size_t bufferBytes = sizeof(Frame_t) * AUDIO_ENGINE_DMA_FRAMES;
+    uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    Frame_t *frames = (Frame_t *)heap_caps_aligned_alloc(AUDIO_DSP_ALIGNMENT,
+                                                         bufferBytes, caps);
+    m_fade_samples = (int16_t *)heap_caps_aligned_alloc(AUDIO_DSP_ALIGNMENT,
+                                                        bufferBytes, caps);
+    if (frames == nullptr || m_fade_samples == nullptr) {
+        Serial.println("Audio engine frame buffer allocation FAILURE.");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    for (;;) {
+        if (m_ramp == RAMP_OUT && !isAudible()) {
+            // Everything ended on its own during the fade-out
+            finishFadeOut();
+        }
+
+        // Sleep on the queue while idle, otherwise only poll it between
+        // DMA buffers so commands take effect within one DMA period
+        Command command;
+        bool idle = m_current == nullptr && m_pending.empty() &&
+                    m_effects.sourceCount() == 0;
+        TickType_t wait = idle ? portMAX_DELAY : 0;
+        while (xQueueReceive(m_commandQueue, &command, wait) == pdPASS) {
+            handleCommand(command);
+            wait = 0;
+        }
+
+        if (!isAudible()) {
+            continue;
+        }
+
+        if (m_effects.sourceCount() > 0 && m_channels != 2) {
+            // Overlays are mixed in stereo, the clip in DMA plays out first
+            configureOutput(2);
+        }
+
+        int64_t renderStart = esp_timer_get_time();
+        renderBlock((int16_t *)frames, AUDIO_ENGINE_DMA_FRAMES);
+        m_effects.mixInto(frames, AUDIO_ENGINE_DMA_FRAMES);
+        int64_t writeStart = esp_timer_get_time();
+        audioStats.getFrames.record(writeStart - renderStart);
+
+        applyOutputStage((int16_t *)frames, AUDIO_ENGINE_DMA_FRAMES);
+        size_t bytesWritten = 0;
+        i2s_write(m_i2sPort, frames,
+                  AUDIO_ENGINE_DMA_FRAMES * m_channels * sizeof(int16_t),
+                  &bytesWritten, portMAX_DELAY);
+        m_last_write_us = esp_timer_get_time();
+        audioStats.i2sWrite.record(m_last_write_us - writeStart);
+        audioStats.blocks++;
+
+        if (m_ramp == RAMP_OUT && m_ramp_position >= m_ramp_total) {
+            finishFadeOut();
+        }
+    }
+}
+
+void AudioEngine::applyOutputStage(int16_t *samples, int number_frames) {
+    if (m_ramp != RAMP_NONE) {
+        // A finished fade-out silences the rest of the buffer
+        fadeSamples(samples, number_frames, m_channels, m_ramp_position,
+                    m_ramp_total, m_ramp == RAMP_IN);
+        m_ramp_position += number_frames;
+        if (m_ramp == RAMP_IN && m_ramp_position >= m_ramp_total) {
+            m_ramp = RAMP_NONE;
+        }
+    }
+
+    size_t count = number_frames * m_channels;
+    int16_t gain = m_master_gain;
+    if (gain != m_applied_gain) {
+        rampGain(samples, number_frames, m_channels, m_applied_gain, gain);
+        m_applied_gain = gain;
+    } else if (gain != AUDIO_DSP_UNITY_GAIN) {
+        const int16_t *source = samples;
+        mixSaturate(&source, &gain, 1, samples, count);
+    }
+
+    if (m_soft_clip) {
+        softClip(samples, count);
+    }
+}
+
+void AudioEngine::startRamp(Ramp ramp, uint16_t ms) {
+    m_ramp = ramp;
+    m_ramp_position = 0;
+    m_ramp_total = (uint32_t)ms * AUDIO_ENGINE_OUTPUT_RATE / 1000;
+}
+
+bool AudioEngine::isAudible() {
+    return m_current != nullptr || !m_pending.empty() ||
+           m_effects.sourceCount() > 0;
+}
+
+void AudioEngine::finishFadeOut() {
+    // The queue was already emptied when the fade-out started, anything
+    // pending now was enqueued after the stop
+    AudioFile *current = m_current;
+    m_current = nullptr;
+    release(current);
+    release(m_fade_source);
+    m_fade_source = nullptr;
+    m_effects.clear();
+    m_ramp = RAMP_NONE;
+
+    if (m_barge_in.source != nullptr) {
+        startSource(m_barge_in);
+        m_barge_in.source = nullptr;
+    } else {
+        startNextSource();
+    }
+    if (isAudible()) {
+        startRamp(RAMP_IN, m_fade_in_ms);
+    }
+    m_is_playing = isAudible();
+    m_current_ms = m_current ? remainingMs(m_current) : 0;
+}
+
+int AudioEngine::readSource(AudioFile *source, int16_t *samples,
+                            int number_frames) {
+    if (m_channels == 1) {
+        return source->getSamples(samples, number_frames);
+    }
+    return source->getFrames((Frame_t *)samples, number_frames);
+}
+
+void AudioEngine::renderBlock(int16_t *samples, int number_frames) {
+    int filled = 0;
+    while (filled < number_frames) {
+        if (m_current == nullptr) {
+            // Gapless transition: the next source continues this buffer when
+            // it has the same channel count, a channel change
+            // waits for the boundary. Sources enqueued during a fade-out
+            // wait for it to finish.
+            if (m_pending.empty() || m_ramp == RAMP_OUT) {
+                break;
+            }
+            if (filled > 0 && !matchesOutput(m_pending.front().source)) {
+                break;
+            }
+            startNextSource();
+        }
+        maybeStartCrossfade();
+
+        int16_t *output = samples + filled * m_channels;
+        int wanted = number_frames - filled;
+        int produced = readSource(m_current, output, wanted);
+        if (m_current == m_probe_source) {
+            probeLatency(output, produced, filled);
+        }
+        if (m_current_gain != AUDIO_DSP_UNITY_GAIN) {
+            const int16_t *source = output;
+            mixSaturate(&source, &m_current_gain, 1, output,
+                        wanted * m_channels);
+        }
+
+        if (m_fade_source != nullptr) {
+            // The incoming source covers the rest of the buffer, past the end
+            // of the outgoing one it is already at full gain
+            readSource(m_fade_source, m_fade_samples, wanted);
+            if (m_fade_gain != AUDIO_DSP_UNITY_GAIN) {
+                const int16_t *source = m_fade_samples;
+                mixSaturate(&source, &m_fade_gain, 1, m_fade_samples,
+                            wanted * m_channels);
+            }
+            crossfadeSamples(output, m_fade_samples, wanted, m_channels,
+                             m_fade_position, m_fade_total);
+            m_fade_position += wanted;
+
+            if (m_current->isComplete()) {
+                release(m_current);
+                m_current = m_fade_source;
+                m_current_gain = m_fade_gain;
+                m_fade_source = nullptr;
+            }
+            break;
+        }
+
+        if (!m_current->isComplete()) {
+            break;
+        }
+
+        // The rest of the buffer has been padded with silence
+        filled += produced;
+        release(m_current);
+        m_current = nullptr;
+    }
+
+    if (m_current == nullptr && filled < number_frames) {
+        // Nothing queued, overlays may still be mixed on top of the silence
+        memset(samples + filled * m_channels, 0,
+               (number_frames - filled) * m_channels * sizeof(int16_t));
+    }
+
+    m_is_playing = m_current != nullptr || !m_pending.empty() ||
+                   m_effects.sourceCount() > 0;
+    m_current_ms = m_current ? remainingMs(m_current) : 0;
+}
+
+void AudioEngine::handleCommand(const Command &command) {
+    int64_t probeStart;
+    if ((command.type == COMMAND_PLAY || command.type == COMMAND_ENQUEUE) &&
+        audioStats.claimClipProbe(probeStart)) {
+        m_probe_source = command.entry.source;
+        m_probe_start = probeStart;
+    }
+
+    switch (command.type) {
+    case COMMAND_PLAY:
+    case COMMAND_STOP:
+        // Whatever is queued goes right away, what is audible fades out
+        // first and is dropped in `finishFadeOut`
+        while (!m_pending.empty()) {
+            release(popPending().source);
+        }
+        release(m_barge_in.source);
+        m_barge_in = command.entry;
+        if (!isAudible()) {
+            finishFadeOut();
+        } else if (m_ramp != RAMP_OUT) {
+            startRamp(RAMP_OUT, m_fade_out_ms);
+        }
+        break;
+    case COMMAND_ENQUEUE: {
+        bool silent = !isAudible();
+        m_pending.push_back(command.entry);
+        if (m_current == nullptr && m_ramp != RAMP_OUT) {
+            startNextSource();
+        }
+        if (silent && m_ramp != RAMP_OUT) {
+            startRamp(RAMP_IN, m_fade_in_ms);
+        }
+        break;
+    }
+    case COMMAND_OVERLAY:
+        m_effects.addSource(command.entry.source, command.entry.gain);
+        break;
+    }
+}
+
+void AudioEngine::probeLatency(const int16_t *samples, int number_frames,
+                               int frame_offset) {
+    int count = number_frames * m_channels;
+    for (int i = 0; i < count; i++) {
+        if (samples[i] != 0) {
+            // Rendered now, heard once the frames in front of it have played
+            int frame = frame_offset + i / m_channels;
+            int64_t latency = esp_timer_get_time() - m_probe_start +
+                              (int64_t)frame * 1000000 /
+                                  AUDIO_ENGINE_OUTPUT_RATE;
+            audioStats.clipLatency.record(latency);
+            audioStats.lastClipLatencyUs = latency;
+            m_probe_source = nullptr;
+            return;
+        }
+    }
+}
+
+void AudioEngine::release(AudioFile *source) {
+    if (source == m_probe_source) {
+        // The clip never made a sound, drop the measurement
+        m_probe_source = nullptr;
+    }
+    delete source;
+}
+
+int AudioEngine::outputChannels(AudioFile *source) {
+    return source->numChannels() == 1 && m_effects.sourceCount() == 0 ? 1 : 2;
+}
+
+bool AudioEngine::matchesOutput(AudioFile *source) {
+    return outputChannels(source) == m_channels;
+}
+
+void AudioEngine::configureOutput(int channels) {
+    if (channels == m_channels) {
+        return;
+    }
+    // Switching restarts the port and drops whatever is queued in DMA, so
+    // wait until the last buffer written has been played
+    int64_t queuedUs = (int64_t)AUDIO_ENGINE_DMA_BUFFERS *
+                       AUDIO_ENGINE_DMA_FRAMES * 1000000 /
+                       AUDIO_ENGINE_OUTPUT_RATE;
+    int64_t wait = m_last_write_us + queuedUs - esp_timer_get_time();
+    if (wait > 0) {
+        vTaskDelay(pdMS_TO_TICKS(wait / 1000 + 1));
+    }
+    // Resizes the DMA buffers for the new frame size, the driver stays
+    // installed and the clock keeps its rate
+    i2s_set_clk(m_i2sPort, AUDIO_ENGINE_OUTPUT_RATE, I2S_BITS_PER_SAMPLE_16BIT,
+                channels == 1 ? I2S_CHANNEL_MONO : I2S_CHANNEL_STEREO);
+    m_channels = channels;
+}
+
+void AudioEngine::startSource(const QueuedSource &entry) {
+    m_current = entry.source;
+    m_current_gain = entry.gain;
+    configureOutput(outputChannels(entry.source));
+    m_is_playing = true;
+}
+
+bool AudioEngine::startNextSource() {
+    if (m_pending.empty()) {
+        return false;
+    }
+    startSource(popPending());
+    return true;
+}
+
+AudioEngine::QueuedSource AudioEngine::popPending() {
+    QueuedSource entry = m_pending.front();
+    m_pending.pop_front();
+    m_queued--;
+    m_queued_ms -= entry.duration_ms;
+    return entry;
+}
+
+void AudioEngine::maybeStartCrossfade() {
+    if (m_fade_source != nullptr || m_pending.empty() || m_ramp == RAMP_OUT ||
+        m_pending.front().crossfade_ms <= 0 ||
+        !matchesOutput(m_pending.front().source)) {
+        return;
+    }
+
+    int remaining = m_current->remainingFrames();
+    uint32_t fadeFrames =
+        (uint64_t)m_pending.front().crossfade_ms * AUDIO_ENGINE_OUTPUT_RATE /
+        1000;
+    if (remaining < 0 || (uint32_t)remaining > fadeFrames) {
+        return;
+    }
+
+    QueuedSource next = popPending();
+    m_fade_source = next.source;
+    m_fade_gain = next.gain;
+    m_fade_position = 0;
+    m_fade_total = max(remaining, 1);
+}
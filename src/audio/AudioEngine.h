@@ -0,0 +1,277 @@
+#ifndef __audio_engine_h__
+#define __audio_engine_h__
+
+#include "AudioDSP.h"
+#include "AudioFile.h"
+#include "AudioMixer.h"
+#include "driver/i2s.h"
+#include <Arduino.h>
+#include <atomic>
+#include <deque>
+
+/**
+ * @brief Number of frames in one DMA buffer. The engine reads, writes and
+ * reacts to commands in steps of this size. A frame is one sample on the mono
+ * path and a left/right pair on the stereo one, so mono output halves the DMA
+ * memory.
+ */
+#define AUDIO_ENGINE_DMA_FRAMES 512
+
+/**
+ * @brief Number of DMA buffers queued in front of the I2S peripheral.
+ */
+#define AUDIO_ENGINE_DMA_BUFFERS 6
+
+/**
+ * @brief Sample rate the I2S clock runs at. Sources at other rates are
+ * converted by a `Resampler`, so the clock is never reprogrammed.
+ */
+#define AUDIO_ENGINE_OUTPUT_RATE 48000
+
+/**
+ * @brief Maximum number of sources waiting behind the one that is playing.
+ */
+#define AUDIO_ENGINE_MAX_QUEUED 8
+
+/**
+ * @brief Default length of the ramps on start and stop. Well under one DMA
+ * buffer, long enough that starting or cutting a clip does not pop.
+ */
+#define AUDIO_ENGINE_DEFAULT_FADE_MS 5
+
+/**
+ * @brief Longest fade-in or fade-out ramp that can be configured.
+ */
+#define AUDIO_ENGINE_MAX_FADE_MS 1000
+
+/**
+ * @brief Returns the default I2S pin configuration.
+ *
+ * @return A `i2s_pin_config_t` structure with default pin assignments.
+ */
+inline i2s_pin_config_t getDefaultI2SPins() {
+    i2s_pin_config_t pins = {
+        .bck_io_num = GPIO_NUM_12,   /**< Bit Clock pin */
+        .ws_io_num = GPIO_NUM_13,    /**< Left/Right Clock pin */
+        .data_out_num = GPIO_NUM_14, /**< Serial Data Out pin */
+        .data_in_num = -1            /**< Not used for output */
+    };
+    return pins;
+}
+
+/**
+ * @class AudioEngine
+ * @brief Long-lived owner of the I2S port and of every playing source.
+ *
+ * The I2S driver is installed once in `begin`. A single task pinned to one
+ * core then pulls frames from the current `AudioFile` one DMA buffer at a
+ * time and takes play/enqueue/stop commands from a queue in between buffers,
+ * so starting or stopping a clip costs at most one DMA period.
+ *
+ * Every source is resampled to `AUDIO_ENGINE_OUTPUT_RATE` on its way in, so
+ * clips at different rates can follow each other or be mixed freely.
+ *
+ * Mono sources are sent to the peripheral as mono, skipping the left/right
+ * duplication and halving the DMA traffic. Stereo sources and overlays switch
+ * the port to stereo. A switch waits for the DMA buffers to play out, so
+ * an overlay starting over mono speech delays it by up to one DMA queue
+ * instead of cutting the queued speech.
+ *
+ * Sources passed to `play` and `enqueue` become owned by the engine and are
+ * only ever deleted on the engine task, never while they are being read.
+ *
+ * Every DMA buffer passes through an output stage: a fade-in ramp when
+ * playback starts from silence, a fade-out ramp before `stop` or a
+ * barge-in `play` takes effect, the master gain and a soft clipper.
+ */
+class AudioEngine {
+  private:
+    enum CommandType {
+        COMMAND_PLAY,
+        COMMAND_ENQUEUE,
+        COMMAND_OVERLAY,
+        COMMAND_STOP
+    };
+
+    struct QueuedSource {
+        AudioFile *source;
+        int crossfade_ms;     /**< Overlap with the previous source */
+        uint32_t duration_ms; /**< Length counted in `m_queued_ms` */
+        int16_t gain;         /**< Q15 gain of the clip */
+    };
+
+    enum Ramp { RAMP_NONE, RAMP_IN, RAMP_OUT };
+
+    struct Command {
+        CommandType type;
+        QueuedSource entry;
+    };
+
+    i2s_port_t m_i2sPort;
+    QueueHandle_t m_commandQueue;
+    QueueHandle_t m_i2sEvents;
+    TaskHandle_t m_taskHandle;
+    int m_channels; /**< Samples per frame the I2S port expects */
+    int64_t m_last_write_us; /**< When the last DMA buffer was queued */
+    volatile bool m_is_playing;
+
+    // Queue accounting, updated by callers on enqueue and by the engine task
+    // when sources leave the queue
+    std::atomic<int> m_queued;
+    std::atomic<uint32_t> m_queued_ms;
+    std::atomic<uint32_t> m_current_ms;
+
+    // Only touched by the engine task
+    AudioFile *m_current;
+    std::deque<QueuedSource> m_pending;
+    AudioFile *m_fade_source; /**< Next source, fading in under the current */
+    uint32_t m_fade_position;
+    uint32_t m_fade_total;
+    int16_t *m_fade_samples;
+    int16_t m_current_gain;
+    int16_t m_fade_gain;
+    AudioMixer m_effects; /**< Overlays mixed on top of the queue */
+
+    // Output stage settings, written by callers
+    std::atomic<int16_t> m_master_gain;
+    std::atomic<uint16_t> m_fade_in_ms;
+    std::atomic<uint16_t> m_fade_out_ms;
+    std::atomic<bool> m_soft_clip;
+
+    // Output stage state, only touched by the engine task
+    int16_t m_applied_gain; /**< Master gain the last buffer ended at */
+    Ramp m_ramp;
+    uint32_t m_ramp_position;
+    uint32_t m_ramp_total;
+    QueuedSource m_barge_in; /**< Plays once the fade-out is done */
+
+    // Clip latency probe, see `AudioStats::armClipProbe`
+    AudioFile *m_probe_source;
+    int64_t m_probe_start;
+
+    static void taskEntry(void *param);
+    static void eventTaskEntry(void *param);
+    void run();
+    void watchEvents();
+    void probeLatency(const int16_t *samples, int number_frames,
+                      int frame_offset);
+    void release(AudioFile *source);
+    void renderBlock(int16_t *samples, int number_frames);
+    int readSource(AudioFile *source, int16_t *samples, int number_frames);
+    void handleCommand(const Command &command);
+    int outputChannels(AudioFile *source);
+    bool matchesOutput(AudioFile *source);
+    void configureOutput(int channels);
+    void applyOutputStage(int16_t *samples, int number_frames);
+    void startRamp(Ramp ramp, uint16_t ms);
+    void finishFadeOut();
+    bool isAudible();
+    void startSource(const QueuedSource &entry);
+    bool startNextSource();
+    void maybeStartCrossfade();
+    QueuedSource popPending();
+    bool sendCommand(CommandType type, const QueuedSource &entry);
+
+  public:
+    AudioEngine();
+
+    /**
+     * @brief Installs the I2S driver and starts the engine task.
+     *
+     * @param i2sPort I2S port number to use.
+     * @param i2sPins Reference to the I2S pin configuration.
+     * @return `true` if the driver and task were created.
+     */
+    bool begin(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins);
+
+    /**
+     * @brief Replaces whatever is playing (and queued) with `source`.
+     *
+     * What is playing fades out first, so barging in does not click.
+     *
+     * @param source Source to play.
+     * @param gain Linear gain between 0 and 1.
+     * @return `false` if the command could not be queued, in which case the
+     * source has already been deleted.
+     */
+    bool play(AudioFile *source, float gain = 1.0f);
+
+    /**
+     * @brief Appends `source` to play after the current and queued sources.
+     *
+     * Consecutive sources with the same channel count play back to back
+     * without a gap, optionally overlapping by `crossfadeMs`.
+     *
+     * @param source Source to queue.
+     * @param crossfadeMs Length of the crossfade from the previous source,
+     * 0 for a plain gapless transition.
+     * @param gain Linear gain between 0 and 1.
+     * @return `false` if the queue is full or the command could not be
+     * queued, in which case the source has already been deleted.
+     */
+    bool enqueue(AudioFile *source, int crossfadeMs = 0, float gain = 1.0f);
+
+    /**
+     * @brief Plays `source` on top of whatever else is playing, for example a
+     * sound effect over speech.
+     *
+     * The overlay does not affect the queue.
+     *
+     * @param source Source to mix in.
+     * @param gain Linear gain between 0 and 1.
+     * @return `false` if the command could not be queued, in which case the
+     * source has already been deleted.
+     */
+    bool overlay(AudioFile *source, float gain = 1.0f);
+
+    /**
+     * @brief Fades out and drops every playing and queued source and
+     * overlay.
+     */
+    void stop();
+
+    /**
+     * @brief Sets the gain applied to everything that is played, between 0
+     * and 1. Changes are ramped over one DMA buffer.
+     */
+    void setMasterGain(float gain);
+    float masterGain() { return (float)m_master_gain / AUDIO_DSP_UNITY_GAIN; }
+
+    /**
+     * @brief Sets the ramps used when playback starts from silence and
+     * before a stop or barge-in takes effect, 0 to cut.
+     */
+    void setFades(int fadeInMs, int fadeOutMs);
+    int fadeInMs() { return m_fade_in_ms; }
+    int fadeOutMs() { return m_fade_out_ms; }
+
+    /**
+     * @brief Enables the soft clipper at the end of the output stage.
+     */
+    void setSoftClip(bool enabled) { m_soft_clip = enabled; }
+    bool softClipEnabled() { return m_soft_clip; }
+
+    /**
+     * @brief Checks whether a source is currently being played.
+     */
+    bool isPlaying() { return m_is_playing; }
+
+    /**
+     * @brief Number of sources waiting behind the one that is playing.
+     */
+    int queueDepth() { return m_queued; }
+
+    /**
+     * @brief Milliseconds of audio left in the current and queued sources.
+     *
+     * Streams that are still being uploaded are not counted.
+     */
+    uint32_t bufferedMs() { return m_queued_ms + m_current_ms; }
+};
+
+/**
+ * @brief Global instance of the audio engine.
+ */
+extern AudioEngine audioEngine;
+
+#endif
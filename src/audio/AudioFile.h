@@ -21,6 +21,8 @@ typedef struct {
  */
 class AudioFile {
   public:
+    virtual ~AudioFile() {}
+
     /**
      * @brief Retrieves the sample rate of the audio file.
      *
@@ -37,8 +39,51 @@ class AudioFile {
      *
      * @param frames Pointer to the buffer where audio frames will be stored.
      * @param number_frames Number of frames to generate.
+     * @return Number of frames produced before the end of the audio. Frames
+     * past that point are silence, which lets the caller continue the buffer
+     * with the next source.
+     */
+    virtual int getFrames(Frame_t *frames, int number_frames) = 0;
+
+    /**
+     * @brief Number of channels the audio is stored with.
+     *
+     * Mono sources can be read with `getSamples`, which skips duplicating
+     * every sample into a left/right pair.
+     *
+     * @return 1 for mono, 2 for stereo.
+     */
+    virtual int numChannels() { return 2; }
+
+    /**
+     * @brief Fills the provided buffer with mono samples.
+     *
+     * Only called on sources whose `numChannels` is 1, the samples are handed
+     * out in the same order and with the same end-of-audio semantics as
+     * `getFrames`.
+     *
+     * @param samples Pointer to the buffer where samples will be stored.
+     * @param number_samples Number of samples to generate.
+     * @return Number of samples produced before the end of the audio.
+     */
+    virtual int getSamples(int16_t *samples, int number_samples) {
+        memset(samples, 0, number_samples * sizeof(int16_t));
+        return 0;
+    }
+
+    /**
+     * @brief Estimates how many frames are left to play.
+     *
+     * @return Remaining frames, or -1 when the length is not known yet.
+     */
+    virtual int remainingFrames() { return -1; }
+
+    /**
+     * @brief Checks whether the generator has run out of audio.
+     *
+     * @return `true` once every frame has been handed out by `getFrames`.
      */
-    virtual void getFrames(Frame_t *frames, int number_frames) = 0;
+    virtual bool isComplete() = 0;
 };
 
 #endif
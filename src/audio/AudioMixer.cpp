@@ -0,0 +1,123 @@
+#include "AudioMixer.h"
+#include "AudioDSP.h"
+
+AudioMixer::AudioMixer(int max_frames)
+    : m_max_frames(max_frames), m_channel_count(0) {}
+
+AudioMixer::~AudioMixer() { clear(); }
+
+bool AudioMixer::addSource(AudioFile *source, int16_t gain) {
+    if (m_channel_count >= AUDIO_MIXER_MAX_SOURCES) {
+        Serial.println("Audio mixer is full.");
+        delete source;
+        return false;
+    }
+    if (m_channel_count > 0 && source->sampleRate() != sampleRate()) {
+        Serial.println("Audio mixer sample rate mismatch.");
+        delete source;
+        return false;
+    }
+
+    // Aligned so the mix kernel can use the vector instructions
+    Frame_t *frames = (Frame_t *)heap_caps_aligned_alloc(
+        AUDIO_DSP_ALIGNMENT, sizeof(Frame_t) * m_max_frames,
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (frames == nullptr) {
+        Serial.println("Audio mixer buffer allocation FAILURE.");
+        delete source;
+        return false;
+    }
+
+    m_channels[m_channel_count++] = {source, gain, frames};
+    return true;
+}
+
+int AudioMixer::sampleRate() {
+    return m_channel_count > 0 ? m_channels[0].source->sampleRate() : 0;
+}
+
+int AudioMixer::renderChannels(int number_frames) {
+    int produced = 0;
+    for (int i = 0; i < m_channel_count; i++) {
+        Channel &channel = m_channels[i];
+        int frames = channel.source->getFrames(channel.frames, number_frames);
+        produced = max(produced, channel.source->isComplete() ? frames
+                                                              : number_frames);
+    }
+    return produced;
+}
+
+void AudioMixer::mixChannels(Frame_t *base, Frame_t *output,
+                             int number_frames) {
+    const int16_t *sources[AUDIO_MIXER_MAX_SOURCES + 1];
+    int16_t gains[AUDIO_MIXER_MAX_SOURCES + 1];
+    size_t count = 0;
+    if (base != nullptr) {
+        sources[count] = (const int16_t *)base;
+        gains[count++] = AUDIO_DSP_UNITY_GAIN;
+    }
+    for (int i = 0; i < m_channel_count; i++) {
+        sources[count] = (const int16_t *)m_channels[i].frames;
+        gains[count++] = m_channels[i].gain;
+    }
+    mixSaturate(sources, gains, count, (int16_t *)output, number_frames * 2);
+}
+
+void AudioMixer::removeCompleted() {
+    int kept = 0;
+    for (int i = 0; i < m_channel_count; i++) {
+        if (m_channels[i].source->isComplete()) {
+            delete m_channels[i].source;
+            heap_caps_free(m_channels[i].frames);
+        } else {
+            m_channels[kept++] = m_channels[i];
+        }
+    }
+    m_channel_count = kept;
+}
+
+void AudioMixer::mixInto(Frame_t *frames, int number_frames) {
+    for (int done = 0; done < number_frames && m_channel_count > 0;) {
+        int step = min(number_frames - done, m_max_frames);
+        renderChannels(step);
+        mixChannels(frames + done, frames + done, step);
+        removeCompleted();
+        done += step;
+    }
+}
+
+int AudioMixer::getFrames(Frame_t *frames, int number_frames) {
+    int produced = 0;
+    int done = 0;
+    while (done < number_frames && m_channel_count > 0) {
+        int step = min(number_frames - done, m_max_frames);
+        produced = done + renderChannels(step);
+        mixChannels(nullptr, frames + done, step);
+        removeCompleted();
+        done += step;
+    }
+    if (done < number_frames) {
+        memset(frames + done, 0, (number_frames - done) * sizeof(Frame_t));
+    }
+    return produced;
+}
+
+int AudioMixer::remainingFrames() {
+    int remaining = 0;
+    for (int i = 0; i < m_channel_count; i++) {
+        int frames = m_channels[i].source->remainingFrames();
+        if (frames < 0) {
+            return -1;
+        }
+        remaining = max(remaining, frames);
+    }
+    return remaining;
+}
+
+void AudioMixer::clear() {
+    for (int i = 0; i < m_channel_count; i++) {
+        delete m_channels[i].source;
+        heap_caps_free(m_channels[i].frames);
+    }
+    m_channel_count = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef __audio_mixer_h__
+#define __audio_mixer_h__
+
+#include "AudioFile.h"
+
+/**
+ * @brief Maximum number of sources a mixer plays at the same time.
+ */
+#define AUDIO_MIXER_MAX_SOURCES 6
+
+/**
+ * @class AudioMixer
+ * @brief Plays several `AudioFile` sources at once.
+ *
+ * Each source is rendered into its own scratch buffer, then all of them are
+ * summed with a per-source Q15 gain into 32-bit accumulators and saturated
+ * back to 16 bits by `mixSaturate`. Sources are owned by the mixer and deleted
+ * as soon as they complete. All sources must share one sample rate.
+ */
+class AudioMixer : public AudioFile {
+  private:
+    struct Channel {
+        AudioFile *source;
+        int16_t gain;    /**< Q15 */
+        Frame_t *frames; /**< Scratch buffer of `m_max_frames` frames */
+    };
+
+    int m_max_frames;
+    Channel m_channels[AUDIO_MIXER_MAX_SOURCES];
+    int m_channel_count;
+
+    int renderChannels(int number_frames);
+    void mixChannels(Frame_t *base, Frame_t *output, int number_frames);
+    void removeCompleted();
+
+  public:
+    /**
+     * @param max_frames Largest block rendered per source in one step,
+     * longer requests are processed in several steps.
+     */
+    AudioMixer(int max_frames);
+    ~AudioMixer();
+
+    /**
+     * @brief Starts playing `source` on top of the current sources.
+     *
+     * @param source Source to add, owned by the mixer from now on.
+     * @param gain Q15 gain, `AUDIO_DSP_UNITY_GAIN` keeps the source level.
+     * @return `false` if the mixer is full, the sample rate does not match or
+     * the scratch buffer could not be allocated, in which case the source has
+     * already been deleted.
+     */
+    bool addSource(AudioFile *source, int16_t gain);
+
+    /**
+     * @brief Number of sources still playing.
+     */
+    int sourceCount() { return m_channel_count; }
+
+    /**
+     * @brief Adds the mixed sources on top of existing frames.
+     *
+     * Lets a caller lay sources over audio it rendered itself without an extra
+     * buffer, the existing frames are kept at unity gain.
+     */
+    void mixInto(Frame_t *frames, int number_frames);
+
+    /**
+     * @brief Drops every source.
+     */
+    void clear();
+
+    /**
+     * @brief Sample rate shared by the sources, 0 while the mixer is empty.
+     */
+    int sampleRate();
+    int getFrames(Frame_t *frames, int number_frames);
+    int remainingFrames();
+    bool isComplete() { return m_channel_count == 0; }
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "AudioSocket.h"
+#include "AudioEngine.h"
+#include "Globals.h"
+#include "JitterBuffer.h"
+#include "StreamBuffer.h"
+#include <ArduinoJson.h>
+#include <memory>
+
+const size_t SOCKET_BUFFER_SIZE = 256 * 1024;
+
+static AsyncWebSocket audioSocket(AUDIO_SOCKET_PATH);
+
+// State of the stream being received, only touched on the web server task
+static std::shared_ptr<StreamBuffer> socketStream;
+static std::shared_ptr<JitterStats> streamStats =
+    std::make_shared<JitterStats>();
+static uint32_t streamClient = 0;
+static audio_packet_header_t streamFormat;
+static uint16_t expectedSequence = 0;
+static bool messageAccepted = false;
+// Tail of a frame split between two pieces of a message
+static uint8_t partialFrame[2 * sizeof(int16_t)];
+static size_t partialBytes = 0;
+
+/**
+ * @brief Lets the current stream play out and forgets about it.
+ */
+static void endStream() {
+    if (socketStream) {
+        socketStream->finish();
+        socketStream.reset();
+    }
+}
+
+/**
+ * @brief Starts a new stream in the format of `header`, replacing whatever
+ * is playing.
+ */
+static bool startStream(AsyncWebSocketClient *client,
+                        const audio_packet_header_t &header) {
+    endStream();
+
+    std::shared_ptr<StreamBuffer> stream =
+        std::make_shared<StreamBuffer>(SOCKET_BUFFER_SIZE);
+    if (!stream->isAllocated()) {
+        logger.println("Socket stream buffer allocation FAILURE.");
+        return false;
+    }
+
+    // Fresh counters, but keep the buffering target learned on this link
+    std::shared_ptr<JitterStats> stats = std::make_shared<JitterStats>();
+    stats->target_ms = streamStats->target_ms.load();
+    if (!audioEngine.play(new JitterBuffer(stream, stats, header.sample_rate,
+                                           header.channels))) {
+        return false;
+    }
+
+    socketStream = stream;
+    streamStats = stats;
+    streamClient = client->id();
+    streamFormat = header;
+    expectedSequence = header.sequence;
+    return true;
+}
+
+/**
+ * @brief Checks the header of a new message and decides whether its
+ * samples are played.
+ */
+static bool acceptPacket(AsyncWebSocketClient *client,
+                         const audio_packet_header_t &header,
+                         size_t payloadBytes) {
+    if (header.format != AUDIO_SOCKET_FORMAT_PCM16 || header.channels < 1 ||
+        header.channels > 2 || header.sample_rate < AUDIO_SOCKET_MIN_RATE ||
+        header.sample_rate > AUDIO_SOCKET_MAX_RATE ||
+        payloadBytes % (sizeof(int16_t) * header.channels) != 0) {
+        // A partial frame would shift every later sample by a byte
+        streamStats->dropped++;
+        return false;
+    }
+
+    // The engine drops the stream when something else is played
+    if (socketStream && socketStream->isAborted()) {
+        socketStream.reset();
+    }
+
+    bool sameStream = socketStream && client->id() == streamClient &&
+                      header.channels == streamFormat.channels &&
+                      header.sample_rate == streamFormat.sample_rate;
+    if (!sameStream) {
+        return startStream(client, header);
+    }
+
+    int16_t gap = (int16_t)(header.sequence - expectedSequence);
+    if (gap < 0) {
+        // Its slot in the stream has already been played
+        streamStats->late++;
+        return false;
+    }
+    streamStats->lost += gap;
+    return true;
+}
+
+/**
+ * @brief Writes whole frames to the stream. On overrun only the frames that
+ * fit are written and the rest of the message is dropped, so the stream
+ * stays frame-aligned.
+ */
+static bool writeFrames(const uint8_t *data, size_t len) {
+    size_t frameBytes = sizeof(int16_t) * streamFormat.channels;
+    size_t room = socketStream->freeSpace();
+    room -= room % frameBytes;
+    if (len > room) {
+        // The client is far ahead of playback, the tail is lost
+        socketStream->write(data, room);
+        streamStats->dropped++;
+        messageAccepted = false;
+        return false;
+    }
+    socketStream->write(data, len);
+    return true;
+}
+
+static void writeSamples(const uint8_t *data, size_t len) {
+    size_t frameBytes = sizeof(int16_t) * streamFormat.channels;
+    if (partialBytes > 0) {
+        size_t part = min(len, frameBytes - partialBytes);
+        memcpy(partialFrame + partialBytes, data, part);
+        partialBytes += part;
+        data += part;
+        len -= part;
+        if (partialBytes < frameBytes) {
+            return;
+        }
+        partialBytes = 0;
+        if (!writeFrames(partialFrame, frameBytes)) {
+            return;
+        }
+    }
+    size_t whole = len - len % frameBytes;
+    if (!writeFrames(data, whole)) {
+        return;
+    }
+    partialBytes = len - whole;
+    memcpy(partialFrame, data + whole, partialBytes);
+}
+
+static void handleBinary(AsyncWebSocketClient *client, AwsFrameInfo *info,
+                         uint8_t *data, size_t len) {
+    // Long messages arrive in several pieces, the header is in the first
+    if (info->num == 0 && info->index == 0) {
+        messageAccepted = false;
+        partialBytes = 0;
+        if (len < sizeof(audio_packet_header_t)) {
+            streamStats->dropped++;
+            return;
+        }
+        audio_packet_header_t header;
+        memcpy(&header, data, sizeof(header));
+        messageAccepted =
+            acceptPacket(client, header, info->len - sizeof(header));
+        if (messageAccepted) {
+            streamStats->packets++;
+            expectedSequence = header.sequence + 1;
+        }
+        data += sizeof(header);
+        len -= sizeof(header);
+    }
+
+    if (messageAccepted && socketStream) {
+        writeSamples(data, len);
+    }
+}
+
+/**
+ * @brief Formats the jitter buffer counters of the current stream.
+ */
+static String statsJson(const char *type) {
+    return String("{\"type\":\"") + type +
+           "\", \"packets\":" + String(streamStats->packets) +
+           ", \"lost\":" + String(streamStats->lost) +
+           ", \"late\":" + String(streamStats->late) +
+           ", \"dropped\":" + String(streamStats->dropped) +
+           ", \"underruns\":" + String(streamStats->underruns) +
+           ", \"depthMs\":" + String(streamStats->depth_ms) +
+           ", \"targetMs\":" + String(streamStats->target_ms) + "}";
+}
+
+static void handleText(AsyncWebSocketClient *client, uint8_t *data,
+                       size_t len) {
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, data, len);
+    if (error) {
+        client->text("{\"error\":\"Invalid JSON\"}");
+        return;
+    }
+
+    String type = doc["type"] | "";
+    if (type == "end") {
+        endStream();
+        client->text(statsJson("ended"));
+    } else if (type == "stats") {
+        client->text(statsJson("stats"));
+    } else if (type == "stop") {
+        endStream();
+        audioEngine.stop();
+        client->text("{\"type\":\"stopped\"}");
+    } else {
+        client->text("{\"error\":\"Unknown message type\"}");
+    }
+}
+
+static void onSocketEvent(AsyncWebSocket *socket, AsyncWebSocketClient *client,
+                          AwsEventType type, void *arg, uint8_t *data,
+                          size_t len) {
+    switch (type) {
+    case WS_EVT_CONNECT:
+        logger.println("Audio socket client connected.");
+        break;
+    case WS_EVT_DISCONNECT:
+        if (client->id() == streamClient) {
+            endStream();
+        }
+        break;
+    case WS_EVT_DATA: {
+        AwsFrameInfo *info = (AwsFrameInfo *)arg;
+        if (info->opcode == WS_BINARY ||
+            (info->opcode == WS_CONTINUATION &&
+             info->message_opcode == WS_BINARY)) {
+            handleBinary(client, info, data, len);
+        } else if (info->opcode == WS_TEXT && info->final &&
+                   info->index == 0 && len == info->len) {
+            handleText(client, data, len);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void initializeAudioSocket() {
+    audioSocket.onEvent(onSocketEvent);
+    server.addHandler(&audioSocket);
+}
+
+void cleanupAudioSocket() { audioSocket.cleanupClients(); }
@@ -0,0 +1,62 @@
+#ifndef AUDIO_SOCKET_H
+#define AUDIO_SOCKET_H
+
+#include <stdint.h>
+
+/**
+ * @brief Path of the realtime audio WebSocket.
+ */
+#define AUDIO_SOCKET_PATH "/audio/ws"
+
+/**
+ * @brief `format` of a packet holding interleaved little-endian 16-bit PCM.
+ */
+#define AUDIO_SOCKET_FORMAT_PCM16 1
+
+/**
+ * @brief Range of sample rates accepted, the rates the resampler converts
+ * to the engine's output rate.
+ */
+#define AUDIO_SOCKET_MIN_RATE 8000
+#define AUDIO_SOCKET_MAX_RATE 48000
+
+/**
+ * @struct audio_packet_header_t
+ * @brief Header in front of the samples of every binary WebSocket message.
+ */
+#pragma pack(push, 1)
+typedef struct {
+    uint8_t format;       /**< `AUDIO_SOCKET_FORMAT_PCM16` */
+    uint8_t channels;     /**< 1 or 2 */
+    uint16_t sequence;    /**< Incremented per packet, wraps around */
+    uint32_t sample_rate; /**< In Hz, 8000 to 48000 */
+} audio_packet_header_t;
+#pragma pack(pop)
+
+/**
+ * @brief Registers the realtime audio WebSocket on the web server.
+ *
+ * A client keeps one connection open per conversation and sends each speech
+ * delta as a binary message: an `audio_packet_header_t` followed by the
+ * samples. The first packet starts playback (interrupting anything else),
+ * later ones are appended to the same adaptive `JitterBuffer`, so speech
+ * plays while it is still being generated. A packet with a different format
+ * starts a new stream.
+ *
+ * Text messages control the stream:
+ * - `{"type":"end"}` lets the stream play out and reports its counters.
+ * - `{"type":"stats"}` reports the counters of the current stream.
+ * - `{"type":"stop"}` stops playback right away.
+ *
+ * Packets that arrive after a later sequence number are dropped as late,
+ * skipped sequence numbers are counted as lost. Packets whose samples are
+ * not a whole number of frames are dropped.
+ */
+void initializeAudioSocket();
+
+/**
+ * @brief Frees the clients of closed connections, call periodically.
+ */
+void cleanupAudioSocket();
+
+#endif // AUDIO_SOCKET_H
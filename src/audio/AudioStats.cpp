@@ -0,0 +1,111 @@
+#include "AudioStats.h"
+#include "AudioEngine.h"
+#include "DecodeAhead.h"
+#include <esp_timer.h>
+
+/**
+ * @brief Length of one DMA buffer, the nominal TX_DONE interval.
+ */
+#define AUDIO_STATS_DMA_PERIOD_US                                              \
+    ((int64_t)AUDIO_ENGINE_DMA_FRAMES * 1000000 / AUDIO_ENGINE_OUTPUT_RATE)
+
+AudioStats audioStats;
+
+void LatencyHistogram::record(uint32_t us) {
+    int bucket = 0;
+    while (bucket < AUDIO_STATS_BUCKETS - 1 && (us >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    m_buckets[bucket]++;
+    m_sum_us += us;
+    m_count++;
+    if (us > m_max_us) {
+        m_max_us = us;
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < AUDIO_STATS_BUCKETS; i++) {
+        m_buckets[i] = 0;
+    }
+    m_count = 0;
+    m_max_us = 0;
+    m_sum_us = 0;
+}
+
+void LatencyHistogram::toJson(JsonObject object) {
+    uint32_t count = m_count;
+    object["count"] = count;
+    object["meanUs"] = count > 0 ? (uint32_t)(m_sum_us / count) : 0;
+    object["maxUs"] = (uint32_t)m_max_us;
+
+    // Trailing empty buckets are left out
+    int used = AUDIO_STATS_BUCKETS;
+    while (used > 0 && m_buckets[used - 1] == 0) {
+        used--;
+    }
+    JsonArray buckets = object["buckets"].to<JsonArray>();
+    for (int i = 0; i < used; i++) {
+        buckets.add((uint32_t)m_buckets[i]);
+    }
+}
+
+AudioStats::AudioStats()
+    : m_last_tx_done(0), m_probe_start(0), m_probe_armed(false), blocks(0),
+      txDone(0), dmaUnderruns(0), lastClipLatencyUs(0) {}
+
+void AudioStats::recordTxDone(int64_t now) {
+    if (m_last_tx_done != 0) {
+        int64_t deviation = now - m_last_tx_done - AUDIO_STATS_DMA_PERIOD_US;
+        txDoneJitter.record(deviation < 0 ? -deviation : deviation);
+    }
+    m_last_tx_done = now;
+    txDone++;
+}
+
+void AudioStats::armClipProbe() {
+    m_probe_start = esp_timer_get_time();
+    m_probe_armed.store(true, std::memory_order_release);
+}
+
+bool AudioStats::claimClipProbe(int64_t &start) {
+    if (!m_probe_armed.exchange(false, std::memory_order_acquire)) {
+        return false;
+    }
+    start = m_probe_start;
+    return true;
+}
+
+void AudioStats::reset() {
+    getFrames.reset();
+    i2sWrite.reset();
+    txDoneJitter.reset();
+    clipLatency.reset();
+    blocks = 0;
+    txDone = 0;
+    dmaUnderruns = 0;
+    lastClipLatencyUs = 0;
+}
+
+String AudioStats::toJson() {
+    JsonDocument doc;
+    doc["build"] = __DATE__ " " __TIME__;
+    doc["uptimeMs"] = millis();
+    doc["dmaPeriodUs"] = AUDIO_STATS_DMA_PERIOD_US;
+    // Audio rendered now reaches the speaker after the queued DMA buffers
+    doc["dmaQueueUs"] = AUDIO_STATS_DMA_PERIOD_US * AUDIO_ENGINE_DMA_BUFFERS;
+    doc["blocks"] = (uint32_t)blocks;
+    doc["txDone"] = (uint32_t)txDone;
+    doc["dmaUnderruns"] = (uint32_t)dmaUnderruns;
+    doc["decodeAheadFill"] = decodeAhead.fillPercent();
+    doc["decodeAheadUnderruns"] = decodeAhead.underruns();
+    doc["lastClipLatencyUs"] = (uint32_t)lastClipLatencyUs;
+    getFrames.toJson(doc["getFrames"].to<JsonObject>());
+    i2sWrite.toJson(doc["i2sWrite"].to<JsonObject>());
+    txDoneJitter.toJson(doc["txDoneJitter"].to<JsonObject>());
+    clipLatency.toJson(doc["clipLatency"].to<JsonObject>());
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
@@ -0,0 +1,104 @@
+#ifndef __audio_stats_h__
+#define __audio_stats_h__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+
+/**
+ * @brief Number of power-of-two buckets in a `LatencyHistogram`. Bucket `i`
+ * counts values from 2^i up to 2^(i + 1) microseconds, the last one
+ * everything above, about 8 seconds.
+ */
+#define AUDIO_STATS_BUCKETS 24
+
+/**
+ * @class LatencyHistogram
+ * @brief Count, mean, maximum and log2 histogram of durations in
+ * microseconds.
+ *
+ * Written by a single task and read by the web server. A reader may see a
+ * sample counted in one field but not yet in another, which is fine for
+ * monitoring.
+ */
+class LatencyHistogram {
+  private:
+    std::atomic<uint32_t> m_buckets[AUDIO_STATS_BUCKETS];
+    std::atomic<uint32_t> m_count;
+    std::atomic<uint32_t> m_max_us;
+    uint64_t m_sum_us;
+
+  public:
+    LatencyHistogram() { reset(); }
+
+    void record(uint32_t us);
+    void reset();
+
+    /**
+     * @brief Writes `count`, `meanUs`, `maxUs` and `buckets` into `object`.
+     */
+    void toJson(JsonObject object);
+};
+
+/**
+ * @class AudioStats
+ * @brief Timing of the audio path, to see how close it runs to an underrun
+ * and to compare latency across firmware builds.
+ */
+class AudioStats {
+  private:
+    int64_t m_last_tx_done;
+    int64_t m_probe_start;
+    std::atomic<bool> m_probe_armed;
+
+  public:
+    /** @brief Time to pull one DMA buffer out of the sources. */
+    LatencyHistogram getFrames;
+    /** @brief Time `i2s_write` blocked waiting for a free DMA buffer. */
+    LatencyHistogram i2sWrite;
+    /** @brief Deviation of `I2S_EVENT_TX_DONE` intervals from a DMA period. */
+    LatencyHistogram txDoneJitter;
+    /** @brief First upload byte to first non-silent rendered sample. */
+    LatencyHistogram clipLatency;
+
+    std::atomic<uint32_t> blocks;       /**< DMA buffers written */
+    std::atomic<uint32_t> txDone;       /**< DMA buffers sent */
+    std::atomic<uint32_t> dmaUnderruns; /**< DMA ran out while playing */
+    std::atomic<uint32_t> lastClipLatencyUs;
+
+    AudioStats();
+
+    /**
+     * @brief Timestamps a TX_DONE event, called from the event task.
+     */
+    void recordTxDone(int64_t now);
+
+    /**
+     * @brief Starts a latency measurement for the clip that is about to be
+     * uploaded.
+     */
+    void armClipProbe();
+
+    /**
+     * @brief Hands the pending measurement to the engine, which tags the next
+     * source it is asked to play with it.
+     *
+     * @param start Set to the time the upload started.
+     * @return `false` if no measurement is pending.
+     */
+    bool claimClipProbe(int64_t &start);
+
+    void reset();
+
+    /**
+     * @brief Formats every counter and histogram as a JSON object.
+     */
+    String toJson();
+};
+
+/**
+ * @brief Global audio path statistics.
+ */
+extern AudioStats audioStats;
+
+#endif
@@ -0,0 +1,76 @@
+#include "ClipCache.h"
+#include "Globals.h"
+#include "WAVFileReader.h"
+#include <SPIFFS.h>
+
+ClipCache clipCache(CLIP_CACHE_BUDGET);
+
+ClipCache::ClipCache(size_t budget)
+    : m_budget(budget), m_used(0), m_hits(0), m_misses(0) {}
+
+std::shared_ptr<PSRAMBuffer> ClipCache::get(const char *path) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->path == path) {
+            m_hits++;
+            m_entries.splice(m_entries.begin(), m_entries, it);
+            return it->data;
+        }
+    }
+
+    m_misses++;
+    std::shared_ptr<PSRAMBuffer> data = load(path);
+    if (data) {
+        m_entries.push_front({String(path), data});
+        m_used += data->size();
+    }
+    return data;
+}
+
+bool ClipCache::preload(const char *path) { return get(path) != nullptr; }
+
+void ClipCache::invalidate(const char *path) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->path == path) {
+            m_used -= it->data->size();
+            m_entries.erase(it);
+            return;
+        }
+    }
+}
+
+void ClipCache::evictFor(size_t bytes) {
+    while (!m_entries.empty() && m_used + bytes > m_budget) {
+        m_used -= m_entries.back().data->size();
+        m_entries.pop_back();
+    }
+}
+
+std::shared_ptr<PSRAMBuffer> ClipCache::load(const char *path) {
+    File file = SPIFFS.open(path, "r");
+    if (!file) {
+        return nullptr;
+    }
+    size_t size = file.size();
+    if (size == 0 || size > m_budget) {
+        file.close();
+        return nullptr;
+    }
+
+    evictFor(size);
+    std::shared_ptr<PSRAMBuffer> data = std::make_shared<PSRAMBuffer>(size);
+    if (!*data) {
+        logger.println("Clip cache PSRAM allocation FAILURE.");
+        file.close();
+        return nullptr;
+    }
+
+    // One bulk read instead of many small ones during playback
+    size_t bytesRead = file.read(data->data(), size);
+    file.close();
+    if (bytesRead != size) {
+        return nullptr;
+    }
+    // Done once here so that every later play is a plain copy
+    convertClipToNative(*data);
+    return data;
+}
@@ -0,0 +1,74 @@
+#ifndef __clip_cache_h__
+#define __clip_cache_h__
+
+#include "PSRAMBuffer.h"
+#include <Arduino.h>
+#include <list>
+#include <memory>
+
+/**
+ * @brief PSRAM budget of the clip cache.
+ */
+#define CLIP_CACHE_BUDGET (1024 * 1024)
+
+/**
+ * @class ClipCache
+ * @brief Keeps recently played SPIFFS clips in PSRAM.
+ *
+ * Clips are keyed by path and evicted least recently used first once the
+ * byte budget is exceeded. Readers share the cached buffer, so an evicted
+ * clip that is still playing stays alive until its reader is done.
+ *
+ * Not thread safe, it is only used from the web server task and during
+ * startup.
+ */
+class ClipCache {
+  private:
+    struct Entry {
+        String path;
+        std::shared_ptr<PSRAMBuffer> data;
+    };
+
+    std::list<Entry> m_entries; /**< Most recently used first */
+    size_t m_budget;
+    size_t m_used;
+    uint32_t m_hits;
+    uint32_t m_misses;
+
+    std::shared_ptr<PSRAMBuffer> load(const char *path);
+    void evictFor(size_t bytes);
+
+  public:
+    explicit ClipCache(size_t budget);
+
+    /**
+     * @brief Returns the clip at `path`, loading it on a miss.
+     *
+     * @return The cached file, or null if it does not exist, cannot be read
+     * or is larger than the whole budget.
+     */
+    std::shared_ptr<PSRAMBuffer> get(const char *path);
+
+    /**
+     * @brief Loads `path` ahead of time so its first play is a hit.
+     *
+     * @return `true` if the clip is cached.
+     */
+    bool preload(const char *path);
+
+    /**
+     * @brief Drops `path` from the cache, e.g. after the file changed.
+     */
+    void invalidate(const char *path);
+
+    size_t usedBytes() { return m_used; }
+    uint32_t hits() { return m_hits; }
+    uint32_t misses() { return m_misses; }
+};
+
+/**
+ * @brief Global clip cache used by `playAudioFile`.
+ */
+extern ClipCache clipCache;
+
+#endif
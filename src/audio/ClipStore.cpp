@@ -0,0 +1,226 @@
+#include "ClipStore.h"
+#include "Globals.h"
+#include "WAVFileReader.h"
+#include <SPIFFS.h>
+#include <mbedtls/sha256.h>
+
+#define CLIP_STORE_QUEUE_LENGTH 4
+#define CLIP_STORE_TASK_STACK 4096
+#define CLIP_STORE_TASK_PRIORITY 1
+#define CLIP_STORE_TASK_CORE 0
+
+ClipStore clipStore;
+
+ClipStore::ClipStore() : m_mutex(nullptr), m_jobs(nullptr) {}
+
+/**
+ * @brief Checks that `hash` looks like one of ours before it becomes a path.
+ */
+static bool isValidHash(const String &hash) {
+    if (hash.length() != CLIP_HASH_LENGTH) {
+        return false;
+    }
+    for (size_t i = 0; i < hash.length(); i++) {
+        if (!isxdigit(hash[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClipStore::begin() {
+    if (m_mutex != nullptr) {
+        return true;
+    }
+
+    // Index what previous boots stored, dropping writes cut short by a reset
+    std::list<String> leftovers;
+    File dir = SPIFFS.open(CLIP_STORE_DIR);
+    File file = dir.openNextFile();
+    while (file) {
+        String path = file.path();
+        file.close();
+        String name = path.substring(path.lastIndexOf('/') + 1);
+        if (name.endsWith(".wav")) {
+            m_clips.push_back(name.substring(0, name.length() - 4));
+        } else {
+            leftovers.push_back(path);
+        }
+        file = dir.openNextFile();
+    }
+    for (const String &path : leftovers) {
+        SPIFFS.remove(path);
+    }
+
+    m_mutex = xSemaphoreCreateMutex();
+    m_jobs = xQueueCreate(CLIP_STORE_QUEUE_LENGTH, sizeof(String *));
+    if (m_mutex == nullptr || m_jobs == nullptr ||
+        xTaskCreatePinnedToCore(taskEntry, "Clip Store Task",
+                                CLIP_STORE_TASK_STACK, this,
+                                CLIP_STORE_TASK_PRIORITY, NULL,
+                                CLIP_STORE_TASK_CORE) != pdPASS) {
+        Serial.println("Clip store task creation FAILURE.");
+        m_jobs = nullptr;
+        return false;
+    }
+    return true;
+}
+
+String ClipStore::hashOf(const uint8_t *data, size_t size) {
+    uint8_t digest[32];
+    mbedtls_sha256_ret(data, size, digest, 0);
+    return hashOfDigest(digest);
+}
+
+String ClipStore::hashOfDigest(const uint8_t *digest) {
+    char hex[CLIP_HASH_LENGTH + 1];
+    for (int i = 0; i < CLIP_HASH_LENGTH / 2; i++) {
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    }
+    return String(hex);
+}
+
+String ClipStore::pathFor(const String &hash) {
+    return String(CLIP_STORE_DIR) + "/" + hash + ".wav";
+}
+
+void ClipStore::touch(const String &hash) {
+    for (auto it = m_clips.begin(); it != m_clips.end(); ++it) {
+        if (*it == hash) {
+            m_clips.splice(m_clips.begin(), m_clips, it);
+            return;
+        }
+    }
+}
+
+void ClipStore::persist(const String &hash, std::shared_ptr<PSRAMBuffer> clip) {
+    if (m_jobs == nullptr) {
+        return;
+    }
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool known = false;
+    for (const String &stored : m_clips) {
+        known = known || stored == hash;
+    }
+    for (const PersistJob &job : m_pending) {
+        known = known || job.hash == hash;
+    }
+    if (known) {
+        touch(hash);
+    } else {
+        m_pending.push_back({hash, clip});
+    }
+    xSemaphoreGive(m_mutex);
+    if (known) {
+        return;
+    }
+
+    String *job = new String(hash);
+    if (xQueueSend(m_jobs, &job, 0) != pdPASS) {
+        // Writer is behind, this clip simply will not be stored
+        delete job;
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        m_pending.pop_back();
+        xSemaphoreGive(m_mutex);
+        Serial.println("Clip store queue is full.");
+    }
+}
+
+AudioFile *ClipStore::open(const String &hash) {
+    if (m_mutex == nullptr || !isValidHash(hash)) {
+        return nullptr;
+    }
+
+    std::shared_ptr<PSRAMBuffer> pending;
+    bool stored = false;
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    for (const PersistJob &job : m_pending) {
+        if (job.hash == hash) {
+            pending = job.clip;
+        }
+    }
+    for (const String &clip : m_clips) {
+        stored = stored || clip == hash;
+    }
+    touch(hash);
+    xSemaphoreGive(m_mutex);
+
+    if (pending) {
+        return createPSRAMReader(pending);
+    }
+    return stored ? openAudioFile(pathFor(hash).c_str()) : nullptr;
+}
+
+void ClipStore::taskEntry(void *param) {
+    static_cast<ClipStore *>(param)->run();
+}
+
+void ClipStore::run() {
+    for (;;) {
+        String *hash;
+        if (xQueueReceive(m_jobs, &hash, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+
+        PersistJob job;
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        for (const PersistJob &pending : m_pending) {
+            if (pending.hash == *hash) {
+                job = pending;
+            }
+        }
+        xSemaphoreGive(m_mutex);
+
+        bool written = job.clip && write(job);
+
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        m_pending.remove_if(
+            [&](const PersistJob &pending) { return pending.hash == *hash; });
+        if (written) {
+            m_clips.push_front(*hash);
+        }
+        xSemaphoreGive(m_mutex);
+        delete hash;
+    }
+}
+
+bool ClipStore::makeRoom(size_t bytes) {
+    size_t limit = SPIFFS.totalBytes() * CLIP_STORE_MAX_FILL_PERCENT / 100;
+    while (SPIFFS.usedBytes() + bytes > limit) {
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        if (m_clips.empty()) {
+            xSemaphoreGive(m_mutex);
+            return false;
+        }
+        // A cached copy may outlive the file, it is never looked up again
+        String victim = m_clips.back();
+        m_clips.pop_back();
+        xSemaphoreGive(m_mutex);
+        SPIFFS.remove(pathFor(victim));
+    }
+    return true;
+}
+
+bool ClipStore::write(const PersistJob &job) {
+    size_t size = job.clip->size();
+    if (!makeRoom(size)) {
+        Serial.println("Clip store is full, " + job.hash + " not stored.");
+        return false;
+    }
+
+    // Written under a temporary name so a reset never leaves a partial clip
+    String temporary = String(CLIP_STORE_DIR) + "/" + job.hash + ".tmp";
+    File file = SPIFFS.open(temporary, "w");
+    if (!file) {
+        return false;
+    }
+    size_t written = file.write(job.clip->data(), size);
+    file.close();
+    if (written != size || !SPIFFS.rename(temporary, pathFor(job.hash))) {
+        SPIFFS.remove(temporary);
+        Serial.println("Clip store write FAILURE.");
+        return false;
+    }
+    return true;
+}
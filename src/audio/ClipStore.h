@@ -0,0 +1,103 @@
+#ifndef __clip_store_h__
+#define __clip_store_h__
+
+#include "AudioFile.h"
+#include "PSRAMBuffer.h"
+#include <Arduino.h>
+#include <list>
+#include <memory>
+
+/**
+ * @brief SPIFFS directory holding the stored clips.
+ */
+#define CLIP_STORE_DIR "/clips"
+
+/**
+ * @brief Hex characters of the SHA-256 kept as the clip hash. 16 keep the
+ * path within the SPIFFS name limit.
+ */
+#define CLIP_HASH_LENGTH 16
+
+/**
+ * @brief Fraction of the partition the store may fill, in percent. The rest
+ * is left to the other files and to SPIFFS garbage collection.
+ */
+#define CLIP_STORE_MAX_FILL_PERCENT 85
+
+/**
+ * @class ClipStore
+ * @brief Content-addressed clip storage on SPIFFS.
+ *
+ * Uploaded clips are saved as `/clips/<hash>.wav`, where the hash is the
+ * start of the SHA-256 of the whole WAV file, so a client that has uploaded
+ * a phrase once can replay it by hash instead of uploading it again.
+ *
+ * Writes happen on a low-priority task so a slow flash write never delays
+ * the upload response or playback. Until then the clip is served from the
+ * PSRAM buffer it was uploaded into. When the partition fills up the least
+ * recently played clips are deleted first.
+ */
+class ClipStore {
+  private:
+    struct PersistJob {
+        String hash;
+        std::shared_ptr<PSRAMBuffer> clip;
+    };
+
+    SemaphoreHandle_t m_mutex;
+    QueueHandle_t m_jobs;
+    std::list<String> m_clips; /**< Stored hashes, most recently used first */
+    std::list<PersistJob> m_pending;
+
+    static void taskEntry(void *param);
+    void run();
+    bool write(const PersistJob &job);
+    bool makeRoom(size_t bytes);
+    void touch(const String &hash);
+
+  public:
+    ClipStore();
+
+    /**
+     * @brief Indexes the clips already on SPIFFS and starts the writer task.
+     */
+    bool begin();
+
+    /**
+     * @brief Computes the hash a clip is stored under.
+     */
+    static String hashOf(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Formats a SHA-256 digest computed elsewhere, e.g. piece by piece
+     * while a clip plays, as a clip hash.
+     */
+    static String hashOfDigest(const uint8_t *digest);
+
+    /**
+     * @brief SPIFFS path of the clip with `hash`.
+     */
+    static String pathFor(const String &hash);
+
+    /**
+     * @brief Queues `clip` to be written under `hash`, unless it is already
+     * stored.
+     */
+    void persist(const String &hash, std::shared_ptr<PSRAMBuffer> clip);
+
+    /**
+     * @brief Opens a clip by hash, from PSRAM if it is still waiting to be
+     * written or cached, from SPIFFS otherwise.
+     *
+     * @return A new reader for the clip, or null if the store does not have
+     * it.
+     */
+    AudioFile *open(const String &hash);
+};
+
+/**
+ * @brief Global content-addressed clip store.
+ */
+extern ClipStore clipStore;
+
+#endif
@@ -0,0 +1,247 @@
+#include "CompressedWAVReader.h"
+#include "AudioDSP.h"
+
+namespace {
+
+constexpr int16_t decodeMuLaw(uint8_t value) {
+    value = ~value;
+    int magnitude = (((value & 0x0F) << 3) + 0x84) << ((value & 0x70) >> 4);
+    return (value & 0x80) ? 0x84 - magnitude : magnitude - 0x84;
+}
+
+constexpr int16_t decodeALaw(uint8_t value) {
+    value ^= 0x55;
+    int magnitude = (value & 0x0F) << 4;
+    int segment = (value & 0x70) >> 4;
+    if (segment == 0) {
+        magnitude += 8;
+    } else {
+        magnitude = (magnitude + 0x108) << (segment - 1);
+    }
+    return (value & 0x80) ? magnitude : -magnitude;
+}
+
+/**
+ * G.711 expansion table, evaluated by the compiler so it lives in flash.
+ */
+struct G711Table {
+    int16_t samples[256];
+
+    constexpr G711Table(bool muLaw) : samples() {
+        for (int i = 0; i < 256; i++) {
+            samples[i] = muLaw ? decodeMuLaw(i) : decodeALaw(i);
+        }
+    }
+};
+
+constexpr G711Table MULAW_TABLE(true);
+constexpr G711Table ALAW_TABLE(false);
+
+const int16_t ADPCM_STEPS[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+const int8_t ADPCM_INDEX_ADJUST[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+struct AdpcmChannel {
+    int predictor;
+    int index;
+};
+
+int16_t decodeNibble(AdpcmChannel &channel, uint8_t nibble) {
+    int step = ADPCM_STEPS[channel.index];
+    int difference = step >> 3;
+    if (nibble & 1) {
+        difference += step >> 2;
+    }
+    if (nibble & 2) {
+        difference += step >> 1;
+    }
+    if (nibble & 4) {
+        difference += step;
+    }
+    channel.predictor += (nibble & 8) ? -difference : difference;
+    channel.predictor = constrain(channel.predictor, INT16_MIN, INT16_MAX);
+    channel.index = constrain(channel.index + ADPCM_INDEX_ADJUST[nibble & 7],
+                              0, 88);
+    return channel.predictor;
+}
+
+} // namespace
+
+CompressedWAVReader::CompressedWAVReader(std::shared_ptr<PSRAMBuffer> buffer,
+                                         const wav_format_t &format)
+    : m_buffer(buffer), m_format(format),
+      m_data(m_buffer->data() + format.data_offset),
+      m_data_end(m_data + format.data_length), m_is_complete(false),
+      m_block(nullptr), m_block_frames(0), m_block_position(0) {
+    if (m_format.audio_format != WAV_FORMAT_IMA_ADPCM) {
+        return;
+    }
+
+    size_t headerBytes = 4 * m_format.num_channels;
+    if (m_format.samples_per_block == 0) {
+        m_format.samples_per_block =
+            (m_format.block_align - headerBytes) * 2 / m_format.num_channels +
+            1;
+    }
+    m_block = (int16_t *)malloc(m_format.samples_per_block *
+                                m_format.num_channels * sizeof(int16_t));
+    if (m_block == nullptr) {
+        Serial.println("ADPCM block buffer allocation FAILURE.");
+        m_is_complete = true;
+    }
+}
+
+CompressedWAVReader::~CompressedWAVReader() { free(m_block); }
+
+bool CompressedWAVReader::supports(const wav_format_t &format) {
+    switch (format.audio_format) {
+    case WAV_FORMAT_ALAW:
+    case WAV_FORMAT_MULAW:
+        return format.bit_depth == 8;
+    case WAV_FORMAT_IMA_ADPCM:
+        return format.bit_depth == 4 &&
+               format.block_align > 4 * format.num_channels;
+    default:
+        return false;
+    }
+}
+
+bool CompressedWAVReader::decodeNextBlock() {
+    int channels = m_format.num_channels;
+    size_t headerBytes = 4 * channels;
+    size_t bytes = min((size_t)m_format.block_align,
+                       (size_t)(m_data_end - m_data));
+    if (bytes <= headerBytes) {
+        return false;
+    }
+
+    // Each block starts with the exact first sample and step index of every
+    // channel
+    AdpcmChannel state[2];
+    for (int channel = 0; channel < channels; channel++) {
+        const uint8_t *header = m_data + 4 * channel;
+        state[channel].predictor = (int16_t)(header[0] | (header[1] << 8));
+        state[channel].index = min((int)header[2], 88);
+        m_block[channel] = state[channel].predictor;
+    }
+
+    int frames = 1 + (bytes - headerBytes) * 2 / channels;
+    frames = min(frames, (int)m_format.samples_per_block);
+
+    // Then groups of 4 bytes (8 nibbles, low nibble first) per channel,
+    // with the channels interleaved group by group
+    const uint8_t *input = m_data + headerBytes;
+    const uint8_t *end = m_data + bytes;
+    for (int first = 1; first < frames; first += 8) {
+        for (int channel = 0; channel < channels; channel++) {
+            for (int i = 0; i < 8 && input < end; i += 2, input++) {
+                int frame = first + i;
+                if (frame < frames) {
+                    m_block[frame * channels + channel] =
+                        decodeNibble(state[channel], *input & 0x0F);
+                }
+                if (frame + 1 < frames) {
+                    m_block[(frame + 1) * channels + channel] =
+                        decodeNibble(state[channel], *input >> 4);
+                }
+            }
+        }
+    }
+
+    m_data += bytes;
+    m_block_frames = frames;
+    m_block_position = 0;
+    return true;
+}
+
+int CompressedWAVReader::render(int16_t *samples, int number_frames) {
+    int channels = m_format.num_channels;
+    int produced = 0;
+    while (!m_is_complete && produced < number_frames) {
+        int16_t *output = samples + produced * channels;
+        int count;
+        if (m_format.audio_format == WAV_FORMAT_IMA_ADPCM) {
+            if (m_block_position >= m_block_frames && !decodeNextBlock()) {
+                m_is_complete = true;
+                break;
+            }
+            count = min(number_frames - produced,
+                        m_block_frames - m_block_position);
+            memcpy(output, m_block + m_block_position * channels,
+                   count * channels * sizeof(int16_t));
+            m_block_position += count;
+        } else {
+            const int16_t *table = m_format.audio_format == WAV_FORMAT_MULAW
+                                       ? MULAW_TABLE.samples
+                                       : ALAW_TABLE.samples;
+            count = min(number_frames - produced,
+                        (int)((m_data_end - m_data) / channels));
+            if (count == 0) {
+                m_is_complete = true;
+                break;
+            }
+            for (int i = 0; i < count * channels; i++) {
+                output[i] = table[m_data[i]];
+            }
+            m_data += count * channels;
+        }
+        produced += count;
+    }
+
+    if (remainingFrames() == 0) {
+        m_is_complete = true;
+    }
+    if (produced < number_frames) {
+        memset(samples + produced * channels, 0,
+               (number_frames - produced) * channels * sizeof(int16_t));
+    }
+    return produced;
+}
+
+int CompressedWAVReader::getFrames(Frame_t *frames, int number_frames) {
+    if (m_format.num_channels == 1) {
+        // Decode into the upper half of the buffer and expand in place
+        int16_t *samples = (int16_t *)frames + number_frames;
+        int produced = render(samples, number_frames);
+        expandMonoToStereo(samples, (int16_t *)frames, number_frames);
+        return produced;
+    }
+    return render((int16_t *)frames, number_frames);
+}
+
+int CompressedWAVReader::getSamples(int16_t *samples, int number_samples) {
+    if (m_format.num_channels != 1) {
+        memset(samples, 0, number_samples * sizeof(int16_t));
+        return 0;
+    }
+    return render(samples, number_samples);
+}
+
+int CompressedWAVReader::remainingFrames() {
+    if (m_is_complete) {
+        return 0;
+    }
+    int channels = m_format.num_channels;
+    size_t bytes = m_data_end - m_data;
+    if (m_format.audio_format != WAV_FORMAT_IMA_ADPCM) {
+        return bytes / channels;
+    }
+
+    int frames = m_block_frames - m_block_position;
+    frames += bytes / m_format.block_align * m_format.samples_per_block;
+    size_t tail = bytes % m_format.block_align;
+    size_t headerBytes = 4 * channels;
+    if (tail > headerBytes) {
+        frames += 1 + (tail - headerBytes) * 2 / channels;
+    }
+    return frames;
+}
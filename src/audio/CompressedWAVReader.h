@@ -0,0 +1,55 @@
+#ifndef __compressed_wav_reader_h__
+#define __compressed_wav_reader_h__
+
+#include "AudioFile.h"
+#include "PSRAMBuffer.h"
+#include "WAVFormat.h"
+#include <memory>
+
+/**
+ * @class CompressedWAVReader
+ * @brief Plays IMA-ADPCM, mu-law and A-law WAV clips held in PSRAM.
+ *
+ * The clip stays compressed in memory and is decoded a little at a time in
+ * `getFrames`: G.711 samples through a 256-entry lookup table, IMA-ADPCM one
+ * block at a time into a small internal buffer.
+ */
+class CompressedWAVReader : public AudioFile {
+  private:
+    std::shared_ptr<PSRAMBuffer> m_buffer;
+    wav_format_t m_format;
+    const uint8_t *m_data;    /**< Next undecoded byte */
+    const uint8_t *m_data_end;
+    bool m_is_complete;
+
+    // IMA-ADPCM block decoded ahead of the consumer
+    int16_t *m_block;
+    int m_block_frames;
+    int m_block_position;
+
+    bool decodeNextBlock();
+    int render(int16_t *samples, int number_frames);
+
+  public:
+    /**
+     * @param buffer Whole WAV file, only read so it may be shared.
+     * @param format Format parsed from `buffer` by `parseWAVFormat`.
+     */
+    CompressedWAVReader(std::shared_ptr<PSRAMBuffer> buffer,
+                        const wav_format_t &format);
+    ~CompressedWAVReader();
+
+    /**
+     * @brief Checks whether `format` is one this reader can decode.
+     */
+    static bool supports(const wav_format_t &format);
+
+    int sampleRate() { return m_format.sample_rate; }
+    int numChannels() { return m_format.num_channels; }
+    int getFrames(Frame_t *frames, int number_frames);
+    int getSamples(int16_t *samples, int number_samples);
+    int remainingFrames();
+    bool isComplete() { return m_is_complete; }
+};
+
+#endif
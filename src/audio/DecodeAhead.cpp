@@ -0,0 +1,156 @@
+#include "DecodeAhead.h"
+
+#define DECODE_AHEAD_TASK_STACK 4096
+#define DECODE_AHEAD_TASK_PRIORITY 3
+#define DECODE_AHEAD_TASK_CORE 1
+#define DECODE_AHEAD_IDLE_MS 10
+
+DecodeAhead decodeAhead;
+
+DecodeAheadReader::DecodeAheadReader(
+    std::shared_ptr<StreamBuffer> buffer,
+    std::shared_ptr<std::atomic<int>> source_remaining, int sample_rate,
+    int num_channels)
+    : StreamingWAVReader(buffer, sample_rate, num_channels,
+                         buffer->capacity() / 4),
+      m_source_remaining(source_remaining) {}
+
+int DecodeAheadReader::remainingFrames() {
+    int pending = *m_source_remaining;
+    if (isComplete() || pending < 0) {
+        return isComplete() ? 0 : -1;
+    }
+    return pending + m_buffer->available() / (sizeof(int16_t) * m_num_channels);
+}
+
+int DecodeAheadReader::getFrames(Frame_t *frames, int number_frames) {
+    int produced = StreamingWAVReader::getFrames(frames, number_frames);
+    // Room was made, let the producer top the buffer up
+    xTaskNotifyGive(decodeAhead.taskHandle());
+    return produced;
+}
+
+int DecodeAheadReader::getSamples(int16_t *samples, int number_samples) {
+    int produced = StreamingWAVReader::getSamples(samples, number_samples);
+    xTaskNotifyGive(decodeAhead.taskHandle());
+    return produced;
+}
+
+DecodeAhead::DecodeAhead()
+    : m_mutex(nullptr), m_taskHandle(nullptr), m_fill_percent(-1),
+      m_underruns(0), m_finished_underruns(0) {}
+
+bool DecodeAhead::begin() {
+    if (m_taskHandle != nullptr) {
+        return true;
+    }
+    m_mutex = xSemaphoreCreateMutex();
+    if (m_mutex == nullptr ||
+        xTaskCreatePinnedToCore(taskEntry, "Decode Ahead Task",
+                                DECODE_AHEAD_TASK_STACK, this,
+                                DECODE_AHEAD_TASK_PRIORITY, &m_taskHandle,
+                                DECODE_AHEAD_TASK_CORE) != pdPASS) {
+        Serial.println("Decode ahead task creation FAILURE.");
+        m_taskHandle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+AudioFile *DecodeAhead::wrap(AudioFile *source) {
+    if (m_taskHandle == nullptr || source->isComplete()) {
+        return source;
+    }
+    std::shared_ptr<StreamBuffer> buffer =
+        std::make_shared<StreamBuffer>(DECODE_AHEAD_BUFFER_SIZE);
+    if (!buffer->isAllocated()) {
+        return source;
+    }
+
+    int channels = source->numChannels();
+    Stream stream = {source, buffer,
+                     std::make_shared<std::atomic<int>>(
+                         source->remainingFrames()),
+                     channels};
+    AudioFile *reader = new DecodeAheadReader(
+        buffer, stream.source_remaining, source->sampleRate(), channels);
+
+    // Nobody else knows the stream yet, so it can be filled right here.
+    // Holding the mutex keeps `m_chunk` to ourselves.
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    while (fill(stream)) {
+    }
+    if (buffer->isFinished()) {
+        // Short clip, already completely buffered
+        delete source;
+    } else {
+        m_streams.push_back(stream);
+    }
+    xSemaphoreGive(m_mutex);
+    return reader;
+}
+
+bool DecodeAhead::fill(Stream &stream) {
+    size_t frameBytes = sizeof(int16_t) * stream.channels;
+    size_t bytes = DECODE_AHEAD_CHUNK_FRAMES * frameBytes;
+    if (stream.buffer->isFinished() || stream.buffer->freeSpace() < bytes) {
+        return false;
+    }
+
+    int produced;
+    if (stream.channels == 1) {
+        produced =
+            stream.source->getSamples(m_chunk, DECODE_AHEAD_CHUNK_FRAMES);
+    } else {
+        produced = stream.source->getFrames((Frame_t *)m_chunk,
+                                            DECODE_AHEAD_CHUNK_FRAMES);
+    }
+    // The producer is the only writer, so everything fits
+    stream.buffer->write((uint8_t *)m_chunk, produced * frameBytes);
+    *stream.source_remaining = stream.source->remainingFrames();
+
+    if (stream.source->isComplete()) {
+        stream.buffer->finish();
+        return false;
+    }
+    return true;
+}
+
+void DecodeAhead::taskEntry(void *param) {
+    static_cast<DecodeAhead *>(param)->run();
+}
+
+void DecodeAhead::run() {
+    for (;;) {
+        bool busy = false;
+        int lowestFill = -1;
+        uint32_t activeUnderruns = 0;
+
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        for (auto it = m_streams.begin(); it != m_streams.end();) {
+            Stream &stream = *it;
+            if (stream.buffer->isAborted() || stream.buffer->isFinished()) {
+                // The reader is gone or the source is fully buffered
+                m_finished_underruns += stream.buffer->underruns();
+                delete stream.source;
+                it = m_streams.erase(it);
+                continue;
+            }
+
+            busy = fill(stream) || busy;
+
+            int percent = stream.buffer->available() * 100 /
+                          stream.buffer->capacity();
+            lowestFill = lowestFill < 0 ? percent : min(lowestFill, percent);
+            activeUnderruns += stream.buffer->underruns();
+            ++it;
+        }
+        xSemaphoreGive(m_mutex);
+
+        m_fill_percent = lowestFill;
+        m_underruns = m_finished_underruns + activeUnderruns;
+        if (!busy) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DECODE_AHEAD_IDLE_MS));
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef __decode_ahead_h__
+#define __decode_ahead_h__
+
+#include "AudioFile.h"
+#include "StreamBuffer.h"
+#include "StreamingWAVReader.h"
+#include <Arduino.h>
+#include <atomic>
+#include <list>
+#include <memory>
+
+/**
+ * @brief Bytes of decoded audio buffered ahead of each wrapped source, about
+ * a second of 16 kHz mono or a third of a second of 48 kHz stereo.
+ */
+#define DECODE_AHEAD_BUFFER_SIZE (32 * 1024)
+
+/**
+ * @brief Frames the producer reads from a source at a time.
+ */
+#define DECODE_AHEAD_CHUNK_FRAMES 512
+
+/**
+ * @class DecodeAheadReader
+ * @brief Consumer side of a decode-ahead stream, handed to the audio engine
+ * in place of the wrapped source.
+ *
+ * Reading is a copy out of the ring buffer, so the engine task never waits
+ * on the filesystem. If the ring runs dry it plays silence until a quarter
+ * of the ring has been refilled, like any other stream.
+ */
+class DecodeAheadReader : public StreamingWAVReader {
+  private:
+    std::shared_ptr<std::atomic<int>> m_source_remaining;
+
+  public:
+    /**
+     * @param buffer Ring filled by the producer task.
+     * @param source_remaining Frames the source has not yet put into
+     * `buffer`, kept up to date by the producer, -1 when unknown.
+     */
+    DecodeAheadReader(std::shared_ptr<StreamBuffer> buffer,
+                      std::shared_ptr<std::atomic<int>> source_remaining,
+                      int sample_rate, int num_channels);
+    int getFrames(Frame_t *frames, int number_frames);
+    int getSamples(int16_t *samples, int number_samples);
+    int remainingFrames();
+};
+
+/**
+ * @class DecodeAhead
+ * @brief Low-priority task that reads filesystem-backed sources ahead of
+ * playback.
+ *
+ * Each wrapped source gets a single-producer/single-consumer `StreamBuffer`
+ * of decoded frames. This task is the only one touching the source, and the
+ * engine only copies out of the buffer, so a slow flash read (for example
+ * while the clip store is writing) is absorbed by the buffer instead of
+ * delaying the next DMA write.
+ */
+class DecodeAhead {
+  private:
+    struct Stream {
+        AudioFile *source; /**< Owned and only read by the producer task */
+        std::shared_ptr<StreamBuffer> buffer;
+        std::shared_ptr<std::atomic<int>> source_remaining;
+        int channels;
+    };
+
+    SemaphoreHandle_t m_mutex;
+    TaskHandle_t m_taskHandle;
+    std::list<Stream> m_streams;
+    int16_t m_chunk[DECODE_AHEAD_CHUNK_FRAMES * 2];
+    std::atomic<int> m_fill_percent;
+    std::atomic<uint32_t> m_underruns;
+    uint32_t m_finished_underruns; /**< Of streams already removed */
+
+    static void taskEntry(void *param);
+    void run();
+    bool fill(Stream &stream);
+
+  public:
+    DecodeAhead();
+
+    /**
+     * @brief Starts the producer task.
+     */
+    bool begin();
+
+    /**
+     * @brief Moves `source` behind a decode-ahead buffer.
+     *
+     * The buffer is filled on the calling task before this returns, so
+     * playback starts without an underrun. The returned reader takes
+     * ownership of `source`. If the task is not running or the buffer
+     * cannot be allocated, `source` itself is returned.
+     */
+    AudioFile *wrap(AudioFile *source);
+
+    /**
+     * @brief Producer task, notified by readers whenever they make room.
+     */
+    TaskHandle_t taskHandle() { return m_taskHandle; }
+
+    /**
+     * @brief Lowest fill level across the active buffers, in percent, or -1
+     * when nothing is being read ahead.
+     */
+    int fillPercent() { return m_fill_percent; }
+
+    /**
+     * @brief Number of times a decode-ahead buffer ran dry.
+     */
+    uint32_t underruns() { return m_underruns; }
+};
+
+/**
+ * @brief Global decode-ahead producer.
+ */
+extern DecodeAhead decodeAhead;
+
+#endif
@@ -1,19 +1,17 @@
 #ifndef FILE_UPLOAD_HANDLER_H
 #define FILE_UPLOAD_HANDLER_H
 
+#include "PSRAMBuffer.h"
 #include <Arduino.h>
 
 class FileUploadHandler {
   private:
-    uint8_t *buffer;
-    size_t totalSize;
+    PSRAMBuffer buffer;
     size_t currentPosition;
     bool initialized;
 
   public:
-    FileUploadHandler()
-        : buffer(nullptr), totalSize(0), currentPosition(0),
-          initialized(false) {}
+    FileUploadHandler() : currentPosition(0), initialized(false) {}
 
     ~FileUploadHandler() { cleanup(); }
 
@@ -24,37 +22,44 @@ class FileUploadHandler {
             return false;
 
         // Allocate in PSRAM
-        buffer = (uint8_t *)ps_malloc(size);
+        buffer = PSRAMBuffer(size);
         if (!buffer)
             return false;
 
-        totalSize = size;
         currentPosition = 0;
         initialized = true;
         return true;
     }
 
     bool writeChunk(uint8_t *data, size_t len) {
-        if (!initialized || !buffer || currentPosition + len > totalSize) {
+        if (!initialized || !buffer || currentPosition + len > buffer.size()) {
             return false;
         }
 
-        memcpy(buffer + currentPosition, data, len);
+        memcpy(buffer.data() + currentPosition, data, len);
         currentPosition += len;
         return true;
     }
 
+    /**
+     * @brief Hands the received bytes over to the caller without copying.
+     *
+     * The handler is left empty and must be `begin`-ed again before reuse.
+     */
+    PSRAMBuffer release() {
+        buffer.truncate(currentPosition);
+        PSRAMBuffer released = std::move(buffer);
+        cleanup();
+        return released;
+    }
+
     void cleanup() {
-        if (buffer) {
-            free(buffer);
-            buffer = nullptr;
-        }
-        totalSize = 0;
+        buffer.reset();
         currentPosition = 0;
         initialized = false;
     }
 
-    uint8_t *getBuffer() { return buffer; }
+    uint8_t *getBuffer() { return buffer.data(); }
     size_t getSize() { return currentPosition; }
     bool isInitialized() { return initialized; }
 };
@@ -0,0 +1,52 @@
+#include "FlashClipReader.h"
+#include "AudioDSP.h"
+
+FlashClipReader::FlashClipReader(const int16_t *samples, size_t total_frames,
+                                 int num_channels, int sample_rate)
+    : m_samples(samples), m_total_frames(total_frames), m_position(0),
+      m_num_channels(num_channels), m_sample_rate(sample_rate),
+      m_is_complete(total_frames == 0) {}
+
+int FlashClipReader::readFrames(int16_t *destination, int number_frames) {
+    size_t frames = min((size_t)number_frames, m_total_frames - m_position);
+    memcpy(destination, m_samples + m_position * m_num_channels,
+           frames * m_num_channels * sizeof(int16_t));
+    m_position += frames;
+
+    if (frames < (size_t)number_frames) {
+        m_is_complete = true;
+        memset(destination + frames * m_num_channels, 0,
+               (number_frames - frames) * m_num_channels * sizeof(int16_t));
+    }
+    return frames;
+}
+
+int FlashClipReader::getSamples(int16_t *samples, int number_samples) {
+    if (m_is_complete || m_num_channels != 1) {
+        memset(samples, 0, number_samples * sizeof(int16_t));
+        return 0;
+    }
+    return readFrames(samples, number_samples);
+}
+
+int FlashClipReader::getFrames(Frame_t *frames, int number_frames) {
+    if (m_is_complete) {
+        memset(frames, 0, number_frames * sizeof(Frame_t));
+        return 0;
+    }
+    if (m_num_channels == 1) {
+        // Expand directly from flash, no intermediate copy
+        size_t available = m_total_frames - m_position;
+        int framesRead = min((size_t)number_frames, available);
+        expandMonoToStereo(m_samples + m_position, (int16_t *)frames,
+                           framesRead);
+        m_position += framesRead;
+        if (framesRead < number_frames) {
+            m_is_complete = true;
+            memset(frames + framesRead, 0,
+                   (number_frames - framesRead) * sizeof(Frame_t));
+        }
+        return framesRead;
+    }
+    return readFrames((int16_t *)frames, number_frames);
+}
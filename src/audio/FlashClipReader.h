@@ -0,0 +1,46 @@
+#ifndef __flash_clip_reader_h__
+#define __flash_clip_reader_h__
+
+#include "AudioFile.h"
+
+/**
+ * @class FlashClipReader
+ * @brief Plays 16-bit PCM straight out of memory-mapped flash.
+ *
+ * The samples are read through the flash cache, so playing a built-in clip
+ * needs neither a RAM copy nor the filesystem. The mapping must outlive the
+ * reader, which is the case for the clip partition since it is never
+ * unmapped.
+ */
+class FlashClipReader : public AudioFile {
+  private:
+    const int16_t *m_samples;
+    size_t m_total_frames;
+    size_t m_position; /**< Next frame to hand out */
+    int m_num_channels;
+    int m_sample_rate;
+    bool m_is_complete;
+
+    /**
+     * @brief Copies frames in the clip's own channel layout.
+     */
+    int readFrames(int16_t *destination, int number_frames);
+
+  public:
+    /**
+     * @param samples Interleaved PCM samples in mapped flash.
+     * @param total_frames Number of frames at `samples`.
+     * @param num_channels 1 or 2.
+     * @param sample_rate Sample rate of the clip.
+     */
+    FlashClipReader(const int16_t *samples, size_t total_frames,
+                    int num_channels, int sample_rate);
+    int sampleRate() { return m_sample_rate; }
+    int getFrames(Frame_t *frames, int number_frames);
+    int numChannels() { return m_num_channels; }
+    int getSamples(int16_t *samples, int number_samples);
+    int remainingFrames() { return m_total_frames - m_position; }
+    bool isComplete() { return m_is_complete; }
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "FlashClipTable.h"
+#include "FlashClipReader.h"
+
+FlashClipTable flashClips;
+
+FlashClipTable::FlashClipTable()
+    : m_base(nullptr), m_size(0), m_entries(nullptr), m_count(0),
+      m_handle(0) {}
+
+bool FlashClipTable::begin() {
+    if (m_base != nullptr) {
+        return true;
+    }
+
+    const esp_partition_t *partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)FLASH_CLIP_SUBTYPE,
+        FLASH_CLIP_PARTITION);
+    if (partition == nullptr) {
+        return false;
+    }
+
+    const void *mapped;
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size,
+                                       ESP_PARTITION_MMAP_DATA, &mapped,
+                                       &m_handle);
+    if (err != ESP_OK) {
+        Serial.printf("Mapping clip partition FAILURE: 0x%x\n", err);
+        return false;
+    }
+    if (!load((const uint8_t *)mapped, partition->size)) {
+        // An erased or foreign partition, nothing to play from it
+        Serial.println("Clip partition holds no valid clip pack.");
+        esp_partition_munmap(m_handle);
+        return false;
+    }
+    return true;
+}
+
+bool FlashClipTable::load(const uint8_t *base, size_t size) {
+    m_base = base;
+    m_size = size;
+    if (!validate()) {
+        m_base = nullptr;
+        m_size = 0;
+        m_entries = nullptr;
+        m_count = 0;
+        return false;
+    }
+    return true;
+}
+
+bool FlashClipTable::validate() {
+    const flash_clip_header_t *header = (const flash_clip_header_t *)m_base;
+    if (m_size < sizeof(flash_clip_header_t) ||
+        memcmp(header->magic, FLASH_CLIP_MAGIC, 4) != 0 ||
+        header->version != FLASH_CLIP_VERSION) {
+        return false;
+    }
+
+    size_t tableEnd = sizeof(flash_clip_header_t) +
+                      header->clip_count * sizeof(flash_clip_entry_t);
+    if (tableEnd > m_size) {
+        return false;
+    }
+
+    const flash_clip_entry_t *entries =
+        (const flash_clip_entry_t *)(m_base + sizeof(flash_clip_header_t));
+    for (int i = 0; i < header->clip_count; i++) {
+        const flash_clip_entry_t &entry = entries[i];
+        if (entry.data_offset < tableEnd ||
+            entry.data_offset % FLASH_CLIP_ALIGNMENT != 0 ||
+            entry.data_offset > m_size ||
+            entry.data_bytes > m_size - entry.data_offset ||
+            entry.bit_depth != 16 || entry.num_channels < 1 ||
+            entry.num_channels > 2 ||
+            entry.name[FLASH_CLIP_NAME_LENGTH - 1] != '\0') {
+            return false;
+        }
+    }
+
+    m_entries = entries;
+    m_count = header->clip_count;
+    return true;
+}
+
+const flash_clip_entry_t *FlashClipTable::find(const char *name) {
+    for (int i = 0; i < m_count; i++) {
+        if (strcmp(m_entries[i].name, name) == 0) {
+            return &m_entries[i];
+        }
+    }
+    return nullptr;
+}
+
+AudioFile *FlashClipTable::open(const char *name) {
+    const flash_clip_entry_t *entry = find(name);
+    if (entry == nullptr) {
+        return nullptr;
+    }
+    size_t frameBytes = sizeof(int16_t) * entry->num_channels;
+    return new FlashClipReader(
+        (const int16_t *)(m_base + entry->data_offset),
+        entry->data_bytes / frameBytes, entry->num_channels,
+        entry->sample_rate);
+}
@@ -0,0 +1,112 @@
+#ifndef __flash_clip_table_h__
+#define __flash_clip_table_h__
+
+#include "AudioFile.h"
+#include <Arduino.h>
+#include <esp_partition.h>
+
+/**
+ * @brief Label of the optional raw partition holding the packed clips.
+ */
+#define FLASH_CLIP_PARTITION "clips"
+
+/**
+ * @brief Data subtype of the clip partition, from the custom range.
+ */
+#define FLASH_CLIP_SUBTYPE 0x40
+
+#define FLASH_CLIP_MAGIC "BOBC"
+#define FLASH_CLIP_VERSION 1
+#define FLASH_CLIP_NAME_LENGTH 32
+
+/**
+ * @brief Offset of every clip's samples in the pack is a multiple of this,
+ * so the vector kernels can read them without realigning.
+ */
+#define FLASH_CLIP_ALIGNMENT 16
+
+// Layout written by tools/pack_clips.py, all fields little-endian
+#pragma pack(push, 1)
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t clip_count;
+    uint32_t reserved[2];
+} flash_clip_header_t;
+
+typedef struct {
+    char name[FLASH_CLIP_NAME_LENGTH]; /**< SPIFFS style path, NUL padded */
+    uint32_t data_offset;              /**< From the start of the partition */
+    uint32_t data_bytes;
+    uint32_t sample_rate;
+    uint16_t num_channels;
+    uint16_t bit_depth; /**< Always 16 */
+} flash_clip_entry_t;
+#pragma pack(pop)
+
+/**
+ * @class FlashClipTable
+ * @brief Built-in clips packed into a raw flash partition.
+ *
+ * The whole partition is mapped into the data address space once at
+ * startup and stays mapped, clips are then played by `FlashClipReader`s
+ * pointing straight into it. The partition is optional: without it (or
+ * with an invalid pack) every lookup simply misses and clips come from
+ * SPIFFS as before.
+ */
+class FlashClipTable {
+  private:
+    const uint8_t *m_base;
+    size_t m_size;
+    const flash_clip_entry_t *m_entries;
+    uint16_t m_count;
+    spi_flash_mmap_handle_t m_handle;
+
+    bool validate();
+
+  public:
+    FlashClipTable();
+
+    /**
+     * @brief Finds and maps the clip partition.
+     *
+     * @return `true` if a valid clip pack is mapped.
+     */
+    bool begin();
+
+    /**
+     * @brief Uses a clip pack that is already in memory, `begin` calls it
+     * with the mapped partition.
+     *
+     * @param base Start of the pack, it must outlive every reader opened.
+     * @param size Bytes available at `base`.
+     * @return `false` if `base` holds no valid clip pack.
+     */
+    bool load(const uint8_t *base, size_t size);
+
+    /**
+     * @brief Looks up a clip by its path, e.g. "/silence.wav".
+     *
+     * @return The entry, or null if the pack does not hold the clip.
+     */
+    const flash_clip_entry_t *find(const char *name);
+
+    /**
+     * @brief Opens a clip for playback.
+     *
+     * @return A new reader, or null if the pack does not hold the clip.
+     */
+    AudioFile *open(const char *name);
+
+    /**
+     * @brief Number of clips in the mapped pack, 0 when there is none.
+     */
+    int clipCount() { return m_count; }
+};
+
+/**
+ * @brief Global table of the clips in the flash clip partition.
+ */
+extern FlashClipTable flashClips;
+
+#endif
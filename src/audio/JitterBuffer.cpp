@@ -0,0 +1,113 @@
+#include "JitterBuffer.h"
+#include "AudioDSP.h"
+
+JitterBuffer::JitterBuffer(std::shared_ptr<StreamBuffer> buffer,
+                           std::shared_ptr<JitterStats> stats,
+                           int sample_rate, int num_channels)
+    : m_buffer(buffer), m_stats(stats), m_sample_rate(sample_rate),
+      m_num_channels(num_channels),
+      m_frame_bytes(sizeof(int16_t) * num_channels),
+      m_fade_frames(sample_rate * JITTER_FADE_MS / 1000),
+      m_target_ms(stats->target_ms), m_stable_frames(0),
+      m_fade_in_position(0), m_buffering(true), m_is_complete(false) {}
+
+JitterBuffer::~JitterBuffer() {
+    // Let the network side know it can stop pushing data
+    m_buffer->abort();
+}
+
+size_t JitterBuffer::bytesFor(uint32_t ms) {
+    size_t bytes = (size_t)m_sample_rate * m_frame_bytes * ms / 1000;
+    // Leave room in the ring for the producer while the target is held
+    return min(bytes, m_buffer->capacity() / 2);
+}
+
+int JitterBuffer::remainingFrames() {
+    if (!m_buffer->isFinished()) {
+        return -1;
+    }
+    return m_buffer->available() / m_frame_bytes;
+}
+
+int JitterBuffer::render(int16_t *samples, int number_frames) {
+    size_t wanted = number_frames * m_frame_bytes;
+    if (m_is_complete) {
+        memset(samples, 0, wanted);
+        return 0;
+    }
+
+    size_t available = m_buffer->available();
+    bool finished = m_buffer->isFinished();
+    m_stats->depth_ms = available * 1000 / (m_sample_rate * m_frame_bytes);
+
+    if (m_buffering) {
+        if (!finished && available < bytesFor(m_target_ms)) {
+            memset(samples, 0, wanted);
+            return number_frames;
+        }
+        m_buffering = false;
+        m_fade_in_position = 0;
+        m_stable_frames = 0;
+    }
+
+    // Running into the held back fade means the link fell behind
+    size_t reserve = finished ? 0 : m_fade_frames * m_frame_bytes;
+    bool underrun = available < wanted + reserve;
+    size_t toRead = min(wanted, available - available % m_frame_bytes);
+    int framesRead = toRead / m_frame_bytes;
+    m_buffer->read((uint8_t *)samples, toRead);
+
+    if (m_fade_in_position < m_fade_frames) {
+        fadeSamples(samples, framesRead, m_num_channels, m_fade_in_position,
+                    m_fade_frames, true);
+        m_fade_in_position += framesRead;
+    }
+
+    if (underrun && !finished) {
+        uint32_t fade = min((uint32_t)framesRead, m_fade_frames);
+        fadeSamples(samples + (framesRead - fade) * m_num_channels, fade,
+                    m_num_channels, 0, fade, false);
+        m_stats->underruns++;
+        m_target_ms = min(m_target_ms + JITTER_GROW_MS,
+                          (uint32_t)JITTER_MAX_TARGET_MS);
+        m_buffering = true;
+    } else {
+        m_stable_frames += framesRead;
+        if (m_stable_frames >=
+            (uint32_t)m_sample_rate * JITTER_STABLE_MS / 1000) {
+            m_stable_frames = 0;
+            m_target_ms = max(m_target_ms - JITTER_SHRINK_MS,
+                              (uint32_t)JITTER_MIN_TARGET_MS);
+        }
+    }
+    m_stats->target_ms = m_target_ms;
+
+    if (framesRead < number_frames) {
+        memset(samples + framesRead * m_num_channels, 0, wanted - toRead);
+    }
+    if (finished && m_buffer->available() < m_frame_bytes) {
+        m_is_complete = true;
+        return framesRead;
+    }
+    return number_frames;
+}
+
+int JitterBuffer::getFrames(Frame_t *frames, int number_frames) {
+    if (m_num_channels == 1) {
+        // Read mono samples into the upper half of the frame buffer and
+        // expand them in place
+        int16_t *samples = (int16_t *)frames + number_frames;
+        int produced = render(samples, number_frames);
+        expandMonoToStereo(samples, (int16_t *)frames, number_frames);
+        return produced;
+    }
+    return render((int16_t *)frames, number_frames);
+}
+
+int JitterBuffer::getSamples(int16_t *samples, int number_samples) {
+    if (m_num_channels != 1) {
+        memset(samples, 0, number_samples * sizeof(int16_t));
+        return 0;
+    }
+    return render(samples, number_samples);
+}
@@ -0,0 +1,98 @@
+#ifndef __jitter_buffer_h__
+#define __jitter_buffer_h__
+
+#include "AudioFile.h"
+#include "StreamBuffer.h"
+#include <atomic>
+#include <memory>
+
+/**
+ * @brief Bounds and starting point of the adaptive buffering target.
+ */
+#define JITTER_MIN_TARGET_MS 40
+#define JITTER_MAX_TARGET_MS 500
+#define JITTER_INITIAL_TARGET_MS 100
+
+/**
+ * @brief Target added after every underrun.
+ */
+#define JITTER_GROW_MS 60
+
+/**
+ * @brief The target shrinks by `JITTER_SHRINK_MS` after every
+ * `JITTER_STABLE_MS` of playback without an underrun.
+ */
+#define JITTER_STABLE_MS 5000
+#define JITTER_SHRINK_MS 20
+
+/**
+ * @brief Length of the fades that hide a gap.
+ */
+#define JITTER_FADE_MS 5
+
+/**
+ * @struct JitterStats
+ * @brief Counters shared between the network side feeding a `JitterBuffer`
+ * and the engine task playing it.
+ */
+struct JitterStats {
+    std::atomic<uint32_t> packets{0};   /**< Packets written to the buffer */
+    std::atomic<uint32_t> lost{0};      /**< Sequence numbers never seen */
+    std::atomic<uint32_t> late{0};      /**< Arrived after a later packet */
+    std::atomic<uint32_t> dropped{0};   /**< Overruns and invalid packets */
+    std::atomic<uint32_t> underruns{0}; /**< Times playback ran dry */
+    std::atomic<uint32_t> depth_ms{0};  /**< Audio buffered right now */
+    std::atomic<uint32_t> target_ms{JITTER_INITIAL_TARGET_MS};
+};
+
+/**
+ * @class JitterBuffer
+ * @brief Plays network audio out of a `StreamBuffer` with an adaptive
+ * buffering target.
+ *
+ * Playback starts, and resumes after an underrun, once `target_ms` of audio
+ * is buffered. Every underrun raises the target so bursty links get more
+ * headroom, long stable stretches lower it again to cut latency.
+ *
+ * Gaps are concealed: `JITTER_FADE_MS` of audio is held back, so when the
+ * buffer runs dry the last samples fade to silence instead of stopping
+ * abruptly, and playback fades back in when it resumes.
+ */
+class JitterBuffer : public AudioFile {
+  private:
+    std::shared_ptr<StreamBuffer> m_buffer;
+    std::shared_ptr<JitterStats> m_stats;
+    int m_sample_rate;
+    int m_num_channels;
+    size_t m_frame_bytes;
+    uint32_t m_fade_frames;
+    uint32_t m_target_ms;
+    uint32_t m_stable_frames; /**< Frames played since the last change */
+    uint32_t m_fade_in_position;
+    bool m_buffering;
+    bool m_is_complete;
+
+    size_t bytesFor(uint32_t ms);
+    int render(int16_t *samples, int number_frames);
+
+  public:
+    /**
+     * @param buffer Ring buffer filled with raw PCM by the network side.
+     * @param stats Counters to update, shared with the network side.
+     * @param sample_rate Sample rate of the PCM.
+     * @param num_channels Channel count of the PCM (1 or 2).
+     */
+    JitterBuffer(std::shared_ptr<StreamBuffer> buffer,
+                 std::shared_ptr<JitterStats> stats, int sample_rate,
+                 int num_channels);
+    ~JitterBuffer();
+
+    int sampleRate() { return m_sample_rate; }
+    int numChannels() { return m_num_channels; }
+    int getFrames(Frame_t *frames, int number_frames);
+    int getSamples(int16_t *samples, int number_samples);
+    int remainingFrames();
+    bool isComplete() { return m_is_complete; }
+};
+
+#endif
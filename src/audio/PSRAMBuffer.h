@@ -0,0 +1,65 @@
+#ifndef PSRAM_BUFFER_H
+#define PSRAM_BUFFER_H
+
+#include <Arduino.h>
+#include <utility>
+
+/**
+ * @class PSRAMBuffer
+ * @brief Move-only owner of a single PSRAM allocation.
+ *
+ * Audio clips are handed from the upload handler to playback by moving the
+ * buffer, so a clip costs one allocation and is never copied.
+ */
+class PSRAMBuffer {
+  private:
+    uint8_t *m_data;
+    size_t m_size;
+
+  public:
+    PSRAMBuffer() : m_data(nullptr), m_size(0) {}
+
+    explicit PSRAMBuffer(size_t size)
+        : m_data(size ? (uint8_t *)ps_malloc(size) : nullptr),
+          m_size(m_data ? size : 0) {}
+
+    ~PSRAMBuffer() { free(m_data); }
+
+    PSRAMBuffer(const PSRAMBuffer &) = delete;
+    PSRAMBuffer &operator=(const PSRAMBuffer &) = delete;
+
+    PSRAMBuffer(PSRAMBuffer &&other) noexcept
+        : m_data(other.m_data), m_size(other.m_size) {
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+
+    PSRAMBuffer &operator=(PSRAMBuffer &&other) noexcept {
+        if (this != &other) {
+            free(m_data);
+            m_data = other.m_data;
+            m_size = other.m_size;
+            other.m_data = nullptr;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    uint8_t *data() { return m_data; }
+    const uint8_t *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    explicit operator bool() const { return m_data != nullptr; }
+
+    /**
+     * @brief Shrinks the logical size without touching the allocation.
+     *
+     * Used when the allocation was sized from the request's content length,
+     * which includes multipart framing around the file itself.
+     */
+    void truncate(size_t size) { m_size = min(size, m_size); }
+
+    /** @brief Frees the allocation early. */
+    void reset() { *this = PSRAMBuffer(); }
+};
+
+#endif
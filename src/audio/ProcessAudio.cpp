@@ -1,10 +1,18 @@
 #include "ProcessAudio.h"
+#include "AudioEngine.h"
 #include "AudioFile.h"
+#include "AudioStats.h"
+#include "ClipStore.h"
 #include "Camera.h"
 #include "DFRobot_AXP313A.h"
+#include "DecodeAhead.h"
+#include "StreamBuffer.h"
+#include "StreamingWAVReader.h"
 #include "WAVFileReader.h"
 #include "utils/ScreenLogger.h"
 #include <SPIFFS.h>
+#include <memory>
+#include <sdkconfig.h>
 
 volatile bool uploadError = false;
 extern DFRobot_AXP313A cameraPowerDriver;
@@ -14,20 +22,244 @@ static int lastReportedProgress = 0;
 static String message = "";
 static String path = "";
 
+// Playback queue, `/audio?enqueue=1&crossfade=<ms>` appends the clip instead
+// of interrupting what is playing
+static bool enqueueUpload = false;
+static int uploadCrossfadeMs = 0;
+static bool queueRejected = false;
+
+// Mixing, `/audio?overlay=1` plays the clip on top of the queue. `gain`
+// (0 to 1) sets the level of any clip.
+static bool overlayUpload = false;
+static float uploadGain = 1.0f;
+
 // Global buffer management
-static uint8_t *uploadBuffer = nullptr;
-static size_t uploadSize = 0;
-static size_t currentPosition = 0;
-static bool isUploading = false;
+FileUploadHandler uploadHandler;
+
+// Streaming playback, enabled with `/audio?stream=1`. The ring holds about
+// 2.7 s of 48 kHz stereo, the sender is held back by the TCP window while it
+// is full.
+const size_t STREAM_BUFFER_SIZE = 256 * 1024;
+const size_t STREAM_PREROLL_MS = 200;
+// Receive window of a connection, lwIP opens it up to this far past the last
+// byte acknowledged
+const size_t STREAM_RECEIVE_WINDOW = CONFIG_LWIP_TCP_WND_DEFAULT;
+static std::shared_ptr<StreamBuffer> uploadStream;
+static size_t streamHeld = 0; /**< Upload bytes not acknowledged yet */
+static wav_header_t streamHeader;
+static size_t streamHeaderBytes = 0;
+static size_t streamDataRemaining = 0;
+static size_t streamPrerollMs = STREAM_PREROLL_MS;
+static size_t streamPrerollBytes = 0;
+static bool isStreaming = false;
+static bool streamStarted = false;
 
 void cleanupUpload() {
-    if (uploadBuffer != nullptr) {
-        free(uploadBuffer);
-        uploadBuffer = nullptr;
+    uploadHandler.cleanup();
+
+    if (uploadStream) {
+        // A stream left unfinished would otherwise wait for data forever
+        uploadStream->finish();
+        uploadStream.reset();
     }
-    uploadSize = 0;
-    currentPosition = 0;
-    isUploading = false;
+    streamHeaderBytes = 0;
+    streamDataRemaining = 0;
+    streamHeld = 0;
+    isStreaming = false;
+    streamStarted = false;
+}
+
+/**
+ * @brief Validates the buffered WAV header and derives the pre-roll size.
+ *
+ * @return `true` if the stream holds 16-bit mono or stereo PCM.
+ */
+static bool parseStreamHeader() {
+    if (memcmp(streamHeader.riff_header, "RIFF", 4) != 0 ||
+        memcmp(streamHeader.data_header, "data", 4) != 0 ||
+        streamHeader.bit_depth != 16 || streamHeader.num_channels < 1 ||
+        streamHeader.num_channels > 2) {
+        return false;
+    }
+
+    size_t frameBytes = sizeof(int16_t) * streamHeader.num_channels;
+    size_t bytesPerSecond = streamHeader.sample_rate * frameBytes;
+    streamPrerollBytes = bytesPerSecond * streamPrerollMs / 1000;
+    // Leave room in the ring for the producer while the pre-roll is held
+    streamPrerollBytes = min(streamPrerollBytes, uploadStream->capacity() / 2);
+    streamPrerollBytes -= streamPrerollBytes % frameBytes;
+
+    // Some encoders write 0 or -1 as the data size of an open-ended stream
+    streamDataRemaining = streamHeader.data_bytes > 0
+                              ? (size_t)streamHeader.data_bytes
+                              : SIZE_MAX;
+    return true;
+}
+
+/**
+ * @brief Formats the playback queue state for the upload responses.
+ */
+static String queueStatusJson() {
+    return ", \"queueDepth\":" + String(audioEngine.queueDepth()) +
+           ", \"bufferedMs\":" + String(audioEngine.bufferedMs()) +
+           ", \"decodeAheadFill\":" + String(decodeAhead.fillPercent()) +
+           ", \"decodeAheadUnderruns\":" + String(decodeAhead.underruns());
+}
+
+static void startStreamPlayback() {
+    StreamingWAVReader *reader = new StreamingWAVReader(
+        uploadStream, streamHeader.sample_rate, streamHeader.num_channels,
+        streamPrerollBytes);
+    streamStarted = true;
+    // Best effort, without the copy the clip is just not stored
+    if (streamHeader.data_bytes > 0 &&
+        (size_t)streamHeader.data_bytes <= MAX_FILE_SIZE) {
+        reader->keepForStore((const uint8_t *)&streamHeader,
+                             sizeof(wav_header_t), streamHeader.data_bytes);
+    }
+    if (overlayUpload) {
+        queueRejected = !overlayAudioStream(reader, uploadGain);
+        return;
+    }
+    if (!enqueueUpload) {
+        playAudioStream(reader, uploadGain);
+    } else if (!enqueueAudioStream(reader, uploadCrossfadeMs, uploadGain)) {
+        // The reader is gone, so the rest of the upload is discarded
+        queueRejected = true;
+        return;
+    }
+    logger.println("Streaming playback started.");
+}
+
+/**
+ * @brief Acknowledges as much of the held back upload as the ring has room
+ * for. Web server task only.
+ *
+ * Acknowledging reopens the TCP window by as much, so the window never gets
+ * larger than the free space of the ring and the sender is paced by playback
+ * instead of the TCP task waiting for it. Once playback is stopped the rest
+ * of the upload is acknowledged as it arrives, and dropped.
+ */
+static void ackStream(AsyncClient *client) {
+    size_t acked = streamHeld;
+    if (uploadStream && !uploadStream->isAborted()) {
+        size_t room = uploadStream->freeSpace() + streamHeld;
+        acked = room > STREAM_RECEIVE_WINDOW
+                    ? min(streamHeld, room - STREAM_RECEIVE_WINDOW)
+                    : 0;
+    }
+    streamHeld -= min(streamHeld, client->ack(acked));
+}
+
+/**
+ * @brief Acknowledges everything held back, once the upload is over.
+ */
+static void releaseStream(AsyncClient *client) {
+    // Clamped by AsyncTCP to what it holds, including the multipart framing
+    client->ack(SIZE_MAX);
+    streamHeld = 0;
+}
+
+/**
+ * @brief Pushes an upload chunk into the stream. The TCP window keeps the
+ * sender from outrunning the ring, so this never waits for playback on the
+ * TCP task.
+ *
+ * @return `false` if the header is invalid or the sender overran the ring.
+ */
+static bool writeStreamChunk(uint8_t *data, size_t len) {
+    if (streamHeaderBytes < sizeof(wav_header_t)) {
+        size_t headerPart = min(len, sizeof(wav_header_t) - streamHeaderBytes);
+        memcpy((uint8_t *)&streamHeader + streamHeaderBytes, data, headerPart);
+        streamHeaderBytes += headerPart;
+        data += headerPart;
+        len -= headerPart;
+
+        if (streamHeaderBytes == sizeof(wav_header_t) && !parseStreamHeader()) {
+            logger.println("Unsupported WAV header for streaming");
+            return false;
+        }
+    }
+
+    if (uploadStream->isAborted()) {
+        // Playback was stopped, discard the rest of the upload
+        return true;
+    }
+
+    // Ignore trailing chunks after the PCM data
+    len = min(len, streamDataRemaining);
+    streamDataRemaining -= len;
+    if (uploadStream->write(data, len) < len) {
+        logger.println("Stream buffer full");
+        return false;
+    }
+
+    if (!streamStarted && streamHeaderBytes == sizeof(wav_header_t) &&
+        uploadStream->available() >= streamPrerollBytes) {
+        startStreamPlayback();
+    }
+    return true;
+}
+
+/**
+ * @brief Upload handler body for `/audio?stream=1`.
+ */
+static void handleStreamUpload(AsyncWebServerRequest *request,
+                               const String &clientIP, uint8_t *data,
+                               size_t len, bool final) {
+    if (!uploadStream) {
+        // An earlier chunk failed, drop the rest of the request
+        releaseStream(request->client());
+        return;
+    }
+
+    // Held back until the ring has room for it, see `ackStream`
+    request->client()->ackLater();
+    streamHeld += len;
+
+    if (len && !writeStreamChunk(data, len)) {
+        uploadError = true;
+        uploadStream->finish();
+        uploadStream.reset();
+        releaseStream(request->client());
+        request->send(500, "application/json",
+                      "{\"error\":\"Audio stream error\"}");
+        digitalWrite(PROCESSING_LED_PIN, LOW);
+        return;
+    }
+
+    if (final) {
+        uploadStream->finish();
+        if (!streamStarted && streamHeaderBytes == sizeof(wav_header_t)) {
+            // Short clip, everything arrived before the pre-roll was reached
+            startStreamPlayback();
+        }
+        // Checked after the short-clip start, which may be rejected too
+        if (queueRejected) {
+            uploadStream.reset();
+            releaseStream(request->client());
+            request->send(503, "application/json",
+                          "{\"error\":\"Playback queue full\"}");
+            digitalWrite(PROCESSING_LED_PIN, LOW);
+            return;
+        }
+
+        uint32_t underruns = uploadStream->underruns();
+        Serial.println("Stream upload complete from " + clientIP +
+                       ", underruns so far: " + String(underruns));
+        request->send(200, "application/json",
+                      "{\"status\":\"Upload successful\", \"size\":" +
+                          String(request->contentLength()) +
+                          ", \"streamed\":true, \"underruns\":" +
+                          String(underruns) + queueStatusJson() + "}");
+
+        // The reader keeps its own reference to the ring buffer
+        uploadStream.reset();
+        releaseStream(request->client());
+        digitalWrite(PROCESSING_LED_PIN, LOW);
+        return;
+    }
+    ackStream(request->client());
 }
 
 void ProcessAudioRequest(AsyncWebServerRequest *request,
@@ -50,6 +282,74 @@ void processStopAudioRequest(AsyncWebServerRequest *request,
         "{\"status\":\"success\",\"message\":\"Audio playback stopped.\"}");
 }
 
+void processAudioStatsRequest(AsyncWebServerRequest *request,
+                              const JsonDocument &doc) {
+    request->send(200, "application/json", audioStats.toJson());
+    if (request->hasParam("reset")) {
+        audioStats.reset();
+    }
+}
+
+void processAudioSettingsRequest(AsyncWebServerRequest *request,
+                                 const JsonDocument &doc) {
+    if (!doc["masterGain"].isNull()) {
+        audioEngine.setMasterGain(doc["masterGain"].as<float>());
+    }
+    if (!doc["fadeInMs"].isNull() || !doc["fadeOutMs"].isNull()) {
+        audioEngine.setFades(doc["fadeInMs"] | audioEngine.fadeInMs(),
+                             doc["fadeOutMs"] | audioEngine.fadeOutMs());
+    }
+    if (!doc["softClip"].isNull()) {
+        audioEngine.setSoftClip(doc["softClip"].as<bool>());
+    }
+
+    JsonDocument responseDoc;
+    responseDoc["masterGain"] = audioEngine.masterGain();
+    responseDoc["fadeInMs"] = audioEngine.fadeInMs();
+    responseDoc["fadeOutMs"] = audioEngine.fadeOutMs();
+    responseDoc["softClip"] = audioEngine.softClipEnabled();
+
+    String response;
+    serializeJson(responseDoc, response);
+    request->send(200, "application/json", response);
+}
+
+void processPlayClipRequest(AsyncWebServerRequest *request,
+                           const JsonDocument &doc) {
+    String hash = doc["hash"] | "";
+    if (hash.length() != CLIP_HASH_LENGTH) {
+        request->send(400, "application/json",
+                      "{\"error\":\"Missing or invalid hash.\"}");
+        return;
+    }
+
+    AudioFile *source = clipStore.open(hash);
+    if (!source) {
+        request->send(404, "application/json",
+                      "{\"error\":\"Clip not found.\"}");
+        return;
+    }
+
+    float gain = doc["gain"] | 1.0f;
+    bool accepted = true;
+    if (doc["overlay"] | false) {
+        accepted = audioEngine.overlay(source, gain);
+    } else if (!(doc["enqueue"] | false)) {
+        audioEngine.play(source, gain);
+    } else {
+        accepted = audioEngine.enqueue(source, doc["crossfadeMs"] | 0, gain);
+    }
+    if (!accepted) {
+        request->send(503, "application/json",
+                      "{\"error\":\"Playback queue full\"" +
+                          queueStatusJson() + "}");
+        return;
+    }
+    request->send(200, "application/json",
+                  "{\"status\":\"success\", \"hash\":\"" + hash + "\"" +
+                      queueStatusJson() + "}");
+}
+
 void handleAudioUpload(AsyncWebServerRequest *request, String filename,
                        size_t index, uint8_t *data, size_t len, bool final) {
     String clientIP = request->client()->remoteIP().toString();
@@ -58,6 +358,7 @@ void handleAudioUpload(AsyncWebServerRequest *request, String filename,
         digitalWrite(PROCESSING_LED_PIN, HIGH);
         uploadError = false;
         logger.println("Audio upload from " + clientIP + " starting...");
+        audioStats.armClipProbe();
         lastReportedProgress = 0;
 
         // Make sure previous upload is cleaned up
@@ -69,10 +370,77 @@ void handleAudioUpload(AsyncWebServerRequest *request, String filename,
         if (path[0] != '/')
             path = "/" + path;
 
-        // Allocate new buffer
-        uploadSize = request->contentLength();
-        uploadBuffer = (uint8_t *)ps_malloc(uploadSize);
-        if (!uploadBuffer) {
+        enqueueUpload = request->hasParam("enqueue");
+        uploadCrossfadeMs = 0;
+        queueRejected = false;
+        overlayUpload = request->hasParam("overlay");
+        uploadGain = 1.0f;
+        if (request->hasParam("gain")) {
+            uploadGain = request->getParam("gain")->value().toFloat();
+        }
+        if (request->hasParam("crossfade")) {
+            uploadCrossfadeMs = request->getParam("crossfade")->value().toInt();
+        }
+
+        if (request->hasParam("stream")) {
+            streamPrerollMs = STREAM_PREROLL_MS;
+            if (request->hasParam("preroll")) {
+                streamPrerollMs =
+                    max(0L, request->getParam("preroll")->value().toInt());
+            }
+            // Set first, so the rest of a rejected upload is dropped
+            isStreaming = true;
+            if (request->contentLength() > MAX_FILE_SIZE) {
+                uploadError = true;
+                logger.println("Audio upload too large");
+                request->send(413, "application/json",
+                              "{\"error\":\"File too large\"}");
+                digitalWrite(PROCESSING_LED_PIN, LOW);
+                return;
+            }
+            uploadStream = std::make_shared<StreamBuffer>(STREAM_BUFFER_SIZE);
+            if (!uploadStream->isAllocated()) {
+                uploadError = true;
+                logger.println("Failed to allocate stream buffer");
+                uploadStream.reset();
+                request->send(500, "application/json",
+                              "{\"error\":\"Failed to allocate buffer\"}");
+                digitalWrite(PROCESSING_LED_PIN, LOW);
+                return;
+            }
+
+            // While the ring is full nothing arrives to acknowledge from,
+            // the poll reopens the window as playback drains it. This takes
+            // the place of the request's own poll handler, which only pushes
+            // out long responses, and the ones sent here fit at once.
+            std::weak_ptr<StreamBuffer> stream = uploadStream;
+            request->client()->onPoll(
+                [stream](void *arg, AsyncClient *client) {
+                    if (uploadStream && stream.lock() == uploadStream) {
+                        ackStream(client);
+                    }
+                },
+                nullptr);
+        }
+    }
+
+    if (isStreaming) {
+        handleStreamUpload(request, clientIP, data, len, final);
+        return;
+    }
+
+    if (!index) {
+        // Allocate new buffer, sized from the request so that the clip itself
+        // is the only copy of the audio in PSRAM
+        if (request->contentLength() > MAX_FILE_SIZE) {
+            uploadError = true;
+            logger.println("Audio upload too large");
+            request->send(413, "application/json",
+                          "{\"error\":\"File too large\"}");
+            digitalWrite(PROCESSING_LED_PIN, LOW);
+            return;
+        }
+        if (!uploadHandler.begin(path, request->contentLength())) {
             uploadError = true;
             logger.println("Failed to allocate PSRAM buffer");
             request->send(500, "application/json",
@@ -80,18 +448,13 @@ void handleAudioUpload(AsyncWebServerRequest *request, String filename,
             digitalWrite(PROCESSING_LED_PIN, LOW);
             return;
         }
-        currentPosition = 0;
-        isUploading = true;
     }
 
-    if (len && uploadBuffer && isUploading) {
-        if (currentPosition + len <= uploadSize) {
-            memcpy(uploadBuffer + currentPosition, data, len);
-            currentPosition += len;
-
+    if (len && uploadHandler.isInitialized()) {
+        if (uploadHandler.writeChunk(data, len)) {
             if (request->contentLength() > 0) {
-                int currentProgress =
-                    (currentPosition * 100) / request->contentLength();
+                int currentProgress = (uploadHandler.getSize() * 100) /
+                                      request->contentLength();
                 int currentFifth = currentProgress / 20;
                 int lastFifth = lastReportedProgress / 20;
 
@@ -114,7 +477,7 @@ void handleAudioUpload(AsyncWebServerRequest *request, String filename,
     }
 
     if (final) {
-        if (!uploadBuffer || !isUploading) {
+        if (!uploadHandler.isInitialized()) {
             uploadError = true;
             logger.println("Upload state error");
             cleanupUpload();
@@ -124,36 +487,45 @@ void handleAudioUpload(AsyncWebServerRequest *request, String filename,
             return;
         }
 
-        logger.println("Upload complete, starting playback...");
+        // Hand the upload buffer straight to playback, and share it with the
+        // clip store so the phrase can be replayed by hash later
+        std::shared_ptr<PSRAMBuffer> clip =
+            std::make_shared<PSRAMBuffer>(uploadHandler.release());
+        size_t finalSize = clip->size();
+        String hash = ClipStore::hashOf(clip->data(), finalSize);
+        // Hashed as sent, stored and played as 16-bit PCM
+        if (convertClipToNative(*clip)) {
+            logger.println("Converted upload to 16-bit PCM.");
+        }
+        clipStore.persist(hash, clip);
 
-        // Create a copy of the buffer for playback
-        uint8_t *playbackBuffer = (uint8_t *)ps_malloc(currentPosition);
-        if (!playbackBuffer) {
+        bool accepted = true;
+        if (overlayUpload) {
+            logger.println("Upload complete, mixing over playback...");
+            accepted = overlayAudioFromPSRAM(clip, uploadGain);
+        } else if (!enqueueUpload) {
+            logger.println("Upload complete, starting playback...");
+            playAudioFromPSRAM(clip, uploadGain);
+        } else if ((accepted = enqueueAudioFromPSRAM(clip, uploadCrossfadeMs,
+                                                     uploadGain))) {
+            logger.println("Upload complete, clip queued.");
+        }
+        if (!accepted) {
             uploadError = true;
-            logger.println("Failed to allocate playback buffer");
-            cleanupUpload();
-            request->send(500, "application/json",
-                          "{\"error\":\"Playback buffer allocation failed\"}");
+            logger.println("Playback queue full");
+            request->send(503, "application/json",
+                          "{\"error\":\"Playback queue full\"}");
             digitalWrite(PROCESSING_LED_PIN, LOW);
             return;
         }
 
-        // Copy the data and clean up upload buffer
-        memcpy(playbackBuffer, uploadBuffer, currentPosition);
-        size_t finalSize = currentPosition;
-
-        // Clean up upload state
-        cleanupUpload();
-
-        // Start playback with the copied buffer
-        playAudioFromPSRAM(playbackBuffer, finalSize);
-
         Serial.println("Upload complete: " + filename + ", size: " +
                        String(finalSize) + " bytes from " + clientIP);
 
         request->send(200, "application/json",
                       "{\"status\":\"Upload successful\", \"size\":" +
-                          String(finalSize) + "}");
+                          String(finalSize) + ", \"hash\":\"" + hash +
+                          "\"" + queueStatusJson() + "}");
         digitalWrite(PROCESSING_LED_PIN, LOW);
     }
 }
@@ -35,6 +35,51 @@ void ProcessAudioRequest(AsyncWebServerRequest *request,
 void processStopAudioRequest(AsyncWebServerRequest *request,
                              const JsonDocument &doc);
 
+/**
+ * @brief Reports the timing statistics of the audio path as JSON.
+ *
+ * Includes histograms of the time spent pulling frames from the sources,
+ * of the time `i2s_write` blocks and of the jitter between DMA completions,
+ * plus the latency from the first upload byte to the first non-silent
+ * sample of that clip. With the `reset` query parameter the statistics are
+ * cleared after they are reported.
+ *
+ * @param request Pointer to the AsyncWebServerRequest object.
+ * @param doc Reference to the JsonDocument containing request data.
+ */
+void processAudioStatsRequest(AsyncWebServerRequest *request,
+                              const JsonDocument &doc);
+
+/**
+ * @brief Reads and changes the settings of the audio output stage.
+ *
+ * Every field of the JSON body is optional: `masterGain` (0 to 1),
+ * `fadeInMs` and `fadeOutMs` for the ramps on start and on stop or
+ * barge-in, and `softClip` to round off peaks. Responds with the settings
+ * now in effect, so an empty object just reads them.
+ *
+ * @param request Pointer to the AsyncWebServerRequest object.
+ * @param doc Reference to the JsonDocument containing request data.
+ */
+void processAudioSettingsRequest(AsyncWebServerRequest *request,
+                                 const JsonDocument &doc);
+
+/**
+ * @brief Plays a clip that was uploaded before, by its content hash.
+ *
+ * Buffered uploads are stored under the first 16 hex digits of their SHA-256
+ * (reported as `hash` in the upload response), so clients can replay a
+ * phrase without sending it again. The JSON body takes `hash` and the same
+ * optional `enqueue`, `crossfadeMs`, `overlay` and `gain` settings as an
+ * upload. Responds with 404 when the clip is not stored, in which case the
+ * client should upload it.
+ *
+ * @param request Pointer to the AsyncWebServerRequest object.
+ * @param doc Reference to the JsonDocument containing request data.
+ */
+void processPlayClipRequest(AsyncWebServerRequest *request,
+                            const JsonDocument &doc);
+
 /**
  * @brief Handles the file upload process for audio files.
  *
@@ -43,6 +88,27 @@ void processStopAudioRequest(AsyncWebServerRequest *request,
  * - File size (max 10MB)
  * - Available SPIFFS space
  *
+ * Besides 16-bit PCM, buffered uploads may be IMA-ADPCM or mu-law/A-law
+ * WAV files, which stay compressed in PSRAM and are decoded during playback.
+ * 24/32-bit and float PCM are converted to 16-bit once, when the upload
+ * completes.
+ *
+ * With the `stream` query parameter the upload is fed into a PSRAM ring
+ * buffer and playback starts as soon as the header and `preroll`
+ * milliseconds of audio (200 by default) have arrived. The ring has a fixed
+ * size, while it is full the upload is held back by the TCP window instead
+ * of being buffered. The clip is stored for `/audio/play` from the bytes
+ * that played, once all of it has, so its hash is not in the response.
+ *
+ * With the `enqueue` query parameter the clip is appended to the playback
+ * queue instead of interrupting the current one, optionally overlapping the
+ * previous clip by `crossfade` milliseconds. With `overlay` it is mixed on
+ * top of the queue, e.g. a sound effect over speech. `gain` (0 to 1) sets
+ * the level of the clip in every mode.
+ * Responses report the queue depth, the milliseconds of audio still
+ * buffered and the lowest fill level (in percent) and underrun count of the
+ * decode-ahead buffers of SPIFFS clips.
+ *
  * @param request Pointer to the AsyncWebServerRequest object
  * @param filename Name of the uploaded file
  * @param index Current position in the upload stream
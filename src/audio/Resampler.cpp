@@ -0,0 +1,235 @@
+#include "Resampler.h"
+#include "AudioDSP.h"
+#include <limits.h>
+#include <numeric>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// std::sin is not constexpr, a short Taylor series is plenty for filter design
+constexpr double constexprSin(double x) {
+    while (x > kPi) {
+        x -= 2 * kPi;
+    }
+    while (x < -kPi) {
+        x += 2 * kPi;
+    }
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double constexprCos(double x) { return constexprSin(x + kPi / 2); }
+
+/**
+ * Blackman-windowed sinc low-pass for upsampling by L and decimating by M,
+ * split into L phases of RESAMPLER_TAPS Q15 coefficients. Evaluated by the
+ * compiler so the tables live in flash.
+ */
+template <int L, int M> struct PolyphaseTable {
+    int16_t taps[L * RESAMPLER_TAPS];
+
+    constexpr PolyphaseTable() : taps() {
+        const int length = L * RESAMPLER_TAPS;
+        // Just below the lower of the two Nyquist frequencies, in cycles per
+        // sample of the upsampled signal
+        const double cutoff = 0.45 / (L > M ? L : M);
+        for (int n = 0; n < length; n++) {
+            double t = n - (length - 1) / 2.0;
+            double sinc = 2 * cutoff;
+            if (t != 0) {
+                sinc = constexprSin(2 * kPi * cutoff * t) / (kPi * t);
+            }
+            double x = 2 * kPi * n / (length - 1);
+            double window =
+                0.42 - 0.5 * constexprCos(x) + 0.08 * constexprCos(2 * x);
+
+            // A gain of L makes up for the zeros stuffed between samples
+            double value = L * sinc * window * 32768.0;
+            value = value >= 0 ? value + 0.5 : value - 0.5;
+            value = value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+
+            // Row `phase` holds h[phase + L * j] for j = 0..RESAMPLER_TAPS-1
+            taps[(n % L) * RESAMPLER_TAPS + n / L] = (int16_t)value;
+        }
+    }
+};
+
+// Common source rates to 48 kHz
+constexpr PolyphaseTable<6, 1> TABLE_8000{};
+constexpr PolyphaseTable<3, 1> TABLE_16000{};
+constexpr PolyphaseTable<320, 147> TABLE_22050{};
+constexpr PolyphaseTable<2, 1> TABLE_24000{};
+constexpr PolyphaseTable<3, 2> TABLE_32000{};
+constexpr PolyphaseTable<160, 147> TABLE_44100{};
+
+struct TableEntry {
+    int up;
+    int down;
+    const int16_t *taps;
+};
+
+const TableEntry TABLES[] = {
+    {6, 1, TABLE_8000.taps},       {3, 1, TABLE_16000.taps},
+    {320, 147, TABLE_22050.taps},  {2, 1, TABLE_24000.taps},
+    {3, 2, TABLE_32000.taps},      {160, 147, TABLE_44100.taps},
+};
+
+} // namespace
+
+Resampler::Resampler(AudioFile *source, int output_rate)
+    : m_source(source), m_output_rate(output_rate),
+      m_channels(source->numChannels()), m_up(1), m_down(1),
+      m_table(nullptr), m_taps(2), m_input(nullptr), m_input_frames(0),
+      m_base(0), m_phase(0), m_end(INT_MAX), m_source_done(false),
+      m_is_complete(false) {
+    int inputRate = source->sampleRate();
+    if (inputRate <= 0 || output_rate <= 0) {
+        m_is_complete = true;
+        return;
+    }
+
+    int divisor = std::gcd(output_rate, inputRate);
+    m_up = output_rate / divisor;
+    m_down = inputRate / divisor;
+    for (const TableEntry &entry : TABLES) {
+        if (entry.up == m_up && entry.down == m_down) {
+            m_table = entry.taps;
+            m_taps = RESAMPLER_TAPS;
+        }
+    }
+
+    size_t frames = m_taps - 1 + RESAMPLER_BLOCK_FRAMES;
+    m_input = (int16_t *)malloc(frames * m_channels * sizeof(int16_t));
+    if (m_input == nullptr) {
+        Serial.println("Resampler buffer allocation FAILURE.");
+        m_is_complete = true;
+        return;
+    }
+
+    // The filter starts out over a history of silence
+    m_input_frames = m_taps - 1;
+    memset(m_input, 0, m_input_frames * m_channels * sizeof(int16_t));
+    m_base = m_input_frames;
+}
+
+Resampler::~Resampler() {
+    delete m_source;
+    free(m_input);
+}
+
+void Resampler::refill() {
+    // Keep the history the filter still needs and append one block
+    int keep = min(m_base - (m_taps - 1), m_input_frames);
+    memmove(m_input, m_input + keep * m_channels,
+            (m_input_frames - keep) * m_channels * sizeof(int16_t));
+    m_input_frames -= keep;
+    m_base -= keep;
+    if (m_end != INT_MAX) {
+        m_end -= keep;
+    }
+
+    int16_t *destination = m_input + m_input_frames * m_channels;
+    if (m_source_done) {
+        // Flush the filter with silence
+        memset(destination, 0,
+               RESAMPLER_BLOCK_FRAMES * m_channels * sizeof(int16_t));
+    } else {
+        int produced =
+            m_channels == 1
+                ? m_source->getSamples(destination, RESAMPLER_BLOCK_FRAMES)
+                : m_source->getFrames((Frame_t *)destination,
+                                      RESAMPLER_BLOCK_FRAMES);
+        if (m_source->isComplete()) {
+            // Play out the filter delay after the last real frame
+            m_source_done = true;
+            m_end = m_input_frames + produced + m_taps / 2;
+        }
+    }
+    m_input_frames += RESAMPLER_BLOCK_FRAMES;
+}
+
+int Resampler::render(int16_t *samples, int number_frames) {
+    int produced = 0;
+    while (!m_is_complete && produced < number_frames) {
+        while (m_base >= m_input_frames) {
+            refill();
+        }
+        if (m_base >= m_end) {
+            m_is_complete = true;
+            break;
+        }
+
+        const int16_t *newest = m_input + m_base * m_channels;
+        int16_t *output = samples + produced * m_channels;
+        for (int channel = 0; channel < m_channels; channel++) {
+            int32_t accumulator;
+            if (m_table != nullptr) {
+                const int16_t *row = m_table + m_phase * m_taps;
+                accumulator = 0;
+                for (int j = 0; j < m_taps; j++) {
+                    accumulator += row[j] * newest[channel - j * m_channels];
+                }
+            } else {
+                int32_t weight = ((int64_t)m_phase << 15) / m_up;
+                accumulator = newest[channel] * weight +
+                              newest[channel - m_channels] * (32768 - weight);
+            }
+            accumulator >>= 15;
+            output[channel] = (int16_t)constrain(accumulator, INT16_MIN,
+                                                 INT16_MAX);
+        }
+
+        m_phase += m_down;
+        m_base += m_phase / m_up;
+        m_phase %= m_up;
+        produced++;
+    }
+
+    if (produced < number_frames) {
+        memset(samples + produced * m_channels, 0,
+               (number_frames - produced) * m_channels * sizeof(int16_t));
+    }
+    return produced;
+}
+
+int Resampler::getFrames(Frame_t *frames, int number_frames) {
+    if (m_channels == 1) {
+        // Render mono into the upper half of the buffer and expand in place
+        int16_t *samples = (int16_t *)frames + number_frames;
+        int produced = render(samples, number_frames);
+        expandMonoToStereo(samples, (int16_t *)frames, number_frames);
+        return produced;
+    }
+    return render((int16_t *)frames, number_frames);
+}
+
+int Resampler::getSamples(int16_t *samples, int number_samples) {
+    if (m_channels != 1) {
+        memset(samples, 0, number_samples * sizeof(int16_t));
+        return 0;
+    }
+    return render(samples, number_samples);
+}
+
+int Resampler::remainingFrames() {
+    if (m_is_complete) {
+        return 0;
+    }
+    int inputFrames;
+    if (m_source_done) {
+        inputFrames = max(m_end - m_base, 0);
+    } else {
+        int sourceFrames = m_source->remainingFrames();
+        if (sourceFrames < 0) {
+            return -1;
+        }
+        inputFrames = sourceFrames + (m_input_frames - m_base);
+    }
+    return (int64_t)inputFrames * m_up / m_down;
+}
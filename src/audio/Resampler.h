@@ -0,0 +1,66 @@
+#ifndef __resampler_h__
+#define __resampler_h__
+
+#include "AudioFile.h"
+
+/**
+ * @brief Filter taps applied per output sample on the polyphase path.
+ */
+#define RESAMPLER_TAPS 16
+
+/**
+ * @brief Input frames pulled from the wrapped source per refill.
+ */
+#define RESAMPLER_BLOCK_FRAMES 256
+
+/**
+ * @class Resampler
+ * @brief Converts an `AudioFile` to another sample rate on the fly.
+ *
+ * The rational ratio `L / M` between the output and input rates selects one
+ * of the precomputed polyphase filter tables (8, 16, 22.05, 24, 32 and
+ * 44.1 kHz to 48 kHz). Each output sample is a 16-tap Q15 dot product over
+ * the input history. Ratios without a table fall back to linear
+ * interpolation.
+ *
+ * The wrapped source is owned by the resampler and keeps its channel layout,
+ * so mono sources stay on the mono output path.
+ */
+class Resampler : public AudioFile {
+  private:
+    AudioFile *m_source;
+    int m_output_rate;
+    int m_channels;
+    int m_up;   /**< L, phases per input sample */
+    int m_down; /**< M, phase advance per output sample */
+    const int16_t *m_table; /**< `m_up` rows of taps, null for linear */
+    int m_taps;
+
+    int16_t *m_input;     /**< History plus one refill, interleaved */
+    int m_input_frames;   /**< Valid frames in `m_input` */
+    int m_base;           /**< Newest input frame under the filter */
+    int m_phase;          /**< Position between `m_base` and the next frame */
+    int m_end;            /**< Input frame where the output ends */
+    bool m_source_done;
+    bool m_is_complete;
+
+    void refill();
+    int render(int16_t *samples, int number_frames);
+
+  public:
+    /**
+     * @param source Source to convert, owned by the resampler.
+     * @param output_rate Sample rate to produce.
+     */
+    Resampler(AudioFile *source, int output_rate);
+    ~Resampler();
+
+    int sampleRate() { return m_output_rate; }
+    int numChannels() { return m_channels; }
+    int getFrames(Frame_t *frames, int number_frames);
+    int getSamples(int16_t *samples, int number_samples);
+    int remainingFrames();
+    bool isComplete() { return m_is_complete; }
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include "PSRAMBuffer.h"
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * @class StreamBuffer
+ * @brief Single-producer/single-consumer byte ring buffer allocated in PSRAM.
+ *
+ * The producer (the AsyncTCP task handling an upload) writes bytes as they
+ * arrive, and the consumer (the I2S writer task) reads them back. The only
+ * state shared between the two sides is the atomic fill level and the
+ * finished/aborted flags, so no locking is needed.
+ */
+class StreamBuffer {
+  private:
+    PSRAMBuffer m_storage;
+    uint8_t *m_buffer;
+    size_t m_capacity;
+    size_t m_read_position;  /**< Owned by the consumer */
+    size_t m_write_position; /**< Owned by the producer */
+    std::atomic<size_t> m_fill;
+    std::atomic<bool> m_finished;
+    std::atomic<bool> m_aborted;
+    std::atomic<uint32_t> m_underruns;
+
+  public:
+    explicit StreamBuffer(size_t capacity)
+        : m_storage(capacity), m_buffer(m_storage.data()),
+          m_capacity(m_storage.size()), m_read_position(0),
+          m_write_position(0), m_fill(0), m_finished(false), m_aborted(false),
+          m_underruns(0) {}
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+    bool isAllocated() const { return m_buffer != nullptr; }
+    size_t capacity() const { return m_capacity; }
+    size_t available() const { return m_fill.load(std::memory_order_acquire); }
+    size_t freeSpace() const { return m_capacity - available(); }
+
+    /**
+     * @brief Copies as many bytes as currently fit into the buffer.
+     *
+     * Producer side only.
+     *
+     * @return Number of bytes actually written.
+     */
+    size_t write(const uint8_t *data, size_t len) {
+        size_t toWrite = min(len, freeSpace());
+        size_t firstPart = min(toWrite, m_capacity - m_write_position);
+        memcpy(m_buffer + m_write_position, data, firstPart);
+        memcpy(m_buffer, data + firstPart, toWrite - firstPart);
+        m_write_position = (m_write_position + toWrite) % m_capacity;
+        m_fill.fetch_add(toWrite, std::memory_order_release);
+        return toWrite;
+    }
+
+    /**
+     * @brief Copies up to `len` buffered bytes out of the buffer.
+     *
+     * Consumer side only.
+     *
+     * @return Number of bytes actually read.
+     */
+    size_t read(uint8_t *data, size_t len) {
+        size_t toRead = min(len, available());
+        size_t firstPart = min(toRead, m_capacity - m_read_position);
+        memcpy(data, m_buffer + m_read_position, firstPart);
+        memcpy(data + firstPart, m_buffer, toRead - firstPart);
+        m_read_position = (m_read_position + toRead) % m_capacity;
+        m_fill.fetch_sub(toRead, std::memory_order_release);
+        return toRead;
+    }
+
+    /** @brief Marks the end of the stream; no more data will be written. */
+    void finish() { m_finished.store(true, std::memory_order_release); }
+    bool isFinished() const {
+        return m_finished.load(std::memory_order_acquire);
+    }
+
+    /** @brief Signals the producer that nobody will read the data anymore. */
+    void abort() { m_aborted.store(true, std::memory_order_release); }
+    bool isAborted() const {
+        return m_aborted.load(std::memory_order_acquire);
+    }
+
+    void recordUnderrun() {
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint32_t underruns() const {
+        return m_underruns.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
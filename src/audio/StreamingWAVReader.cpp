@@ -0,0 +1,121 @@
+#include "StreamingWAVReader.h"
+#include "AudioDSP.h"
+#include "ClipStore.h"
+
+StreamingWAVReader::StreamingWAVReader(std::shared_ptr<StreamBuffer> buffer,
+                                       int sample_rate, int num_channels,
+                                       size_t preroll_bytes)
+    : m_buffer(buffer), m_num_channels(num_channels),
+      m_sample_rate(sample_rate), m_preroll_bytes(preroll_bytes),
+      m_is_complete(false), m_rebuffering(false), m_kept_bytes(0) {
+    mbedtls_sha256_init(&m_sha);
+}
+
+StreamingWAVReader::~StreamingWAVReader() {
+    // Let the upload handler know it can stop pushing data
+    m_buffer->abort();
+    mbedtls_sha256_free(&m_sha);
+}
+
+bool StreamingWAVReader::keepForStore(const uint8_t *header,
+                                      size_t header_bytes, size_t data_bytes) {
+    m_kept = PSRAMBuffer(header_bytes + data_bytes);
+    if (!m_kept) {
+        return false;
+    }
+    m_kept_bytes = 0;
+    mbedtls_sha256_starts_ret(&m_sha, 0);
+    keep(header, header_bytes);
+    return true;
+}
+
+void StreamingWAVReader::keep(const uint8_t *data, size_t bytes) {
+    if (!m_kept) {
+        return;
+    }
+    // Hashed piece by piece, so finishing the clip costs no more than a block
+    bytes = min(bytes, m_kept.size() - m_kept_bytes);
+    memcpy(m_kept.data() + m_kept_bytes, data, bytes);
+    mbedtls_sha256_update_ret(&m_sha, data, bytes);
+    m_kept_bytes += bytes;
+}
+
+void StreamingWAVReader::storeKept() {
+    if (!m_kept || m_kept_bytes != m_kept.size()) {
+        // Cut short, or the header announced more than arrived
+        m_kept.reset();
+        return;
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_finish_ret(&m_sha, digest);
+    clipStore.persist(ClipStore::hashOfDigest(digest),
+                      std::make_shared<PSRAMBuffer>(std::move(m_kept)));
+}
+
+int StreamingWAVReader::remainingFrames() {
+    if (!m_buffer->isFinished()) {
+        return -1;
+    }
+    return m_buffer->available() / (sizeof(int16_t) * m_num_channels);
+}
+
+int StreamingWAVReader::readFrames(uint8_t *destination, int number_frames) {
+    size_t frameBytes = sizeof(int16_t) * m_num_channels;
+    size_t wanted = number_frames * frameBytes;
+    if (m_is_complete) {
+        memset(destination, 0, wanted);
+        return 0;
+    }
+
+    size_t available = m_buffer->available();
+    bool finished = m_buffer->isFinished();
+
+    if (m_rebuffering && (available >= m_preroll_bytes || finished)) {
+        m_rebuffering = false;
+    }
+
+    if (!finished && (m_rebuffering || available < wanted)) {
+        if (!m_rebuffering) {
+            m_buffer->recordUnderrun();
+            m_rebuffering = true;
+        }
+        memset(destination, 0, wanted);
+        return number_frames;
+    }
+
+    // Only consume whole frames, a trailing odd byte is dropped at the end
+    size_t toRead = min(wanted, available - available % frameBytes);
+    int framesRead = toRead / frameBytes;
+    m_buffer->read(destination, toRead);
+    keep(destination, toRead);
+
+    if (framesRead < number_frames) {
+        memset(destination + toRead, 0, wanted - toRead);
+        if (finished && m_buffer->available() < frameBytes) {
+            m_is_complete = true;
+            storeKept();
+            return framesRead;
+        }
+    }
+    return number_frames;
+}
+
+int StreamingWAVReader::getSamples(int16_t *samples, int number_samples) {
+    if (m_num_channels != 1) {
+        memset(samples, 0, number_samples * sizeof(int16_t));
+        return 0;
+    }
+    return readFrames((uint8_t *)samples, number_samples);
+}
+
+int StreamingWAVReader::getFrames(Frame_t *frames, int number_frames) {
+    if (m_num_channels == 1) {
+        // Read mono samples into the upper half of the frame buffer and
+        // expand them in place
+        int16_t *samples = (int16_t *)frames + number_frames;
+        int framesRead = readFrames((uint8_t *)samples, number_frames);
+        expandMonoToStereo(samples, (int16_t *)frames, number_frames);
+        return framesRead;
+    }
+    return readFrames((uint8_t *)frames, number_frames);
+}
@@ -0,0 +1,78 @@
+#ifndef __streaming_wav_reader_h__
+#define __streaming_wav_reader_h__
+
+#include "AudioFile.h"
+#include "PSRAMBuffer.h"
+#include "StreamBuffer.h"
+#include <mbedtls/sha256.h>
+#include <memory>
+
+/**
+ * @class StreamingWAVReader
+ * @brief Plays PCM data out of a `StreamBuffer` while it is still being
+ * filled.
+ *
+ * When the buffer runs dry before the producer has finished, the reader emits
+ * silence, records an underrun and waits until the pre-roll has been buffered
+ * again before resuming, so a slow network produces gaps instead of crackle.
+ *
+ * With `keepForStore` the bytes are also copied out as they play, so a clip
+ * that plays to the end can be stored without the upload being buffered a
+ * second time.
+ */
+class StreamingWAVReader : public AudioFile {
+  protected:
+    std::shared_ptr<StreamBuffer> m_buffer;
+    int m_num_channels;
+
+  private:
+    int m_sample_rate;
+    size_t m_preroll_bytes;
+    bool m_is_complete;
+    bool m_rebuffering;
+    PSRAMBuffer m_kept; /**< Header and the PCM data played so far */
+    size_t m_kept_bytes;
+    mbedtls_sha256_context m_sha; /**< Of `m_kept`, updated as it fills */
+
+    void keep(const uint8_t *data, size_t bytes);
+    void storeKept();
+
+    /**
+     * @brief Reads frames in the stream's own channel layout, emitting
+     * silence while rebuffering.
+     */
+    int readFrames(uint8_t *destination, int number_frames);
+
+  public:
+    /**
+     * @param buffer Ring buffer shared with the upload handler. The header has
+     * already been consumed, only PCM data is expected.
+     * @param sample_rate Sample rate from the WAV header.
+     * @param num_channels Channel count from the WAV header (1 or 2).
+     * @param preroll_bytes Bytes to buffer again after an underrun.
+     */
+    StreamingWAVReader(std::shared_ptr<StreamBuffer> buffer, int sample_rate,
+                       int num_channels, size_t preroll_bytes);
+    ~StreamingWAVReader();
+
+    /**
+     * @brief Copies the clip as it plays and hands it to `clipStore` once
+     * all of it has played. A clip stopped before the end is not stored.
+     *
+     * @param header The header the upload started with, it is part of the
+     * stored file and of its hash.
+     * @param header_bytes Length of `header`.
+     * @param data_bytes PCM bytes announced by the header.
+     * @return `false` if there is no room for the copy.
+     */
+    bool keepForStore(const uint8_t *header, size_t header_bytes,
+                      size_t data_bytes);
+    int sampleRate() { return m_sample_rate; }
+    int getFrames(Frame_t *frames, int number_frames);
+    int numChannels() { return m_num_channels; }
+    int getSamples(int16_t *samples, int number_samples);
+    int remainingFrames();
+    bool isComplete() { return m_is_complete; }
+};
+
+#endif
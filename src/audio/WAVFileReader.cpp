@@ -1,164 +1,264 @@
 #include "WAVFileReader.h"
+#include "AudioDSP.h"
+#include "ClipCache.h"
+#include "CompressedWAVReader.h"
+#include "DecodeAhead.h"
+#include "FlashClipTable.h"
 #include "AudioFile.h"
 #include "Globals.h"
-#include "I2SOutput.h"
+#include "AudioEngine.h"
 #include <FS.h>
 #include <SPIFFS.h>
 
-#pragma pack(push, 1)
-typedef struct {
-    char riff_header[4];
-    int wav_size;
-    char wave_header[4];
-    char fmt_header[4];
-    int fmt_chunk_size;
-    short audio_format;
-    short num_channels;
-    int sample_rate;
-    int byte_rate;
-    short sample_alignment;
-    short bit_depth;
-    char data_header[4];
-    int data_bytes;
-} wav_header_t;
-#pragma pack(pop)
-
-static I2SOutput *currentOutput = nullptr;
-static WAVFileReader *currentWav = nullptr;
-static volatile bool isPlaying = false;
+static size_t readFile(void *context, size_t offset, uint8_t *destination,
+                       size_t bytes) {
+    File *file = (File *)context;
+    if (!file->seek(offset)) {
+        return 0;
+    }
+    return file->read(destination, bytes);
+}
 
 WAVFileReader::WAVFileReader(const char *file_name)
-    : m_is_complete(false), m_using_psram(false), m_psram_buffer(nullptr) {
+    : m_num_channels(1), m_sample_rate(0), m_is_complete(false),
+      m_needs_conversion(false), m_using_psram(false), m_data_start(0),
+      m_data_length(0) {
     if (!SPIFFS.exists(file_name)) {
         Serial.println(
             "Failed to open file! Have you uploaded the file system?");
+        m_is_complete = true;
         return;
     }
     m_file = SPIFFS.open(file_name, "r");
 
-    wav_header_t wav_header;
-    m_file.read((uint8_t *)&wav_header, sizeof(wav_header_t));
-
-    if (wav_header.bit_depth != 16) {
-        Serial.printf("ERROR: bit depth %d is not supported\n",
-                      wav_header.bit_depth);
+    wav_format_t format;
+    bool parsed = walkWAVChunks(readFile, &m_file, m_file.size(), format);
+    if (useFormat(parsed, format)) {
+        m_file.seek(m_data_start);
     }
-
-    m_num_channels = wav_header.num_channels;
-    m_sample_rate = wav_header.sample_rate;
-    m_data_length = wav_header.data_bytes;
-    m_data_start = m_file.position();
 }
 
-WAVFileReader::WAVFileReader(uint8_t *buffer, size_t size)
-    : m_is_complete(false), m_using_psram(true), m_psram_buffer(buffer),
-      m_buffer_size(size), m_current_position(0) {
-    wav_header_t wav_header;
-    memcpy(&wav_header, buffer, sizeof(wav_header_t));
+WAVFileReader::WAVFileReader(PSRAMBuffer &&buffer)
+    : WAVFileReader(std::make_shared<PSRAMBuffer>(std::move(buffer))) {}
 
-    if (wav_header.bit_depth != 16) {
-        Serial.printf("ERROR: bit depth %d is not supported\n",
-                      wav_header.bit_depth);
+WAVFileReader::WAVFileReader(std::shared_ptr<PSRAMBuffer> buffer)
+    : m_num_channels(1), m_sample_rate(0), m_is_complete(false),
+      m_needs_conversion(false), m_using_psram(true), m_psram_buffer(buffer),
+      m_buffer_size(0), m_current_position(0), m_data_start(0),
+      m_data_length(0) {
+    wav_format_t format;
+    bool parsed =
+        parseWAVFormat(m_psram_buffer->data(), m_psram_buffer->size(), format);
+    if (useFormat(parsed, format)) {
+        m_current_position = m_data_start;
+        m_buffer_size = m_data_start + m_data_length;
     }
+}
 
-    m_num_channels = wav_header.num_channels;
-    m_sample_rate = wav_header.sample_rate;
-    m_data_length = wav_header.data_bytes;
-    m_data_start = sizeof(wav_header_t);
-    m_current_position = m_data_start;
+/**
+ * @brief Takes the stream parameters from a parsed header, or marks the
+ * reader complete when the data cannot be copied out as 16-bit PCM.
+ */
+bool WAVFileReader::useFormat(bool parsed, const wav_format_t &format) {
+    if (!parsed) {
+        Serial.println("ERROR: not a valid WAV file");
+        m_is_complete = true;
+        return false;
+    }
+    m_num_channels = format.num_channels;
+    m_sample_rate = format.sample_rate;
+    if (!isNativeWAVFormat(format)) {
+        m_needs_conversion = canConvertToNativeWAV(format);
+        Serial.printf("ERROR: format %d with bit depth %d is not supported\n",
+                      format.audio_format, format.bit_depth);
+        m_is_complete = true;
+        return false;
+    }
+    m_data_start = format.data_offset;
+    m_data_length = format.data_length;
+    return true;
 }
 
 WAVFileReader::~WAVFileReader() {
     if (!m_using_psram && m_file) {
         m_file.close();
     }
-    if (m_using_psram && m_psram_buffer) {
-        free(m_psram_buffer);
-        m_psram_buffer = nullptr;
+}
+
+size_t WAVFileReader::readBlock(uint8_t *destination, size_t bytes) {
+    if (m_using_psram) {
+        size_t remaining = m_current_position < m_buffer_size
+                               ? m_buffer_size - m_current_position
+                               : 0;
+        bytes = min(bytes, remaining);
+        memcpy(destination, m_psram_buffer->data() + m_current_position,
+               bytes);
+        m_current_position += bytes;
+        return bytes;
     }
+    // Stop at the end of `data`, trailing chunks are not audio
+    size_t end = m_data_start + m_data_length;
+    size_t position = m_file.position();
+    return m_file.read(destination,
+                       min(bytes, position < end ? end - position : 0));
 }
 
-void WAVFileReader::getFrames(Frame_t *frames, int number_frames) {
-    if (m_is_complete || !isPlaying) {
-        for (int i = 0; i < number_frames; i++) {
-            frames[i].left = 0;
-            frames[i].right = 0;
-        }
-        return;
+int WAVFileReader::remainingFrames() {
+    if (m_is_complete) {
+        return 0;
     }
+    size_t position = m_using_psram ? m_current_position : m_file.position();
+    size_t end = m_data_start + m_data_length;
+    size_t remaining = position < end ? end - position : 0;
+    return remaining / (sizeof(int16_t) * m_num_channels);
+}
 
-    for (int i = 0; i < number_frames; i++) {
-        if ((m_using_psram && m_current_position >= m_buffer_size) ||
-            (!m_using_psram && m_file.available() == 0) || !isPlaying) {
-            m_is_complete = true;
-            for (; i < number_frames; i++) {
-                frames[i].left = 0;
-                frames[i].right = 0;
-            }
-            return;
-        }
+int WAVFileReader::getSamples(int16_t *samples, int number_samples) {
+    if (m_is_complete || m_num_channels != 1) {
+        memset(samples, 0, number_samples * sizeof(int16_t));
+        return 0;
+    }
 
-        if (m_using_psram) {
-            memcpy(&frames[i].left, m_psram_buffer + m_current_position,
-                   sizeof(int16_t));
-            m_current_position += sizeof(int16_t);
-            if (m_num_channels == 1) {
-                frames[i].right = frames[i].left;
-            } else {
-                memcpy(&frames[i].right, m_psram_buffer + m_current_position,
-                       sizeof(int16_t));
-                m_current_position += sizeof(int16_t);
-            }
-        } else {
-            m_file.read((uint8_t *)(&frames[i].left), sizeof(int16_t));
-            if (m_num_channels == 1) {
-                frames[i].right = frames[i].left;
-            } else {
-                m_file.read((uint8_t *)(&frames[i].right), sizeof(int16_t));
-            }
-        }
+    size_t bytesRead =
+        readBlock((uint8_t *)samples, number_samples * sizeof(int16_t));
+    int samplesRead = bytesRead / sizeof(int16_t);
+    if (samplesRead < number_samples) {
+        m_is_complete = true;
+        memset(samples + samplesRead, 0,
+               (number_samples - samplesRead) * sizeof(int16_t));
     }
+    return samplesRead;
 }
 
-void playAudioFile(const char *filename, const bool announcePlayback) {
-    stopPlayback();
-    delay(50);
+int WAVFileReader::getFrames(Frame_t *frames, int number_frames) {
+    if (m_num_channels == 1) {
+        // Mono data lands in the upper half of the buffer and is expanded in
+        // place
+        int16_t *samples = (int16_t *)frames + number_frames;
+        int framesRead = getSamples(samples, number_frames);
+        expandMonoToStereo(samples, (int16_t *)frames, number_frames);
+        return framesRead;
+    }
+
+    if (m_is_complete) {
+        memset(frames, 0, number_frames * sizeof(Frame_t));
+        return 0;
+    }
 
+    // One bulk read per request, stereo data already has the Frame_t layout
+    size_t bytesRead =
+        readBlock((uint8_t *)frames, number_frames * sizeof(Frame_t));
+    int framesRead = bytesRead / sizeof(Frame_t);
+
+    if (framesRead < number_frames) {
+        m_is_complete = true;
+        memset(frames + framesRead, 0,
+               (number_frames - framesRead) * sizeof(Frame_t));
+    }
+    return framesRead;
+}
+
+/**
+ * @brief Reads a whole SPIFFS clip into PSRAM and converts it to 16-bit PCM.
+ */
+static std::shared_ptr<PSRAMBuffer> loadConvertedClip(const char *filename) {
+    File file = SPIFFS.open(filename, "r");
+    if (!file) {
+        return nullptr;
+    }
+    std::shared_ptr<PSRAMBuffer> clip =
+        std::make_shared<PSRAMBuffer>(file.size());
+    bool loaded = *clip && file.read(clip->data(), clip->size()) ==
+                               clip->size();
+    file.close();
+    if (!loaded || !convertClipToNative(*clip)) {
+        logger.println("Converting " + String(filename) + " FAILURE.");
+        return nullptr;
+    }
+    return clip;
+}
+
+void playAudioFile(const char *filename, const bool announcePlayback) {
     if (announcePlayback) {
         logger.println("Playing audio file: " + String(filename));
     }
-    currentWav = new WAVFileReader(filename);
-    currentOutput = new I2SOutput();
-
-    i2s_pin_config_t pins = getDefaultI2SPins();
-    isPlaying = true;
-    currentOutput->start(I2S_NUM_1, pins, currentWav);
+    audioEngine.play(openAudioFile(filename));
 }
 
-void playAudioFromPSRAM(uint8_t *buffer, size_t size) {
-    stopPlayback();
-    delay(50);
+AudioFile *openAudioFile(const char *filename) {
+    // Built-in clips play straight from the mapped clip partition
+    AudioFile *builtIn = flashClips.open(filename);
+    if (builtIn) {
+        return builtIn;
+    }
 
-    currentWav = new WAVFileReader(buffer, size);
-    currentOutput = new I2SOutput();
+    // Served from PSRAM when the clip fits the cache, otherwise from SPIFFS
+    std::shared_ptr<PSRAMBuffer> clip = clipCache.get(filename);
+    if (clip) {
+        return createPSRAMReader(clip);
+    }
 
-    i2s_pin_config_t pins = getDefaultI2SPins();
-    isPlaying = true;
-    currentOutput->start(I2S_NUM_1, pins, currentWav);
+    WAVFileReader *reader = new WAVFileReader(filename);
+    if (reader->needsConversion()) {
+        // Too large for the cache, so convert a private copy instead
+        std::shared_ptr<PSRAMBuffer> converted = loadConvertedClip(filename);
+        if (converted) {
+            delete reader;
+            return createPSRAMReader(converted);
+        }
+    }
+    // Flash reads happen on the producer task, not on the engine task
+    return decodeAhead.wrap(reader);
 }
 
-void stopPlayback() {
-    isPlaying = false;
-
-    if (currentOutput != nullptr) {
-        currentOutput->stop();
-        delay(50);
-        delete currentOutput;
-        currentOutput = nullptr;
+bool convertClipToNative(PSRAMBuffer &clip) {
+    wav_format_t format;
+    if (!parseWAVFormat(clip.data(), clip.size(), format) ||
+        !canConvertToNativeWAV(format)) {
+        return false;
     }
+    size_t size = convertToNativeWAV(clip.data(), format);
+    if (size == 0) {
+        return false;
+    }
+    clip.truncate(size);
+    return true;
+}
 
-    if (currentWav != nullptr) {
-        delete currentWav;
-        currentWav = nullptr;
+AudioFile *createPSRAMReader(std::shared_ptr<PSRAMBuffer> buffer) {
+    // Compressed clips stay compressed in PSRAM and are decoded on the fly
+    wav_format_t format;
+    if (parseWAVFormat(buffer->data(), buffer->size(), format) &&
+        CompressedWAVReader::supports(format)) {
+        return new CompressedWAVReader(buffer, format);
     }
+    return new WAVFileReader(buffer);
+}
+
+void playAudioFromPSRAM(std::shared_ptr<PSRAMBuffer> buffer, float gain) {
+    audioEngine.play(createPSRAMReader(buffer), gain);
+}
+
+bool enqueueAudioFromPSRAM(std::shared_ptr<PSRAMBuffer> buffer,
+                           int crossfadeMs, float gain) {
+    return audioEngine.enqueue(createPSRAMReader(buffer), crossfadeMs, gain);
+}
+
+bool overlayAudioFromPSRAM(std::shared_ptr<PSRAMBuffer> buffer, float gain) {
+    return audioEngine.overlay(createPSRAMReader(buffer), gain);
+}
+
+void playAudioStream(StreamingWAVReader *stream, float gain) {
+    audioEngine.play(stream, gain);
+}
+
+bool enqueueAudioStream(StreamingWAVReader *stream, int crossfadeMs,
+                        float gain) {
+    return audioEngine.enqueue(stream, crossfadeMs, gain);
 }
+
+bool overlayAudioStream(StreamingWAVReader *stream, float gain) {
+    return audioEngine.overlay(stream, gain);
+}
+
+void stopPlayback() { audioEngine.stop(); }
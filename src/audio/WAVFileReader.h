@@ -2,33 +2,103 @@
 #define __wav_file_reader_h__
 
 #include "AudioFile.h"
-#include "I2SOutput.h"
+#include "PSRAMBuffer.h"
+#include "StreamingWAVReader.h"
+#include "WAVFormat.h"
 #include <FS.h>
+#include <memory>
+
+#pragma pack(push, 1)
+typedef struct {
+    char riff_header[4];
+    int wav_size;
+    char wave_header[4];
+    char fmt_header[4];
+    int fmt_chunk_size;
+    short audio_format;
+    short num_channels;
+    int sample_rate;
+    int byte_rate;
+    short sample_alignment;
+    short bit_depth;
+    char data_header[4];
+    int data_bytes;
+} wav_header_t;
+#pragma pack(pop)
 
 class WAVFileReader : public AudioFile {
   private:
     int m_num_channels;
     int m_sample_rate;
     bool m_is_complete;
+    bool m_needs_conversion;
     bool m_using_psram;
-    uint8_t *m_psram_buffer;
+    std::shared_ptr<PSRAMBuffer> m_psram_buffer; /**< May be shared */
     size_t m_buffer_size;
     size_t m_current_position;
     File m_file;
     size_t m_data_start;
     size_t m_data_length;
 
+    size_t readBlock(uint8_t *destination, size_t bytes);
+    bool useFormat(bool parsed, const wav_format_t &format);
+
   public:
     WAVFileReader(const char *file_name);
-    WAVFileReader(uint8_t *buffer, size_t size);
+    WAVFileReader(PSRAMBuffer &&buffer);
+    WAVFileReader(std::shared_ptr<PSRAMBuffer> buffer);
     ~WAVFileReader();
     int sampleRate() { return m_sample_rate; }
-    void getFrames(Frame_t *frames, int number_frames);
+    int getFrames(Frame_t *frames, int number_frames);
+    int numChannels() { return m_num_channels; }
+    int getSamples(int16_t *samples, int number_samples);
+    int remainingFrames();
     bool isComplete() { return m_is_complete; }
+
+    /**
+     * @brief Checks whether the file could be played after converting it
+     * with `convertClipToNative`. Such a reader produces nothing itself.
+     */
+    bool needsConversion() { return m_needs_conversion; }
 };
 
+/**
+ * @brief Converts a 24/32-bit or float WAV clip in PSRAM to 16-bit PCM, in
+ * place, so playback is a plain copy.
+ *
+ * Call it before the buffer is shared. Other formats are left untouched.
+ *
+ * @return `true` if the clip was converted.
+ */
+bool convertClipToNative(PSRAMBuffer &clip);
+
+/**
+ * @brief Picks the reader for a WAV file held in PSRAM: PCM is read
+ * directly, IMA-ADPCM and G.711 go through `CompressedWAVReader`.
+ *
+ * The buffer may be shared with other readers (e.g. by the clip cache), it
+ * is only ever read.
+ */
+AudioFile *createPSRAMReader(std::shared_ptr<PSRAMBuffer> buffer);
+
+/**
+ * @brief Opens a clip by path: from the flash clip partition when it is
+ * packed there, otherwise from SPIFFS through the PSRAM clip cache. Clips
+ * read from SPIFFS during playback go through `decodeAhead`.
+ */
+AudioFile *openAudioFile(const char *filename);
+
 void playAudioFile(const char *filename, const bool announcePlayback = true);
-void playAudioFromPSRAM(uint8_t *buffer, size_t size);
+void playAudioFromPSRAM(std::shared_ptr<PSRAMBuffer> buffer,
+                        float gain = 1.0f);
+bool enqueueAudioFromPSRAM(std::shared_ptr<PSRAMBuffer> buffer,
+                           int crossfadeMs = 0, float gain = 1.0f);
+bool overlayAudioFromPSRAM(std::shared_ptr<PSRAMBuffer> buffer,
+                           float gain = 1.0f);
+void playAudioStream(StreamingWAVReader *stream, float gain = 1.0f);
+bool enqueueAudioStream(StreamingWAVReader *stream, int crossfadeMs = 0,
+                        float gain = 1.0f);
+bool overlayAudioStream(StreamingWAVReader *stream, float gain = 1.0f);
 void stopPlayback(void);
 
 #endif
@@ -0,0 +1,184 @@
+#include "WAVFormat.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief Longest `fmt ` body that is looked at, WAVEFORMATEXTENSIBLE.
+ */
+#define WAV_FORMAT_BODY_MAX 40
+
+static uint16_t readLE16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t readLE32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) |
+           ((uint32_t)data[3] << 24);
+}
+
+static void writeLE16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static void writeLE32(uint8_t *data, uint32_t value) {
+    writeLE16(data, value);
+    writeLE16(data + 2, value >> 16);
+}
+
+bool walkWAVChunks(wav_read_t read, void *context, size_t size,
+                   wav_format_t &format) {
+    uint8_t header[12];
+    if (size < 12 || read(context, 0, header, 12) != 12 ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool haveFormat = false;
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        uint8_t chunk[8];
+        if (read(context, offset, chunk, 8) != 8) {
+            return false;
+        }
+        uint32_t chunkSize = readLE32(chunk + 4);
+        size_t bodyAvailable = size - offset - 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t body[WAV_FORMAT_BODY_MAX];
+            size_t bodySize = chunkSize < bodyAvailable ? chunkSize
+                                                        : bodyAvailable;
+            if (bodySize > WAV_FORMAT_BODY_MAX) {
+                bodySize = WAV_FORMAT_BODY_MAX;
+            }
+            if (bodySize < 16 ||
+                read(context, offset + 8, body, bodySize) != bodySize) {
+                return false;
+            }
+            format.audio_format = readLE16(body);
+            format.num_channels = readLE16(body + 2);
+            format.sample_rate = readLE32(body + 4);
+            format.block_align = readLE16(body + 12);
+            format.bit_depth = readLE16(body + 14);
+            format.samples_per_block = 0;
+            // WAVEFORMATEX extension: cbSize, then samples per block
+            if (bodySize >= 20) {
+                format.samples_per_block = readLE16(body + 18);
+            }
+            // The sub-format GUID starts with the plain format code
+            if (format.audio_format == WAV_FORMAT_EXTENSIBLE) {
+                if (bodySize < 26) {
+                    return false;
+                }
+                format.audio_format = readLE16(body + 24);
+            }
+            haveFormat = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) {
+                return false;
+            }
+            format.data_offset = offset + 8;
+            // Streams written on the fly may leave the size at 0 or -1
+            format.data_length =
+                chunkSize == 0 || chunkSize > bodyAvailable ? bodyAvailable
+                                                            : chunkSize;
+            return format.num_channels >= 1 && format.num_channels <= 2 &&
+                   format.sample_rate > 0 && format.block_align > 0;
+        }
+
+        if (chunkSize > bodyAvailable) {
+            break;
+        }
+        // Chunks are padded to an even length
+        offset += 8 + (size_t)chunkSize + (chunkSize & 1);
+    }
+    return false;
+}
+
+static size_t readMemory(void *context, size_t offset, uint8_t *destination,
+                         size_t bytes) {
+    memcpy(destination, (const uint8_t *)context + offset, bytes);
+    return bytes;
+}
+
+bool parseWAVFormat(const uint8_t *data, size_t size, wav_format_t &format) {
+    // The walker never reads past `size`
+    return walkWAVChunks(readMemory, (void *)data, size, format);
+}
+
+bool isNativeWAVFormat(const wav_format_t &format) {
+    return format.audio_format == WAV_FORMAT_PCM && format.bit_depth == 16 &&
+           format.block_align == 2 * format.num_channels;
+}
+
+bool canConvertToNativeWAV(const wav_format_t &format) {
+    if (format.audio_format == WAV_FORMAT_IEEE_FLOAT) {
+        return format.bit_depth == 32 &&
+               format.block_align == 4 * format.num_channels;
+    }
+    if (format.audio_format != WAV_FORMAT_PCM) {
+        return false;
+    }
+    return (format.bit_depth == 24 || format.bit_depth == 32) &&
+           format.block_align == format.bit_depth / 8 * format.num_channels;
+}
+
+static int16_t saturate16(int32_t value) {
+    return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+static int16_t convertSample(const uint8_t *sample,
+                             const wav_format_t &format) {
+    if (format.audio_format == WAV_FORMAT_IEEE_FLOAT) {
+        float value;
+        memcpy(&value, sample, sizeof(value));
+        // NaN fails both comparisons and ends up as silence
+        if (!(value > -1.0f)) {
+            return value <= -1.0f ? -32768 : 0;
+        }
+        return value >= 1.0f ? 32767 : (int16_t)lrintf(value * 32767.0f);
+    }
+    if (format.bit_depth == 24) {
+        int32_t value = (int32_t)((uint32_t)sample[0] << 8 |
+                                  (uint32_t)sample[1] << 16 |
+                                  (uint32_t)sample[2] << 24) >>
+                        8;
+        return saturate16((value + 128) >> 8);
+    }
+    int32_t value = (int32_t)readLE32(sample);
+    return saturate16(((int64_t)value + 32768) >> 16);
+}
+
+size_t convertToNativeWAV(uint8_t *data, const wav_format_t &format) {
+    if (!canConvertToNativeWAV(format) ||
+        format.data_offset < WAV_CANONICAL_HEADER_SIZE) {
+        return 0;
+    }
+
+    // Every source sample is wider than its result and starts after it, so
+    // a forward pass never overwrites input that has not been read yet
+    size_t sampleBytes = format.bit_depth / 8;
+    size_t samples = format.data_length / format.block_align *
+                     format.num_channels;
+    const uint8_t *input = data + format.data_offset;
+    uint8_t *output = data + WAV_CANONICAL_HEADER_SIZE;
+    for (size_t i = 0; i < samples; i++) {
+        int16_t value = convertSample(input + i * sampleBytes, format);
+        memcpy(output + 2 * i, &value, sizeof(value));
+    }
+
+    uint32_t dataBytes = samples * 2;
+    memcpy(data, "RIFF", 4);
+    writeLE32(data + 4, WAV_CANONICAL_HEADER_SIZE - 8 + dataBytes);
+    memcpy(data + 8, "WAVEfmt ", 8);
+    writeLE32(data + 16, 16);
+    writeLE16(data + 20, WAV_FORMAT_PCM);
+    writeLE16(data + 22, format.num_channels);
+    writeLE32(data + 24, format.sample_rate);
+    writeLE32(data + 28, format.sample_rate * 2 * format.num_channels);
+    writeLE16(data + 32, 2 * format.num_channels);
+    writeLE16(data + 34, 16);
+    memcpy(data + 36, "data", 4);
+    writeLE32(data + 40, dataBytes);
+    return WAV_CANONICAL_HEADER_SIZE + dataBytes;
+}
@@ -0,0 +1,100 @@
+#ifndef __wav_format_h__
+#define __wav_format_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief `audio_format` codes from the WAV `fmt ` chunk.
+ */
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_IEEE_FLOAT 0x0003
+#define WAV_FORMAT_ALAW 0x0006
+#define WAV_FORMAT_MULAW 0x0007
+#define WAV_FORMAT_IMA_ADPCM 0x0011
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+/**
+ * @brief Size of the canonical header written by `convertToNativeWAV`: RIFF,
+ * a 16-byte `fmt ` chunk and the `data` chunk header.
+ */
+#define WAV_CANONICAL_HEADER_SIZE 44
+
+/**
+ * @struct wav_format_t
+ * @brief Stream parameters and data location found in a RIFF/WAVE file.
+ */
+typedef struct {
+    uint16_t audio_format;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint16_t block_align;     /**< Bytes per frame, or per ADPCM block */
+    uint16_t bit_depth;
+    uint16_t samples_per_block; /**< IMA-ADPCM only */
+    size_t data_offset;       /**< Offset of the first byte of `data` */
+    size_t data_length;       /**< Clamped to the bytes actually present */
+} wav_format_t;
+
+/**
+ * @brief Reads `bytes` at `offset` of a WAV file into `destination`.
+ *
+ * @return Bytes actually read.
+ */
+typedef size_t (*wav_read_t)(void *context, size_t offset,
+                             uint8_t *destination, size_t bytes);
+
+/**
+ * @brief Walks the chunks of a WAV file of `size` bytes to find `fmt ` and
+ * `data` at any offset, skipping any other chunk (`fact`, `LIST`, ...).
+ *
+ * Only the chunk headers and the format are read, so this works the same on
+ * files and on memory. `WAVE_FORMAT_EXTENSIBLE` is resolved to the format
+ * code of its sub-format.
+ *
+ * @param read Reads from the file.
+ * @param context Passed to `read`.
+ * @param size Bytes in the file.
+ * @param format Filled in on success.
+ * @return `true` if both chunks were found and the format is sane.
+ */
+bool walkWAVChunks(wav_read_t read, void *context, size_t size,
+                   wav_format_t &format);
+
+/**
+ * @brief Walks the chunks of an in-memory WAV file to find `fmt ` and
+ * `data`, skipping any other chunk (`fact`, `LIST`, ...) in between.
+ *
+ * @param data Start of the file.
+ * @param size Bytes available.
+ * @param format Filled in on success.
+ * @return `true` if both chunks were found and the format is sane.
+ */
+bool parseWAVFormat(const uint8_t *data, size_t size, wav_format_t &format);
+
+/**
+ * @brief Checks whether `format` is the 16-bit PCM the readers copy as-is.
+ */
+bool isNativeWAVFormat(const wav_format_t &format);
+
+/**
+ * @brief Checks whether `convertToNativeWAV` can handle `format`: 24 or 32-bit
+ * integer PCM and 32-bit float. Each of these shrinks when converted, which
+ * is what allows converting in place.
+ */
+bool canConvertToNativeWAV(const wav_format_t &format);
+
+/**
+ * @brief Rewrites an in-memory WAV file as 16-bit PCM with a canonical
+ * header, in place.
+ *
+ * Meant to run once when a clip is loaded or uploaded, so playback only
+ * ever copies samples. Samples are rounded and saturated, float samples are
+ * clipped to [-1, 1].
+ *
+ * @param data Whole file, as parsed into `format`.
+ * @param format Format of `data`, from `parseWAVFormat`.
+ * @return New size of the file, or 0 if the format cannot be converted.
+ */
+size_t convertToNativeWAV(uint8_t *data, const wav_format_t &format);
+
+#endif
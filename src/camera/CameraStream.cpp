@@ -0,0 +1,276 @@
+#include "CameraStream.h"
+#include "FrameCache.h"
+#include "Globals.h"
+#include <memory>
+
+#define CAMERA_STREAM_BOUNDARY "bobframe"
+
+#define CAMERA_STREAM_TASK_STACK 3072
+#define CAMERA_STREAM_TASK_PRIORITY 1
+// The audio engine owns core 1
+#define CAMERA_STREAM_TASK_CORE 0
+
+// Every driver buffer is held and the latest frame was already sent, look
+// again after this long
+#define CAMERA_STREAM_RETRY_MS 5
+// The send buffer of a connection is full, look again after this long
+#define CAMERA_STREAM_SEND_RETRY_MS 2
+
+/**
+ * @brief State of one stream, shared by the response, the disconnect handler
+ * of the request and the pacing task. The frame is released however the
+ * stream ends.
+ */
+struct StreamState {
+    uint32_t period_ms; /**< Minimum time between two frames */
+
+    // Pacing task only
+    uint32_t last_seq;   /**< Of the last frame sent */
+    uint32_t next_frame; /**< `millis()` at which the next frame is due */
+    std::shared_ptr<CameraFrame> frame; /**< Being sent, null in between */
+    String header; /**< Chunk and part header of `frame` */
+    size_t sent;   /**< Bytes of the current chunk already sent */
+    bool ended;    /**< A capture failed, the response was ended */
+
+    // Guarded by `streamMutex`
+    AsyncClient *client; /**< Null until the head is out, and once closed */
+
+    StreamState(uint32_t period)
+        : period_ms(period), last_seq(0), next_frame(millis()), sent(0),
+          ended(false), client(nullptr) {}
+
+    void startPart(std::shared_ptr<CameraFrame> next) {
+        frame = next;
+        String part = "--" CAMERA_STREAM_BOUNDARY "\r\n"
+                      "Content-Type: image/jpeg\r\n"
+                      "Content-Length: " +
+                      String(frame->length()) + "\r\n"
+                      "X-Frame-Seq: " + String(frame->seq()) + "\r\n\r\n";
+        // One chunk of the chunked response per part, which ends with the
+        // CRLF after the JPEG
+        header = String(part.length() + frame->length() + 2, HEX) + "\r\n" +
+                 part;
+        sent = 0;
+    }
+
+    /**
+     * @brief Length of the chunk: header, JPEG, the CRLF ending the part and
+     * the one ending the chunk.
+     */
+    size_t chunkSize() { return header.length() + frame->length() + 4; }
+};
+
+static TaskHandle_t streamTask = nullptr;
+static SemaphoreHandle_t streamMutex = nullptr;
+static std::weak_ptr<StreamState> streams[CAMERA_STREAM_MAX_CLIENTS];
+
+/**
+ * @brief Hands as much of the current chunk to the connection as its send
+ * buffer takes, and releases the frame once all of it is out.
+ *
+ * Writing from this task rather than the web server task is what the
+ * library's own event sources do, AsyncTCP runs the writes on the lwIP
+ * thread. The mutex keeps the disconnect handler from letting the client be
+ * freed meanwhile.
+ *
+ * @return `false` if the connection is closed.
+ */
+static bool sendPart(StreamState &state) {
+    size_t headerLen = state.header.length();
+    size_t chunkSize = state.chunkSize();
+
+    xSemaphoreTake(streamMutex, portMAX_DELAY);
+    AsyncClient *client = state.client;
+    while (client != nullptr && state.sent < chunkSize) {
+        const char *source;
+        size_t available;
+        if (state.sent < headerLen) {
+            source = state.header.c_str() + state.sent;
+            available = headerLen - state.sent;
+        } else if (state.sent < headerLen + state.frame->length()) {
+            source = (const char *)state.frame->data() +
+                     (state.sent - headerLen);
+            available = headerLen + state.frame->length() - state.sent;
+        } else {
+            source = "\r\n\r\n" +
+                     (state.sent - headerLen - state.frame->length());
+            available = chunkSize - state.sent;
+        }
+        size_t length = min(available, client->space());
+        if (length == 0) {
+            break;
+        }
+        // Copied, the frame can be released as soon as the chunk is added
+        length = client->add(source, length);
+        if (length == 0) {
+            break;
+        }
+        state.sent += length;
+    }
+    if (client != nullptr) {
+        client->send();
+    }
+    xSemaphoreGive(streamMutex);
+
+    if (state.sent == chunkSize) {
+        state.frame.reset();
+    }
+    return client != nullptr;
+}
+
+/**
+ * @brief Takes a frame for every stream due one and sends what the
+ * connections have room for.
+ *
+ * @return Ticks until a stream needs this task again.
+ */
+static TickType_t paceStreams() {
+    std::shared_ptr<StreamState> live[CAMERA_STREAM_MAX_CLIENTS];
+    xSemaphoreTake(streamMutex, portMAX_DELAY);
+    for (int i = 0; i < CAMERA_STREAM_MAX_CLIENTS; i++) {
+        live[i] = streams[i].lock();
+    }
+    xSemaphoreGive(streamMutex);
+
+    TickType_t sleep = portMAX_DELAY;
+    for (std::shared_ptr<StreamState> &state : live) {
+        if (!state) {
+            continue;
+        }
+        xSemaphoreTake(streamMutex, portMAX_DELAY);
+        bool open = state->client != nullptr;
+        xSemaphoreGive(streamMutex);
+        if (!open || state->ended) {
+            // The head is not out yet, the response wakes this task then
+            continue;
+        }
+
+        int32_t wait = 0;
+        if (!state->frame) {
+            wait = (int32_t)(state->next_frame - millis());
+            if (wait <= 0) {
+                std::shared_ptr<CameraFrame> next = frameCache.get(0);
+                if (!next) {
+                    // Ends the response with the last chunk, the client can
+                    // reconnect
+                    xSemaphoreTake(streamMutex, portMAX_DELAY);
+                    if (state->client != nullptr) {
+                        state->client->add("0\r\n\r\n", 5);
+                        state->client->send();
+                    }
+                    xSemaphoreGive(streamMutex);
+                    state->ended = true;
+                    continue;
+                }
+                if (next->seq() == state->last_seq) {
+                    wait = CAMERA_STREAM_RETRY_MS;
+                } else {
+                    state->last_seq = next->seq();
+                    state->next_frame = millis() + state->period_ms;
+                    state->startPart(next);
+                }
+            }
+        }
+        if (state->frame && sendPart(*state)) {
+            wait = state->frame ? CAMERA_STREAM_SEND_RETRY_MS
+                                : (int32_t)(state->next_frame - millis());
+        }
+        sleep = min(sleep, pdMS_TO_TICKS((uint32_t)max(wait, (int32_t)1)));
+    }
+    return sleep;
+}
+
+static void streamTaskEntry(void *param) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, paceStreams());
+    }
+}
+
+/**
+ * @brief Starts the pacing task on the first stream.
+ */
+static bool beginStreams() {
+    if (streamTask != nullptr) {
+        return true;
+    }
+    if (streamMutex == nullptr) {
+        streamMutex = xSemaphoreCreateMutex();
+    }
+    if (streamMutex == nullptr ||
+        xTaskCreatePinnedToCore(streamTaskEntry, "Camera Stream Task",
+                                CAMERA_STREAM_TASK_STACK, nullptr,
+                                CAMERA_STREAM_TASK_PRIORITY, &streamTask,
+                                CAMERA_STREAM_TASK_CORE) != pdPASS) {
+        Serial.println("Camera stream task creation FAILURE.");
+        streamTask = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void processStreamRequest(AsyncWebServerRequest *request,
+                          const JsonDocument &doc) {
+    if (!beginStreams()) {
+        request->send(500, "text/plain", "Camera stream task failed.");
+        return;
+    }
+
+    int fps = CAMERA_STREAM_DEFAULT_FPS;
+    if (request->hasParam("fps")) {
+        fps = request->getParam("fps")->value().toInt();
+        fps = constrain(fps, 1, CAMERA_STREAM_MAX_FPS);
+    }
+
+    std::shared_ptr<StreamState> state =
+        std::make_shared<StreamState>(1000 / fps);
+    bool added = false;
+    xSemaphoreTake(streamMutex, portMAX_DELAY);
+    for (std::weak_ptr<StreamState> &slot : streams) {
+        if (slot.expired()) {
+            slot = state;
+            added = true;
+            break;
+        }
+    }
+    xSemaphoreGive(streamMutex);
+    if (!added) {
+        request->send(503, "text/plain", "Too many streams.");
+        return;
+    }
+
+    // Runs before the client is freed
+    request->onDisconnect([state]() {
+        xSemaphoreTake(streamMutex, portMAX_DELAY);
+        state->client = nullptr;
+        xSemaphoreGive(streamMutex);
+    });
+
+    // The web server only sends the head, with the CRLF that may precede
+    // the first boundary. The parts are written to the client by the pacing
+    // task, as chunks of this response, once a frame is due and the
+    // connection has room, so the frame rate does not depend on when the
+    // web server polls the response.
+    bool started = false;
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+        "multipart/x-mixed-replace;boundary=" CAMERA_STREAM_BOUNDARY,
+        [state, request, started](uint8_t *buffer, size_t maxLen,
+                                  size_t index) mutable -> size_t {
+            if (!started) {
+                started = true;
+                buffer[0] = '\r';
+                buffer[1] = '\n';
+                return 2;
+            }
+            // Called again once the head was written
+            xSemaphoreTake(streamMutex, portMAX_DELAY);
+            bool handOver = state->client == nullptr;
+            state->client = request->client();
+            xSemaphoreGive(streamMutex);
+            if (handOver) {
+                xTaskNotifyGive(streamTask);
+            }
+            return RESPONSE_TRY_AGAIN;
+        });
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
@@ -0,0 +1,48 @@
+#ifndef __camera_stream_h__
+#define __camera_stream_h__
+
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+/**
+ * @brief Frame rate used when the client does not ask for one.
+ */
+#define CAMERA_STREAM_DEFAULT_FPS 10
+
+/**
+ * @brief Highest frame rate a client can ask for.
+ */
+#define CAMERA_STREAM_MAX_FPS 30
+
+/**
+ * @brief Number of streams served at once. Frames come from `frameCache`, so
+ * streams share captures with each other and with `/capture`.
+ */
+#define CAMERA_STREAM_MAX_CLIENTS 2
+
+/**
+ * @brief Serves live video as `multipart/x-mixed-replace` JPEG parts.
+ *
+ * A low-priority task paces the streams: once a frame is due it takes it
+ * from `frameCache` and writes it to the connection as a chunk of the
+ * response, as fast as the connection takes it. The web server task only
+ * sends the head, so it never waits for the camera and the rate does not
+ * depend on when it polls the response.
+ *
+ * A new frame is only taken from the driver once the previous one has been
+ * sent, and the driver keeps just the latest one, so a slow client sees a
+ * lower frame rate instead of a growing delay. The frame is released as soon
+ * as a part is sent or the client disconnects. A failed capture ends the
+ * stream.
+ *
+ * The `fps` query parameter caps the frame rate, between 1 and
+ * `CAMERA_STREAM_MAX_FPS`. Responds with 503 when
+ * `CAMERA_STREAM_MAX_CLIENTS` streams are already running.
+ *
+ * @param request Pointer to the AsyncWebServerRequest object.
+ * @param doc Reference to the JsonDocument containing request data (unused).
+ */
+void processStreamRequest(AsyncWebServerRequest *request,
+                          const JsonDocument &doc);
+
+#endif
@@ -0,0 +1,53 @@
+#include "CaptureProfile.h"
+#include "Globals.h"
+
+// OV2640 special effect that turns the image gray
+#define SENSOR_EFFECT_NONE 0
+#define SENSOR_EFFECT_GRAYSCALE 2
+
+static const CaptureProfile profiles[] = {
+    // 1600x1200, a few hundred KB
+    {"full", {FRAMESIZE_UXGA, 12, false}},
+    // 640x480, about what the vision model looks at anyway
+    {"vision", {FRAMESIZE_VGA, 12, false}},
+    {"gray", {FRAMESIZE_VGA, 12, true}},
+    // 320x240, for previews
+    {"preview", {FRAMESIZE_QVGA, 15, false}},
+};
+
+const CaptureProfile &defaultCaptureProfile = profiles[0];
+
+const CaptureProfile *findCaptureProfile(const String &name) {
+    for (const CaptureProfile &profile : profiles) {
+        if (name == profile.name) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+bool applySensorSettings(const SensorSettings &from,
+                         const SensorSettings &to) {
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (!sensor) {
+        logger.println("Camera sensor FAILURE, settings not applied.");
+        return false;
+    }
+    bool ok = true;
+    if (from.frameSize != to.frameSize) {
+        ok &= sensor->set_framesize(sensor, to.frameSize) == 0;
+    }
+    if (from.quality != to.quality) {
+        ok &= sensor->set_quality(sensor, to.quality) == 0;
+    }
+    if (from.grayscale != to.grayscale) {
+        ok &= sensor->set_special_effect(sensor,
+                                         to.grayscale
+                                             ? SENSOR_EFFECT_GRAYSCALE
+                                             : SENSOR_EFFECT_NONE) == 0;
+    }
+    if (!ok) {
+        logger.println("Camera sensor settings FAILURE.");
+    }
+    return ok;
+}
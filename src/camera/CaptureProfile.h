@@ -0,0 +1,39 @@
+#ifndef __capture_profile_h__
+#define __capture_profile_h__
+
+#include "SensorSettings.h"
+#include <Arduino.h>
+
+/**
+ * @brief Named sensor settings a capture can ask for.
+ */
+struct CaptureProfile {
+    const char *name;
+    SensorSettings settings;
+};
+
+/**
+ * @brief Profile used when a request does not name one, and the one the
+ * camera is initialized with. Full resolution, as before profiles existed.
+ */
+extern const CaptureProfile &defaultCaptureProfile;
+
+/**
+ * @brief Looks up a profile by name.
+ *
+ * `full` is 1600x1200, `vision` 640x480, `gray` the same in grayscale and
+ * `preview` 320x240 at a lower quality.
+ *
+ * @return The profile, or null if there is none with that name.
+ */
+const CaptureProfile *findCaptureProfile(const String &name);
+
+/**
+ * @brief Programs the registers that differ between `from`, what the sensor
+ * currently runs with, and `to`.
+ *
+ * @return `true` if every register was written.
+ */
+bool applySensorSettings(const SensorSettings &from, const SensorSettings &to);
+
+#endif
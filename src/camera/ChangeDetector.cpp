@@ -0,0 +1,154 @@
+#include "ChangeDetector.h"
+#include "Globals.h"
+#include <esp_timer.h>
+
+#define CHANGE_DETECTOR_TASK_STACK 4096
+#define CHANGE_DETECTOR_TASK_PRIORITY 1
+// The audio engine owns core 1
+#define CHANGE_DETECTOR_TASK_CORE 0
+
+ChangeDetector changeDetector;
+
+ChangeDetector::ChangeDetector()
+    : m_taskHandle(nullptr), m_has_background(false), m_background_size(-1),
+      m_baseline_seq(0), m_score(0), m_seq(0), m_last_change_seq(0),
+      m_last_change_ms(0), m_frames(0), m_decode_us(0), m_analysis_us(0),
+      m_share_task(nullptr), m_share_mutex(nullptr) {}
+
+bool ChangeDetector::begin() {
+    if (m_taskHandle != nullptr) {
+        return true;
+    }
+    // Sized for the largest profile, the one the camera starts with
+    framesize_t largest = defaultCaptureProfile.settings.frameSize;
+    m_gray = PSRAMBuffer((size_t)((resolution[largest].width + 7) / 8) *
+                         ((resolution[largest].height + 7) / 8));
+    m_share_mutex = xSemaphoreCreateMutex();
+    if (!m_gray || m_share_mutex == nullptr ||
+        xTaskCreatePinnedToCore(taskEntry, "Change Detector Task",
+                                CHANGE_DETECTOR_TASK_STACK, this,
+                                CHANGE_DETECTOR_TASK_PRIORITY, &m_taskHandle,
+                                CHANGE_DETECTOR_TASK_CORE) != pdPASS) {
+        Serial.println("Change detector task creation FAILURE.");
+        m_taskHandle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void ChangeDetector::taskEntry(void *param) {
+    static_cast<ChangeDetector *>(param)->run();
+}
+
+void ChangeDetector::run() {
+    const TickType_t period = pdMS_TO_TICKS(1000 / CHANGE_DETECTOR_FPS);
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&wake, period);
+        analyze();
+        if (m_share_task != nullptr) {
+            xTaskNotifyGive(m_share_task);
+        }
+    }
+}
+
+bool ChangeDetector::analyze() {
+    // Any frame taken since the last tick will do, including one a request
+    // is sending
+    std::shared_ptr<CameraFrame> frame =
+        frameCache.get(1000 / CHANGE_DETECTOR_FPS);
+    if (!frame || frame->seq() == m_seq) {
+        return false;
+    }
+
+    // Timed from here, waiting for a capture is not part of the cost
+    int64_t start = esp_timer_get_time();
+    int width = 0;
+    int height = 0;
+    bool decoded = frame->decodeGray(JPG_SCALE_8X, m_gray.data(),
+                                     m_gray.size(), width, height);
+    int64_t decodedAt = esp_timer_get_time();
+    uint32_t seq = frame->seq();
+    int frameSize = frame->settings().frameSize;
+    // Give the buffer back before the arithmetic, or on to the task checking
+    // the same frame next
+    if (m_share_task != nullptr) {
+        xSemaphoreTake(m_share_mutex, portMAX_DELAY);
+        m_shared = frame;
+        xSemaphoreGive(m_share_mutex);
+    }
+    frame.reset();
+    if (!decoded || width < CHANGE_DETECTOR_GRID_WIDTH ||
+        height < CHANGE_DETECTOR_GRID_HEIGHT) {
+        // Undecodable, or a profile too small for the grid
+        return false;
+    }
+
+    if (frameSize != m_background_size) {
+        // A new framing shifts every cell a little, start over from it
+        m_model.reset();
+    }
+    bool rebuilt = !m_model.hasBackground();
+    int score = m_model.update(m_gray.data(), width, height);
+    m_decode_us = decodedAt - start;
+    m_analysis_us = esp_timer_get_time() - start;
+    m_frames++;
+
+    if (rebuilt) {
+        m_has_background = true;
+        m_background_size = frameSize;
+        m_baseline_seq = seq;
+        m_score = 0;
+        // Last, so `changedSince` never sees the frame before its verdict
+        m_seq = seq;
+        return true;
+    }
+
+    m_score = score;
+    if (score >= CHANGE_DETECTOR_MIN_SCORE) {
+        m_last_change_seq = seq;
+        m_last_change_ms = millis();
+    }
+    m_seq = seq;
+    return true;
+}
+
+void ChangeDetector::shareFrames(TaskHandle_t task) { m_share_task = task; }
+
+std::shared_ptr<CameraFrame> ChangeDetector::takeFrame() {
+    xSemaphoreTake(m_share_mutex, portMAX_DELAY);
+    std::shared_ptr<CameraFrame> frame = m_shared;
+    m_shared.reset();
+    xSemaphoreGive(m_share_mutex);
+    return frame;
+}
+
+String ChangeDetector::toJson(uint32_t since) {
+    JsonDocument doc;
+    doc["seq"] = (uint32_t)m_seq;
+    doc["score"] = (int)m_score;
+    doc["lastChangeSeq"] = (uint32_t)m_last_change_seq;
+    doc["msSinceChange"] =
+        m_last_change_seq ? millis() - m_last_change_ms : (uint32_t)0;
+    doc["changed"] = changedSince(since);
+    doc["frames"] = (uint32_t)m_frames;
+    doc["decodeUs"] = (uint32_t)m_decode_us;
+    doc["analysisUs"] = (uint32_t)m_analysis_us;
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+void processChangeRequest(AsyncWebServerRequest *request,
+                          const JsonDocument &doc) {
+    if (!changeDetector.isRunning()) {
+        request->send(503, "application/json",
+                      "{\"error\":\"Change detector not running.\"}");
+        return;
+    }
+    uint32_t since = 0;
+    if (request->hasParam("since")) {
+        since = request->getParam("since")->value().toInt();
+    }
+    request->send(200, "application/json", changeDetector.toJson(since));
+}
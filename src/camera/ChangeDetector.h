@@ -0,0 +1,142 @@
+#ifndef __change_detector_h__
+#define __change_detector_h__
+
+#include "ChangeModel.h"
+#include "FrameCache.h"
+#include "audio/PSRAMBuffer.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+
+/**
+ * @brief Frames analyzed per second.
+ */
+#define CHANGE_DETECTOR_FPS 4
+
+/**
+ * @class ChangeDetector
+ * @brief Watches the camera for changes, so callers can skip sending a
+ * frame to the vision model when nothing moved since the last one.
+ *
+ * A low-priority task takes frames from `frameCache`, sharing them with any
+ * request in flight, decodes them at 1/8 scale to grayscale and averages
+ * them down to a `CHANGE_DETECTOR_GRID_WIDTH` by
+ * `CHANGE_DETECTOR_GRID_HEIGHT` grid. At 1/8 scale the decoder only uses the
+ * DC coefficient of each 8x8 block, skipping the inverse transform.
+ *
+ * Each grid is compared against a slowly adapting background by
+ * `ChangeModel`. The score is the share of cells that differ from it by more
+ * than a threshold after taking out global brightness changes. Frames
+ * scoring at least `CHANGE_DETECTOR_MIN_SCORE` are recorded as changes, by
+ * sequence number.
+ */
+class ChangeDetector {
+  private:
+    TaskHandle_t m_taskHandle;
+    PSRAMBuffer m_gray; /**< Decoded frame at 1/8 scale */
+    ChangeModel m_model;
+    std::atomic<bool> m_has_background;
+    int m_background_size; /**< Frame size the background was built from */
+    std::atomic<uint32_t> m_baseline_seq; /**< Frame it was built from */
+
+    std::atomic<int> m_score;
+    std::atomic<uint32_t> m_seq;
+    std::atomic<uint32_t> m_last_change_seq;
+    std::atomic<uint32_t> m_last_change_ms;
+    std::atomic<uint32_t> m_frames;
+    std::atomic<uint32_t> m_decode_us;   /**< Of the last frame */
+    std::atomic<uint32_t> m_analysis_us; /**< Decode and model */
+
+    TaskHandle_t m_share_task; /**< Notified after each frame, or null */
+    SemaphoreHandle_t m_share_mutex;
+    std::shared_ptr<CameraFrame> m_shared; /**< Not taken yet */
+
+    static void taskEntry(void *param);
+    void run();
+    bool analyze();
+
+  public:
+    ChangeDetector();
+
+    /**
+     * @brief Starts the detector task, call once the camera is initialized.
+     */
+    bool begin();
+
+    bool isRunning() { return m_taskHandle != nullptr; }
+
+    /**
+     * @brief Hands every frame this detector analyzed on to another task,
+     * which is notified once the verdict on the frame is in, so both
+     * detectors look at one capture.
+     *
+     * @param task Task to notify, it has to `takeFrame` after each
+     * notification so the driver buffer is given back.
+     */
+    void shareFrames(TaskHandle_t task);
+
+    /**
+     * @brief Takes the frame handed on by the last analysis, null if it did
+     * not get a new one.
+     */
+    std::shared_ptr<CameraFrame> takeFrame();
+
+    /**
+     * @brief Score of the last frame analyzed, 0-100.
+     */
+    int score() { return m_score; }
+
+    /**
+     * @brief Sequence number of the last frame analyzed.
+     */
+    uint32_t seq() { return m_seq; }
+
+    /**
+     * @brief Sequence number of the last frame that counted as a change, 0
+     * if none has yet.
+     */
+    uint32_t lastChangeSeq() { return m_last_change_seq; }
+
+    /**
+     * @brief Checks whether the scene may have changed after frame `seq`.
+     *
+     * Only reports no change when a later frame was analyzed against the
+     * same background and nothing moved. Until then, e.g. before the first
+     * background or while the profile is too small for the grid, every
+     * frame counts as changed, as do frames from before the background was
+     * built.
+     */
+    bool changedSince(uint32_t seq) {
+        return !m_has_background || m_seq <= seq || seq < m_baseline_seq ||
+               m_last_change_seq > seq;
+    }
+
+    /**
+     * @brief Formats the state as a JSON object, with `changed` relative to
+     * frame `since`.
+     */
+    String toJson(uint32_t since);
+};
+
+/**
+ * @brief Global change detector.
+ */
+extern ChangeDetector changeDetector;
+
+/**
+ * @brief Reports whether the scene changed, so a vision request can be
+ * skipped when it did not.
+ *
+ * With the `since` query parameter, the frame sequence number of the last
+ * image the client analyzed (`X-Frame-Seq` of `/capture`), `changed` tells
+ * whether anything moved after it. It stays `true` until the detector has
+ * analyzed a later frame. Responds with 503 if the detector is not running.
+ *
+ * @param request Pointer to the AsyncWebServerRequest object.
+ * @param doc Reference to the JsonDocument containing request data (unused).
+ */
+void processChangeRequest(AsyncWebServerRequest *request,
+                          const JsonDocument &doc);
+
+#endif
@@ -0,0 +1,19 @@
+#include "ChangeModel.h"
+#include "ImageDSP.h"
+
+int ChangeModel::update(const uint8_t *gray, int width, int height) {
+    downsampleGray(gray, width, height, m_grid, CHANGE_DETECTOR_GRID_WIDTH,
+                   CHANGE_DETECTOR_GRID_HEIGHT);
+    if (!m_has_background) {
+        for (int i = 0; i < CHANGE_DETECTOR_CELLS; i++) {
+            m_background[i] = m_grid[i] << 8;
+        }
+        m_has_background = true;
+        return 0;
+    }
+    size_t changed =
+        compareToBackground(m_grid, m_background, CHANGE_DETECTOR_CELLS,
+                            CHANGE_DETECTOR_THRESHOLD,
+                            CHANGE_DETECTOR_ADAPT_SHIFT);
+    return changed * 100 / CHANGE_DETECTOR_CELLS;
+}
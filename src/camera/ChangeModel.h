@@ -0,0 +1,77 @@
+#ifndef CHANGE_MODEL_H
+#define CHANGE_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file ChangeModel.h
+ * @brief Scene model of the change detector and its tuning.
+ *
+ * Like the image kernels it only depends on the C standard library, so the
+ * detector's decisions can be checked on a host machine against recorded
+ * frames with the same constants the robot uses.
+ */
+
+/**
+ * @brief Size of the grid frames are averaged down to before comparing, so
+ * the model does not depend on the capture profile.
+ */
+#define CHANGE_DETECTOR_GRID_WIDTH 40
+#define CHANGE_DETECTOR_GRID_HEIGHT 30
+
+#define CHANGE_DETECTOR_CELLS                                                  \
+    (CHANGE_DETECTOR_GRID_WIDTH * CHANGE_DETECTOR_GRID_HEIGHT)
+
+/**
+ * @brief Share of changed cells, in percent, from which a frame counts as a
+ * change of the scene.
+ */
+#define CHANGE_DETECTOR_MIN_SCORE 2
+
+/**
+ * @brief Gray levels a cell may drift from the background without counting.
+ */
+#define CHANGE_DETECTOR_THRESHOLD 12
+
+/**
+ * @brief The background follows the scene by 1/16 of the difference per
+ * frame, about four seconds at the default rate.
+ */
+#define CHANGE_DETECTOR_ADAPT_SHIFT 4
+
+/**
+ * @class ChangeModel
+ * @brief Slowly adapting background of grayscale frames and the score of
+ * each frame against it.
+ */
+class ChangeModel {
+  private:
+    uint8_t m_grid[CHANGE_DETECTOR_CELLS];
+    uint16_t m_background[CHANGE_DETECTOR_CELLS]; /**< Q8 */
+    bool m_has_background;
+
+  public:
+    ChangeModel() : m_has_background(false) {}
+
+    /**
+     * @brief Forgets the background, the next frame builds a new one.
+     */
+    void reset() { m_has_background = false; }
+
+    bool hasBackground() { return m_has_background; }
+
+    /**
+     * @brief Averages a frame down to the grid and scores it against the
+     * background, which then moves towards it.
+     *
+     * @param gray   Decoded frame, `width * height` pixels.
+     * @param width  At least `CHANGE_DETECTOR_GRID_WIDTH`.
+     * @param height At least `CHANGE_DETECTOR_GRID_HEIGHT`.
+     * @return Share of changed cells, 0-100, or 0 for the frame that built
+     * the background.
+     */
+    int update(const uint8_t *gray, int width, int height);
+};
+
+#endif // CHANGE_MODEL_H
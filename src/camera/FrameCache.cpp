@@ -0,0 +1,217 @@
+#include "FrameCache.h"
+#include "Camera.h"
+#include "Globals.h"
+#include "ImageDSP.h"
+
+FrameCache frameCache;
+
+CameraFrame::CameraFrame(camera_fb_t *fb, uint32_t seq,
+                         const SensorSettings &settings)
+    : m_fb(fb), m_seq(seq), m_taken_ms(millis()), m_settings(settings) {
+    frameCache.m_held++;
+}
+
+CameraFrame::~CameraFrame() {
+    esp_camera_fb_return(m_fb);
+    frameCache.m_held--;
+    if (frameCache.m_released != nullptr) {
+        xSemaphoreGive(frameCache.m_released);
+    }
+}
+
+size_t CameraFrame::read(size_t index, uint8_t *buf, size_t len) {
+    if (index >= m_fb->len) {
+        return 0;
+    }
+    len = min(len, m_fb->len - index);
+    if (buf) {
+        memcpy(buf, m_fb->buf + index, len);
+    }
+    return len;
+}
+
+struct GrayTarget {
+    CameraFrame *frame;
+    uint8_t *pixels;
+    size_t capacity; /**< In pixels */
+    int width;
+    int height;
+};
+
+static size_t readJpeg(void *arg, size_t index, uint8_t *buf, size_t len) {
+    return static_cast<GrayTarget *>(arg)->frame->read(index, buf, len);
+}
+
+static bool writeGray(void *arg, uint16_t x, uint16_t y, uint16_t w,
+                      uint16_t h, uint8_t *data) {
+    GrayTarget *target = static_cast<GrayTarget *>(arg);
+    if (!data) {
+        if (x == 0 && y == 0) {
+            target->width = w;
+            target->height = h;
+            return (size_t)w * h <= target->capacity;
+        }
+        return true;
+    }
+    if (x + w > target->width || y + h > target->height) {
+        return false;
+    }
+    for (uint16_t row = 0; row < h; row++) {
+        rgb888ToGray(data + (size_t)row * w * 3,
+                     target->pixels + (size_t)(y + row) * target->width + x,
+                     w);
+    }
+    return true;
+}
+
+bool CameraFrame::decodeGray(jpg_scale_t scale, uint8_t *pixels,
+                             size_t capacity, int &width, int &height) {
+    GrayTarget target = {this, pixels, capacity, 0, 0};
+    if (esp_jpg_decode(m_fb->len, scale, readJpeg, writeGray, &target) !=
+        ESP_OK) {
+        return false;
+    }
+    width = target.width;
+    height = target.height;
+    return true;
+}
+
+int64_t CameraFrame::timestampMs() {
+    return (int64_t)m_fb->timestamp.tv_sec * 1000 +
+           m_fb->timestamp.tv_usec / 1000;
+}
+
+FrameCache::FrameCache()
+    : m_mutex(nullptr), m_released(nullptr), m_seq(0), m_taken_ms(0),
+      m_invalidated(false), m_active(defaultCaptureProfile.settings),
+      m_switches(0), m_held(0), m_shared(0) {}
+
+bool FrameCache::begin(const SensorSettings &settings) {
+    if (m_mutex == nullptr) {
+        m_mutex = xSemaphoreCreateMutex();
+    }
+    if (m_released == nullptr) {
+        m_released = xSemaphoreCreateBinary();
+    }
+    if (m_mutex == nullptr || m_released == nullptr) {
+        Serial.println("Frame cache lock creation FAILURE.");
+        return false;
+    }
+    m_active = settings;
+    return true;
+}
+
+bool FrameCache::switchTo(const SensorSettings &settings) {
+    m_latest.reset();
+    m_invalidated = true;
+    if (!applySensorSettings(m_active, settings)) {
+        // Some registers may have been written, make sure they are all
+        // written again next time
+        m_active.quality = -1;
+        m_active.frameSize = FRAMESIZE_INVALID;
+        return false;
+    }
+    m_active = settings;
+    m_switches++;
+
+    // Every buffer the driver owns is either queued or being filled, and may
+    // hold a frame exposed with the old settings
+    int stale = CAMERA_FB_COUNT - m_held;
+    for (int i = 0; i < stale; i++) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb) {
+            break;
+        }
+        esp_camera_fb_return(fb);
+    }
+    return true;
+}
+
+void FrameCache::waitForRelease() {
+    const TickType_t limit = pdMS_TO_TICKS(FRAME_CACHE_SWITCH_WAIT_MS);
+    TickType_t start = xTaskGetTickCount();
+    // A release from before the wait leaves the semaphore given, hence the
+    // loop
+    while (m_held >= CAMERA_FB_COUNT) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= limit) {
+            break;
+        }
+        // Unlocked, a holder may need the cache to finish with its frame
+        xSemaphoreGive(m_mutex);
+        xSemaphoreTake(m_released, limit - waited);
+        xSemaphoreTake(m_mutex, portMAX_DELAY);
+    }
+}
+
+std::shared_ptr<CameraFrame> FrameCache::get(uint32_t maxAgeMs,
+                                             const SensorSettings *settings) {
+    if (m_mutex == nullptr) {
+        return nullptr;
+    }
+    // Held across the capture, so a second caller waits for this frame
+    // instead of taking another driver buffer
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    if (settings && *settings != m_active && m_held >= CAMERA_FB_COUNT) {
+        waitForRelease();
+    }
+    bool matches = !settings || *settings == m_active;
+    // Switching empties the cache, so the latest frame was taken with the
+    // active settings
+    std::shared_ptr<CameraFrame> frame = matches ? m_latest.lock() : nullptr;
+    bool fresh = frame && millis() - frame->takenMs() <= maxAgeMs;
+    if (fresh || (frame && m_held >= CAMERA_FB_COUNT)) {
+        m_shared++;
+    } else if (!matches && m_held >= CAMERA_FB_COUNT) {
+        // Still all held, flushing the old frames would block
+        frame = nullptr;
+    } else if (!matches && !switchTo(*settings)) {
+        frame = nullptr;
+    } else {
+        camera_fb_t *fb = capturePhoto();
+        if (fb) {
+            frame = std::make_shared<CameraFrame>(fb, ++m_seq, m_active);
+            m_taken_ms = frame->takenMs();
+            m_latest = frame;
+            m_invalidated = false;
+        } else {
+            frame = nullptr;
+        }
+    }
+    xSemaphoreGive(m_mutex);
+    return frame;
+}
+
+std::shared_ptr<CameraFrame> FrameCache::find(uint32_t seq) {
+    if (m_mutex == nullptr) {
+        return nullptr;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    std::shared_ptr<CameraFrame> frame = m_latest.lock();
+    xSemaphoreGive(m_mutex);
+    return frame && frame->seq() == seq ? frame : nullptr;
+}
+
+bool FrameCache::isCurrent(const String &etag, const SensorSettings *settings,
+                           uint32_t maxAgeMs) {
+    if (m_mutex == nullptr) {
+        return false;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    bool current = m_seq != 0 && !m_invalidated &&
+                   (!settings || *settings == m_active) &&
+                   millis() - m_taken_ms <= maxAgeMs &&
+                   etag == "\"" + String(m_seq) + "\"";
+    xSemaphoreGive(m_mutex);
+    return current;
+}
+
+void FrameCache::invalidate() {
+    if (m_mutex == nullptr) {
+        return;
+    }
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    m_latest.reset();
+    m_invalidated = true;
+    xSemaphoreGive(m_mutex);
+}
@@ -0,0 +1,201 @@
+#ifndef __frame_cache_h__
+#define __frame_cache_h__
+
+#include "CaptureProfile.h"
+#include <Arduino.h>
+#include <atomic>
+#include <esp_camera.h>
+#include <esp_jpg_decode.h>
+#include <memory>
+
+/**
+ * @brief How old a frame may be and still be handed to another request, in
+ * milliseconds.
+ */
+#define FRAME_CACHE_MAX_AGE_MS 200
+
+/**
+ * @brief How long a caller asking for other sensor settings waits for a
+ * driver buffer to be given back when every one is held, in milliseconds.
+ * Bounded, since a holder sending its frame from the same task cannot give
+ * it back while the caller waits.
+ */
+#define FRAME_CACHE_SWITCH_WAIT_MS 300
+
+/**
+ * @class CameraFrame
+ * @brief A driver frame buffer shared between everyone sending or reading
+ * it. The buffer goes back to the driver when the last reference is dropped,
+ * for example when a client disconnects half way through a response.
+ */
+class CameraFrame {
+  private:
+    camera_fb_t *m_fb;
+    uint32_t m_seq;
+    uint32_t m_taken_ms;
+    SensorSettings m_settings;
+
+  public:
+    CameraFrame(camera_fb_t *fb, uint32_t seq, const SensorSettings &settings);
+    ~CameraFrame();
+
+    const uint8_t *data() { return m_fb->buf; }
+    size_t length() { return m_fb->len; }
+    int width() { return m_fb->width; }
+    int height() { return m_fb->height; }
+    camera_fb_t *fb() { return m_fb; }
+
+    /**
+     * @brief Copies up to `len` bytes of the JPEG from `index`, in the form
+     * the decoder's reader callback expects. A null `buf` only skips.
+     *
+     * @return Number of bytes read, 0 at the end.
+     */
+    size_t read(size_t index, uint8_t *buf, size_t len);
+
+    /**
+     * @brief Decodes the JPEG to 8-bit grayscale at a reduced scale.
+     *
+     * @param scale    Reduction applied by the decoder. At 1/8 it only uses
+     * the DC coefficient of each block, skipping the inverse transform.
+     * @param pixels   Destination, row after row.
+     * @param capacity Room in `pixels`, in pixels.
+     * @param width    Set to the width of the decoded image.
+     * @param height   Set to the height of the decoded image.
+     * @return `false` if the JPEG could not be decoded or does not fit.
+     */
+    bool decodeGray(jpg_scale_t scale, uint8_t *pixels, size_t capacity,
+                    int &width, int &height);
+
+    /**
+     * @brief Number of the frame, counting up from 1 since boot.
+     */
+    uint32_t seq() { return m_seq; }
+
+    /**
+     * @brief `millis()` when the frame was taken from the driver.
+     */
+    uint32_t takenMs() { return m_taken_ms; }
+
+    /**
+     * @brief Sensor settings the frame was captured with.
+     */
+    const SensorSettings &settings() { return m_settings; }
+
+    /**
+     * @brief Capture time stamped by the driver, in milliseconds.
+     */
+    int64_t timestampMs();
+
+    /**
+     * @brief Entity tag of the frame, its quoted sequence number.
+     */
+    String etag() { return "\"" + String(m_seq) + "\""; }
+};
+
+/**
+ * @class FrameCache
+ * @brief Single point through which camera frames are taken from the
+ * driver, so concurrent requests share a frame instead of each holding one
+ * of the few driver buffers.
+ *
+ * The cache only keeps a weak reference to the latest frame. A frame is
+ * shared while someone still holds it and it is younger than the requested
+ * age, and goes back to the driver as soon as nobody does. When every driver
+ * buffer is held the latest frame is shared regardless of its age, since
+ * asking the driver would block until one of the holders is done.
+ *
+ * It also owns the sensor settings. Callers ask for the settings they need
+ * and the registers are only written when those differ from the ones the
+ * sensor runs with, so repeated requests for the same profile cost nothing.
+ */
+class FrameCache {
+  private:
+    SemaphoreHandle_t m_mutex;
+    SemaphoreHandle_t m_released; /**< Given when a frame is dropped */
+    std::weak_ptr<CameraFrame> m_latest;
+    uint32_t m_seq;       /**< Of the latest frame */
+    uint32_t m_taken_ms;  /**< Of the latest frame */
+    bool m_invalidated;
+    SensorSettings m_active; /**< What the sensor currently runs with */
+    uint32_t m_switches;
+    std::atomic<int> m_held;
+    std::atomic<uint32_t> m_shared;
+
+    friend class CameraFrame;
+
+    bool switchTo(const SensorSettings &settings);
+    void waitForRelease();
+
+  public:
+    FrameCache();
+
+    /**
+     * @brief Creates the lock, call once the camera is initialized.
+     *
+     * @param settings Settings the camera was initialized with.
+     */
+    bool begin(const SensorSettings &settings);
+
+    /**
+     * @brief Returns the latest frame if it is at most `maxAgeMs` old, still
+     * held and taken with `settings`, otherwise takes a new one from the
+     * driver.
+     *
+     * @param maxAgeMs Age up to which another request's frame is reused.
+     * @param settings Settings the frame must be taken with, null for
+     * whatever the sensor currently runs with.
+     * Switching settings needs every driver buffer back, so when all of them
+     * are held this waits up to `FRAME_CACHE_SWITCH_WAIT_MS` for one to be
+     * released.
+     *
+     * @return The frame, or null if the camera is not initialized, the
+     * capture failed, or the settings cannot be switched because every
+     * driver buffer stayed held.
+     */
+    std::shared_ptr<CameraFrame>
+    get(uint32_t maxAgeMs = FRAME_CACHE_MAX_AGE_MS,
+        const SensorSettings *settings = nullptr);
+
+    /**
+     * @brief Returns the frame numbered `seq` if it is the latest one and
+     * still held.
+     */
+    std::shared_ptr<CameraFrame> find(uint32_t seq);
+
+    /**
+     * @brief Checks whether `etag` names the latest frame, taken with
+     * `settings` at most `maxAgeMs` ago, that is nothing newer would be
+     * captured for it.
+     */
+    bool isCurrent(const String &etag, const SensorSettings *settings = nullptr,
+                   uint32_t maxAgeMs = FRAME_CACHE_MAX_AGE_MS);
+
+    /**
+     * @brief Stops sharing the latest frame, e.g. after the sensor settings
+     * changed.
+     */
+    void invalidate();
+
+    /**
+     * @brief Sequence number of the latest frame, 0 before the first one.
+     */
+    uint32_t latestSeq() { return m_seq; }
+
+    /**
+     * @brief Number of requests served with a frame taken for another one.
+     */
+    uint32_t sharedCount() { return m_shared; }
+
+    /**
+     * @brief Number of times the sensor settings were changed.
+     */
+    uint32_t switchCount() { return m_switches; }
+};
+
+/**
+ * @brief Global frame cache used by every camera endpoint.
+ */
+extern FrameCache frameCache;
+
+#endif
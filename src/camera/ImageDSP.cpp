@@ -0,0 +1,108 @@
+#include "ImageDSP.h"
+
+static inline uint16_t packRgb565(uint32_t r, uint32_t g, uint32_t b) {
+    // High byte first in memory: RRRRRGGG GGGBBBBB
+    uint32_t high = (r & 0xF8) | (g >> 5);
+    uint32_t low = ((g << 3) & 0xE0) | (b >> 3);
+    return (uint16_t)(high | (low << 8));
+}
+
+static inline bool isWordAligned(const void *pointer) {
+    return ((uintptr_t)pointer & 3) == 0;
+}
+
+/**
+ * Converts 4 pixels per iteration from three little-endian words
+ * `r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3` into two words of two pixels,
+ * keeping every load and store a full aligned word.
+ */
+static void rgb888ToRgb565Words(const uint32_t *rgb, uint32_t *out,
+                                size_t blocks) {
+    for (size_t block = 0; block < blocks; block++) {
+        uint32_t w0 = rgb[0];
+        uint32_t w1 = rgb[1];
+        uint32_t w2 = rgb[2];
+        rgb += 3;
+        uint32_t p0 = packRgb565(w0 & 0xFF, (w0 >> 8) & 0xFF,
+                                 (w0 >> 16) & 0xFF);
+        uint32_t p1 = packRgb565(w0 >> 24, w1 & 0xFF, (w1 >> 8) & 0xFF);
+        uint32_t p2 = packRgb565((w1 >> 16) & 0xFF, w1 >> 24, w2 & 0xFF);
+        uint32_t p3 = packRgb565((w2 >> 8) & 0xFF, (w2 >> 16) & 0xFF,
+                                 w2 >> 24);
+        out[0] = p0 | (p1 << 16);
+        out[1] = p2 | (p3 << 16);
+        out += 2;
+    }
+}
+
+void rgb888ToRgb565(const uint8_t *rgb, uint16_t *out, size_t count) {
+    size_t done = 0;
+    if (isWordAligned(rgb) && isWordAligned(out)) {
+        done = count & ~(size_t)3;
+        rgb888ToRgb565Words((const uint32_t *)rgb, (uint32_t *)out, done / 4);
+    }
+    for (size_t i = done; i < count; i++) {
+        out[i] = packRgb565(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]);
+    }
+}
+
+void rgb888ToGray(const uint8_t *rgb, uint8_t *gray, size_t count) {
+    for (size_t i = 0; i < count; i++, rgb += 3) {
+        gray[i] = (uint8_t)((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8);
+    }
+}
+
+void downsampleGray(const uint8_t *src, int width, int height, uint8_t *grid,
+                    int gridWidth, int gridHeight) {
+    for (int cellY = 0; cellY < gridHeight; cellY++) {
+        int top = cellY * height / gridHeight;
+        int bottom = (cellY + 1) * height / gridHeight;
+        for (int cellX = 0; cellX < gridWidth; cellX++) {
+            int left = cellX * width / gridWidth;
+            int right = (cellX + 1) * width / gridWidth;
+            uint32_t sum = 0;
+            for (int y = top; y < bottom; y++) {
+                const uint8_t *row = src + (size_t)y * width;
+                for (int x = left; x < right; x++) {
+                    sum += row[x];
+                }
+            }
+            uint32_t area = (uint32_t)(bottom - top) * (right - left);
+            grid[cellY * gridWidth + cellX] =
+                (uint8_t)((sum + area / 2) / area);
+        }
+    }
+}
+
+size_t compareToBackground(const uint8_t *grid, uint16_t *background,
+                           size_t count, int threshold, int shift) {
+    if (count == 0) {
+        return 0;
+    }
+    // Means in Q8, their difference is the global brightness change
+    int32_t gridSum = 0;
+    int32_t backgroundSum = 0;
+    for (size_t i = 0; i < count; i++) {
+        gridSum += grid[i];
+        backgroundSum += background[i];
+    }
+    int32_t offset = (int32_t)(((int64_t)gridSum * 256 - backgroundSum) /
+                               (int64_t)count);
+
+    int32_t limit = threshold * 256;
+    size_t changed = 0;
+    for (size_t i = 0; i < count; i++) {
+        int32_t difference = grid[i] * 256 - background[i];
+        int32_t local = difference - offset;
+        if (local > limit || local < -limit) {
+            changed++;
+        }
+        // Rounded towards the target so the background always converges
+        int32_t step = difference >> shift;
+        if (step == 0 && difference != 0) {
+            step = difference > 0 ? 1 : -1;
+        }
+        background[i] = (uint16_t)(background[i] + step);
+    }
+    return changed;
+}
@@ -0,0 +1,76 @@
+#ifndef IMAGE_DSP_H
+#define IMAGE_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file ImageDSP.h
+ * @brief Pixel-level kernels used on decoded camera frames.
+ *
+ * Like the audio kernels they only depend on the C standard library, so they
+ * can be compiled and checked on a host machine.
+ */
+
+/**
+ * @brief Converts packed RGB888 pixels to big-endian RGB565, the byte order
+ * the camera and the JPEG encoder use.
+ *
+ * Works on four pixels (three 32-bit words in, two out) per step when both
+ * buffers are 4-byte aligned, and pixel by pixel otherwise.
+ *
+ * @param rgb    Source pixels, 3 bytes each in R, G, B order.
+ * @param out    Destination, room for `count` pixels.
+ * @param count  Number of pixels.
+ */
+void rgb888ToRgb565(const uint8_t *rgb, uint16_t *out, size_t count);
+
+/**
+ * @brief Converts packed RGB888 pixels to 8-bit luma with the BT.601
+ * weights in Q8.
+ *
+ * @param rgb   Source pixels, 3 bytes each in R, G, B order.
+ * @param gray  Destination, room for `count` pixels.
+ * @param count Number of pixels.
+ */
+void rgb888ToGray(const uint8_t *rgb, uint8_t *gray, size_t count);
+
+/**
+ * @brief Averages a grayscale image down to a fixed grid, each output cell
+ * being the mean of the source pixels it covers.
+ *
+ * Cells cover whole source pixels, so sizes that do not divide evenly give
+ * cells that differ by at most one pixel in width or height.
+ *
+ * @param src        Source image, `width * height` pixels.
+ * @param width      Source width, at least `gridWidth`.
+ * @param height     Source height, at least `gridHeight`.
+ * @param grid       Destination, `gridWidth * gridHeight` cells.
+ * @param gridWidth  Cells per row.
+ * @param gridHeight Rows of cells.
+ */
+void downsampleGray(const uint8_t *src, int width, int height, uint8_t *grid,
+                    int gridWidth, int gridHeight);
+
+/**
+ * @brief Compares a grid against a running background, then moves the
+ * background towards it.
+ *
+ * The background is kept in Q8 so slow adaptation does not stall on
+ * rounding. The difference of the two means is taken out before comparing,
+ * so a global brightness change from auto exposure does not count as
+ * change.
+ *
+ * @param grid       Current cells.
+ * @param background Q8 background of the same size, updated in place.
+ * @param count      Number of cells.
+ * @param threshold  Difference in gray levels above which a cell counts as
+ * changed.
+ * @param shift      Adaptation rate, the background moves by 1 / 2^shift of
+ * the difference per call.
+ * @return Number of changed cells.
+ */
+size_t compareToBackground(const uint8_t *grid, uint16_t *background,
+                           size_t count, int threshold, int shift);
+
+#endif // IMAGE_DSP_H
@@ -0,0 +1,213 @@
+#include "PresenceDetector.h"
+#include "ChangeDetector.h"
+#include "Globals.h"
+#include "ImageDSP.h"
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#define PRESENCE_DETECTOR_TASK_STACK 4096
+#define PRESENCE_DETECTOR_TASK_PRIORITY 1
+// The audio engine owns core 1
+#define PRESENCE_DETECTOR_TASK_CORE 0
+
+// Outputs of the model, one logit or absent/present logits
+#define PRESENCE_DETECTOR_MAX_OUTPUTS 2
+
+PresenceDetector presenceDetector;
+
+static AsyncEventSource presenceEvents(PRESENCE_EVENTS_PATH);
+
+PresenceDetector::PresenceDetector()
+    : m_taskHandle(nullptr), m_model(nullptr), m_arena(nullptr),
+      m_present(false), m_probability(0), m_seq(0), m_run_ms(0),
+      m_state_ms(0), m_inferences(0), m_skipped(0), m_inference_us(0) {}
+
+bool PresenceDetector::loadModel() {
+    File file = SPIFFS.open(PRESENCE_MODEL_PATH, "r");
+    if (!file) {
+        return false;
+    }
+    size_t size = file.size();
+    // Internal RAM when there is room, the weights are read for every output
+    // pixel
+    m_model = (uint8_t *)heap_caps_aligned_alloc(TINY_CNN_ALIGNMENT, size,
+                                                 MALLOC_CAP_8BIT);
+    bool loaded = m_model && file.read(m_model, size) == size &&
+                  m_cnn.load(m_model, size) && m_cnn.inputChannels() == 1 &&
+                  m_cnn.outputCount() <= PRESENCE_DETECTOR_MAX_OUTPUTS;
+    file.close();
+    if (loaded) {
+        m_arena = (uint8_t *)heap_caps_aligned_alloc(
+            TINY_CNN_ALIGNMENT, m_cnn.arenaSize(), MALLOC_CAP_8BIT);
+        loaded = m_arena != nullptr;
+    }
+    if (!loaded) {
+        heap_caps_free(m_model);
+        m_model = nullptr;
+    }
+    return loaded;
+}
+
+bool PresenceDetector::begin() {
+    if (m_taskHandle != nullptr) {
+        return true;
+    }
+    if (!SPIFFS.exists(PRESENCE_MODEL_PATH)) {
+        Serial.println("No presence model, presence detector disabled.");
+        return true;
+    }
+    if (m_model == nullptr && !loadModel()) {
+        Serial.println("Loading " PRESENCE_MODEL_PATH " FAILURE.");
+        return false;
+    }
+
+    // Frames are decoded at the largest reduction that covers the input,
+    // so at most twice its size, or 1/8 of the largest profile
+    int width = m_cnn.inputWidth();
+    int height = m_cnn.inputHeight();
+    framesize_t largest = defaultCaptureProfile.settings.frameSize;
+    size_t decoded = (size_t)((resolution[largest].width + 7) / 8) *
+                     ((resolution[largest].height + 7) / 8);
+    m_gray = PSRAMBuffer(max(decoded, (size_t)4 * width * height));
+    m_input = PSRAMBuffer((size_t)width * height);
+    if (!m_gray || !m_input ||
+        xTaskCreatePinnedToCore(taskEntry, "Presence Detector Task",
+                                PRESENCE_DETECTOR_TASK_STACK, this,
+                                PRESENCE_DETECTOR_TASK_PRIORITY, &m_taskHandle,
+                                PRESENCE_DETECTOR_TASK_CORE) != pdPASS) {
+        Serial.println("Presence detector task creation FAILURE.");
+        m_taskHandle = nullptr;
+        return false;
+    }
+    changeDetector.shareFrames(m_taskHandle);
+    Serial.println("Presence model loaded, " + String(m_cnn.macCount()) +
+                   " MACs per frame.");
+    return true;
+}
+
+void PresenceDetector::taskEntry(void *param) {
+    static_cast<PresenceDetector *>(param)->run();
+}
+
+void PresenceDetector::run() {
+    const TickType_t period = pdMS_TO_TICKS(1000 / PRESENCE_DETECTOR_FPS);
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        if (!changeDetector.isRunning()) {
+            vTaskDelayUntil(&wake, period);
+            analyze(nullptr);
+            continue;
+        }
+        // Paced by the change detector, which hands on each frame it
+        // analyzed. A frame of its own only if that stalls.
+        bool handedOn = ulTaskNotifyTake(pdTRUE, 2 * period) > 0;
+        std::shared_ptr<CameraFrame> frame = changeDetector.takeFrame();
+        if (handedOn && !frame) {
+            // No new frame since the last one
+            continue;
+        }
+        analyze(frame);
+    }
+}
+
+float PresenceDetector::probability(const int8_t *outputs) {
+    // A single logit, or the margin of present over absent
+    float logit = m_cnn.dequantize(outputs[0]);
+    if (m_cnn.outputCount() == 2) {
+        logit = m_cnn.dequantize(outputs[1]) - logit;
+    }
+    return 1.0f / (1.0f + expf(-logit));
+}
+
+bool PresenceDetector::analyze(std::shared_ptr<CameraFrame> frame) {
+    // The change detector saw a later frame and nothing moved since the last
+    // one analyzed here, the answer still holds
+    if (m_seq != 0 && changeDetector.isRunning() &&
+        !changeDetector.changedSince(m_seq) &&
+        millis() - m_run_ms < PRESENCE_DETECTOR_REFRESH_MS) {
+        m_skipped++;
+        return false;
+    }
+
+    if (!frame) {
+        frame = frameCache.get(1000 / PRESENCE_DETECTOR_FPS);
+    }
+    if (!frame || frame->seq() == m_seq) {
+        return false;
+    }
+
+    int width = m_cnn.inputWidth();
+    int height = m_cnn.inputHeight();
+    jpg_scale_t scale = JPG_SCALE_8X;
+    while (scale > JPG_SCALE_NONE &&
+           ((frame->width() >> scale) < width ||
+            (frame->height() >> scale) < height)) {
+        scale = (jpg_scale_t)(scale - 1);
+    }
+    int decodedWidth = 0;
+    int decodedHeight = 0;
+    bool decoded = frame->decodeGray(scale, m_gray.data(), m_gray.size(),
+                                     decodedWidth, decodedHeight);
+    uint32_t seq = frame->seq();
+    // Give the buffer back before the arithmetic
+    frame.reset();
+    if (!decoded || decodedWidth < width || decodedHeight < height) {
+        // Undecodable, or a profile smaller than the model input
+        return false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    downsampleGray(m_gray.data(), decodedWidth, decodedHeight, m_input.data(),
+                   width, height);
+    int8_t outputs[PRESENCE_DETECTOR_MAX_OUTPUTS];
+    m_cnn.invoke(m_input.data(), m_arena, outputs);
+    float p = probability(outputs);
+    m_inference_us = esp_timer_get_time() - start;
+    uint32_t now = millis();
+    m_run_ms = now;
+    m_probability = p;
+    m_seq = seq;
+    m_inferences++;
+
+    bool present = m_present;
+    if (present ? p < PRESENCE_DETECTOR_OFF : p >= PRESENCE_DETECTOR_ON) {
+        m_present = !present;
+        m_state_ms = now;
+        presenceEvents.send(toJson().c_str(), "presence", seq);
+    }
+    return true;
+}
+
+String PresenceDetector::toJson() {
+    JsonDocument doc;
+    doc["present"] = (bool)m_present;
+    doc["probability"] = (float)m_probability;
+    doc["seq"] = (uint32_t)m_seq;
+    doc["ageMs"] = m_seq ? millis() - m_run_ms : (uint32_t)0;
+    doc["msSinceChange"] = m_state_ms ? millis() - m_state_ms : (uint32_t)0;
+    doc["inferences"] = (uint32_t)m_inferences;
+    doc["skipped"] = (uint32_t)m_skipped;
+    doc["inferenceUs"] = (uint32_t)m_inference_us;
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+void initializePresenceEvents() {
+    presenceEvents.onConnect([](AsyncEventSourceClient *client) {
+        client->send(presenceDetector.toJson().c_str(), "presence",
+                     presenceDetector.seq());
+    });
+    server.addHandler(&presenceEvents);
+}
+
+void processPresenceRequest(AsyncWebServerRequest *request,
+                            const JsonDocument &doc) {
+    if (!presenceDetector.isRunning()) {
+        request->send(503, "application/json",
+                      "{\"error\":\"Presence detector not running.\"}");
+        return;
+    }
+    request->send(200, "application/json", presenceDetector.toJson());
+}
@@ -0,0 +1,138 @@
+#ifndef __presence_detector_h__
+#define __presence_detector_h__
+
+#include "FrameCache.h"
+#include "TinyCNN.h"
+#include "audio/PSRAMBuffer.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+
+/**
+ * @brief SPIFFS path of the model, packed with tools/pack_presence_model.py.
+ */
+#define PRESENCE_MODEL_PATH "/presence.bin"
+
+/**
+ * @brief Path of the server-sent events stream announcing presence changes.
+ */
+#define PRESENCE_EVENTS_PATH "/presence/events"
+
+/**
+ * @brief Frames checked per second, `CHANGE_DETECTOR_FPS` sets the pace
+ * instead while the change detector runs.
+ */
+#define PRESENCE_DETECTOR_FPS 4
+
+/**
+ * @brief Longest time a result is kept without running the model again,
+ * even if the change detector saw nothing move.
+ */
+#define PRESENCE_DETECTOR_REFRESH_MS 5000
+
+/**
+ * @brief Probabilities at which the state turns present and back absent.
+ * The gap keeps a borderline scene from flapping.
+ */
+#define PRESENCE_DETECTOR_ON 0.6f
+#define PRESENCE_DETECTOR_OFF 0.4f
+
+/**
+ * @class PresenceDetector
+ * @brief Tells whether someone is in front of the camera without leaving
+ * the robot, so the vision model is only asked when something is there.
+ *
+ * A low-priority task decodes frames to grayscale at the largest
+ * reduction that still covers the model input, averages them down to it and
+ * runs the int8 CNN loaded from `PRESENCE_MODEL_PATH` with `TinyCNN`. While
+ * `changeDetector` runs, the task wakes right after it and checks the frame
+ * it just analyzed, so both share one capture. Otherwise it takes frames from
+ * `frameCache` on its own.
+ *
+ * Frames are skipped while `changeDetector` has analyzed a later frame and
+ * reports nothing moved since the last one analyzed here, up to
+ * `PRESENCE_DETECTOR_REFRESH_MS`. Every change of
+ * the present/absent state is sent as a `presence` event on
+ * `PRESENCE_EVENTS_PATH`.
+ */
+class PresenceDetector {
+  private:
+    TaskHandle_t m_taskHandle;
+    uint8_t *m_model; /**< Model file, the weights are used in place */
+    uint8_t *m_arena;
+    TinyCNN m_cnn;
+    PSRAMBuffer m_gray;  /**< Decoded frame */
+    PSRAMBuffer m_input; /**< Frame averaged down to the model input */
+
+    std::atomic<bool> m_present;
+    std::atomic<float> m_probability;
+    std::atomic<uint32_t> m_seq;
+    std::atomic<uint32_t> m_run_ms;   /**< `millis()` of the last inference */
+    std::atomic<uint32_t> m_state_ms; /**< `millis()` of the last flip */
+    std::atomic<uint32_t> m_inferences;
+    std::atomic<uint32_t> m_skipped;
+    std::atomic<uint32_t> m_inference_us;
+
+    static void taskEntry(void *param);
+    void run();
+    bool loadModel();
+    bool analyze(std::shared_ptr<CameraFrame> frame);
+    float probability(const int8_t *outputs);
+
+  public:
+    PresenceDetector();
+
+    /**
+     * @brief Loads the model and starts the detector task, call once the
+     * camera is initialized. Without a model file the detector stays off.
+     *
+     * @return `false` if the model is malformed or the task could not be
+     * started.
+     */
+    bool begin();
+
+    bool isRunning() { return m_taskHandle != nullptr; }
+
+    /**
+     * @brief Whether someone was in front of the camera in the last frame
+     * analyzed.
+     */
+    bool isPresent() { return m_present; }
+
+    /**
+     * @brief Sequence number of the last frame analyzed.
+     */
+    uint32_t seq() { return m_seq; }
+
+    /**
+     * @brief Formats the state as a JSON object.
+     */
+    String toJson();
+};
+
+/**
+ * @brief Global presence detector.
+ */
+extern PresenceDetector presenceDetector;
+
+/**
+ * @brief Registers the `PRESENCE_EVENTS_PATH` event stream with the web
+ * server. A client gets the current state as soon as it connects.
+ */
+void initializePresenceEvents();
+
+/**
+ * @brief Reports whether someone is in front of the camera.
+ *
+ * Answers from the last frame analyzed, at most 1 / `PRESENCE_DETECTOR_FPS`
+ * behind when the scene changes. Responds with 503 if the detector is not
+ * running, e.g. because no model was uploaded.
+ *
+ * @param request Pointer to the AsyncWebServerRequest object.
+ * @param doc Reference to the JsonDocument containing request data (unused).
+ */
+void processPresenceRequest(AsyncWebServerRequest *request,
+                            const JsonDocument &doc);
+
+#endif
@@ -0,0 +1,20 @@
+#include "RateControl.h"
+
+RateControl rateControl;
+
+static size_t captureFrame(void *context, const SensorSettings &settings) {
+    std::shared_ptr<CameraFrame> &frame =
+        *(std::shared_ptr<CameraFrame> *)context;
+    // Give the buffer back before asking for the next one
+    frame.reset();
+    frame = frameCache.get(FRAME_CACHE_MAX_AGE_MS, &settings);
+    return frame ? frame->length() : 0;
+}
+
+std::shared_ptr<CameraFrame> RateControl::capture(size_t maxBytes,
+                                                  const SensorSettings &start,
+                                                  int &iterations) {
+    std::shared_ptr<CameraFrame> frame;
+    iterations = m_model.meetBudget(maxBytes, start, captureFrame, &frame);
+    return frame;
+}
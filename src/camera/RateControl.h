@@ -0,0 +1,40 @@
+#ifndef __rate_control_h__
+#define __rate_control_h__
+
+#include "FrameCache.h"
+#include "RateModel.h"
+#include <memory>
+
+/**
+ * @class RateControl
+ * @brief Captures frames from `frameCache` under a byte budget, with the
+ * quality and frame size `RateModel` picks.
+ *
+ * Not thread safe, it is only used from the web server task.
+ */
+class RateControl {
+  private:
+    RateModel m_model;
+
+  public:
+    /**
+     * @brief Captures a frame of at most `maxBytes`.
+     *
+     * @param maxBytes Size budget of the JPEG.
+     * @param start Largest frame size and best quality to use.
+     * @param iterations Set to the number of frames captured.
+     * @return The frame, which may still be over budget if it could not be
+     * met in `RATE_CONTROL_MAX_ITERATIONS` frames, or null if the capture
+     * failed.
+     */
+    std::shared_ptr<CameraFrame> capture(size_t maxBytes,
+                                         const SensorSettings &start,
+                                         int &iterations);
+};
+
+/**
+ * @brief Global rate controller used by `/capture?maxBytes=`.
+ */
+extern RateControl rateControl;
+
+#endif
@@ -0,0 +1,139 @@
+#include "RateModel.h"
+#include <Arduino.h>
+#include <math.h>
+
+// Aim this far under the budget, so noise between frames rarely crosses it
+#define RATE_CONTROL_HEADROOM 0.9f
+
+// Starting model before any frame has been seen, about what the OV2640
+// produces for an indoor scene at quality 12
+#define RATE_CONTROL_DEFAULT_QUALITY 12
+#define RATE_CONTROL_DEFAULT_BYTES_PER_PIXEL 0.13f
+#define RATE_CONTROL_DEFAULT_SLOPE -0.04f
+
+#define RATE_CONTROL_MIN_SLOPE -0.15f
+#define RATE_CONTROL_MAX_SLOPE -0.005f
+
+/**
+ * @brief Frame sizes tried, largest first, when the quality alone cannot
+ * meet the budget.
+ */
+static const framesize_t ladder[] = {
+    FRAMESIZE_UXGA, FRAMESIZE_SXGA, FRAMESIZE_XGA,  FRAMESIZE_SVGA,
+    FRAMESIZE_VGA,  FRAMESIZE_HVGA, FRAMESIZE_QVGA, FRAMESIZE_QQVGA};
+
+static float pixels(framesize_t size) {
+    return (float)resolution[size].width * resolution[size].height;
+}
+
+RateModel::RateModel() {
+    for (int gray = 0; gray < 2; gray++) {
+        for (int size = 0; size < FRAMESIZE_INVALID; size++) {
+            m_models[gray][size] = {0, 0, RATE_CONTROL_DEFAULT_SLOPE};
+        }
+    }
+}
+
+float RateModel::predictBytes(framesize_t size, bool grayscale,
+                              int quality) {
+    // Prefer the same size, then the nearest size in the same color mode,
+    // then the other color mode
+    const Model *reference = nullptr;
+    float scale = 1.0f;
+    for (int pass = 0; pass < 2 && !reference; pass++) {
+        bool gray = pass == 0 ? grayscale : !grayscale;
+        float bestDistance = INFINITY;
+        for (int other = 0; other < FRAMESIZE_INVALID; other++) {
+            const Model &model = m_models[gray][other];
+            if (model.quality == 0) {
+                continue;
+            }
+            float ratio = pixels(size) / pixels((framesize_t)other);
+            float distance = fabsf(logf(ratio));
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                reference = &model;
+                scale = ratio;
+            }
+        }
+    }
+
+    if (!reference) {
+        return pixels(size) * RATE_CONTROL_DEFAULT_BYTES_PER_PIXEL *
+               expf(RATE_CONTROL_DEFAULT_SLOPE *
+                    (quality - RATE_CONTROL_DEFAULT_QUALITY));
+    }
+    return reference->bytes * scale *
+           expf(reference->slope * (quality - reference->quality));
+}
+
+SensorSettings RateModel::plan(size_t maxBytes, const SensorSettings &start) {
+    float target = maxBytes * RATE_CONTROL_HEADROOM;
+    float largest = pixels(start.frameSize);
+    int bestQuality = max(start.quality, RATE_CONTROL_MIN_QUALITY);
+
+    SensorSettings settings = start;
+    settings.quality = qualityFor(start.frameSize, start.grayscale,
+                                  bestQuality, target);
+    for (framesize_t size : ladder) {
+        if (settings.quality <= RATE_CONTROL_MAX_QUALITY) {
+            return settings;
+        }
+        if (pixels(size) < largest) {
+            settings.frameSize = size;
+            settings.quality =
+                qualityFor(size, start.grayscale, bestQuality, target);
+        }
+    }
+    settings.quality = min(settings.quality, RATE_CONTROL_MAX_QUALITY);
+    return settings;
+}
+
+int RateModel::qualityFor(framesize_t size, bool grayscale, int bestQuality,
+                          float target) {
+    float bytes = predictBytes(size, grayscale, bestQuality);
+    if (bytes <= target) {
+        return bestQuality;
+    }
+    // The prediction is exponential in the quality, so two probes give the
+    // slope to solve for the target with
+    float slope = logf(predictBytes(size, grayscale, bestQuality + 1) / bytes);
+    return bestQuality + (int)ceilf(logf(target / bytes) / slope);
+}
+
+void RateModel::observe(const SensorSettings &settings, size_t bytes) {
+    Model &model = m_models[settings.grayscale][settings.frameSize];
+    if (model.quality != 0 && model.quality != settings.quality) {
+        float slope = logf((float)bytes / model.bytes) /
+                      (settings.quality - model.quality);
+        slope = constrain(slope, RATE_CONTROL_MIN_SLOPE,
+                          RATE_CONTROL_MAX_SLOPE);
+        model.slope = (model.slope + slope) / 2;
+    }
+    model.quality = settings.quality;
+    model.bytes = bytes;
+}
+
+int RateModel::meetBudget(size_t maxBytes, const SensorSettings &start,
+                          rate_capture_t capture, void *context) {
+    SensorSettings last = start;
+    int iterations = 0;
+    while (iterations < RATE_CONTROL_MAX_ITERATIONS) {
+        SensorSettings settings = plan(maxBytes, start);
+        if (iterations > 0 && settings == last) {
+            // Already at the limits, another frame would not be smaller
+            break;
+        }
+        size_t bytes = capture(context, settings);
+        iterations++;
+        if (bytes == 0) {
+            break;
+        }
+        observe(settings, bytes);
+        last = settings;
+        if (bytes <= maxBytes) {
+            break;
+        }
+    }
+    return iterations;
+}
@@ -0,0 +1,85 @@
+#ifndef RATE_MODEL_H
+#define RATE_MODEL_H
+
+#include "SensorSettings.h"
+#include <stddef.h>
+
+/**
+ * @file RateModel.h
+ * @brief JPEG size model of the rate controller.
+ *
+ * Only needs the sensor types, not the camera, so the controller can be run
+ * on a host machine against a simulated sensor.
+ */
+
+/**
+ * @brief Best JPEG quality the controller picks. Lower numbers can overflow
+ * the frame buffers at full resolution.
+ */
+#define RATE_CONTROL_MIN_QUALITY 10
+
+/**
+ * @brief Worst JPEG quality the sensor supports.
+ */
+#define RATE_CONTROL_MAX_QUALITY 63
+
+/**
+ * @brief Frames captured at most to meet a byte budget.
+ */
+#define RATE_CONTROL_MAX_ITERATIONS 3
+
+/**
+ * @brief Takes a frame with `settings`.
+ *
+ * @return Size of the JPEG, 0 if the capture failed.
+ */
+typedef size_t (*rate_capture_t)(void *context,
+                                 const SensorSettings &settings);
+
+/**
+ * @class RateModel
+ * @brief Picks the JPEG quality, and if needed a smaller frame size, that
+ * keeps captures under a byte budget.
+ *
+ * For each frame size and color mode it keeps a model of
+ * `bytes = b0 * exp(slope * (quality - q0))`, anchored at the last frame
+ * seen and with the slope estimated from the last two. Sizes without a
+ * frame of their own are predicted from another size by pixel count. Every
+ * frame it captures refines the model, so after the first request the
+ * budget is usually met with the first frame.
+ */
+class RateModel {
+  private:
+    struct Model {
+        int quality;  /**< Of the last frame, 0 before the first one */
+        size_t bytes; /**< Of the last frame */
+        float slope;  /**< d ln(bytes) / d quality */
+    };
+
+    Model m_models[2][FRAMESIZE_INVALID];
+
+    float predictBytes(framesize_t size, bool grayscale, int quality);
+    SensorSettings plan(size_t maxBytes, const SensorSettings &start);
+    int qualityFor(framesize_t size, bool grayscale, int bestQuality,
+                   float target);
+    void observe(const SensorSettings &settings, size_t bytes);
+
+  public:
+    RateModel();
+
+    /**
+     * @brief Captures frames until one fits `maxBytes`, at most
+     * `RATE_CONTROL_MAX_ITERATIONS`, or until the limits are reached.
+     *
+     * @param maxBytes Size budget of the JPEG.
+     * @param start Largest frame size and best quality to use.
+     * @param capture Takes each frame, the caller keeps the last one.
+     * @param context Passed to `capture`.
+     * @return Number of frames captured. The last one may still be over
+     * budget, or have failed.
+     */
+    int meetBudget(size_t maxBytes, const SensorSettings &start,
+                   rate_capture_t capture, void *context);
+};
+
+#endif // RATE_MODEL_H
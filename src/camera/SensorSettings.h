@@ -0,0 +1,23 @@
+#ifndef __sensor_settings_h__
+#define __sensor_settings_h__
+
+#include <esp_camera.h>
+
+/**
+ * @brief Sensor registers that differ between captures.
+ */
+struct SensorSettings {
+    framesize_t frameSize;
+    int quality; /**< JPEG quality, 0-63, lower number means higher quality */
+    bool grayscale;
+
+    bool operator==(const SensorSettings &other) const {
+        return frameSize == other.frameSize && quality == other.quality &&
+               grayscale == other.grayscale;
+    }
+    bool operator!=(const SensorSettings &other) const {
+        return !(*this == other);
+    }
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "Thumbnails.h"
+#include "Globals.h"
+#include "ImageDSP.h"
+#include <img_converters.h>
+
+ThumbnailPipeline thumbnails;
+
+/**
+ * @brief Converts a scale factor to the decoder's setting.
+ */
+static jpg_scale_t toJpgScale(int scale) {
+    switch (scale) {
+    case 2:
+        return JPG_SCALE_2X;
+    case 4:
+        return JPG_SCALE_4X;
+    case 8:
+        return JPG_SCALE_8X;
+    default:
+        return JPG_SCALE_NONE;
+    }
+}
+
+/**
+ * @brief Keeps `buffer` if it is big enough and nobody else holds it,
+ * otherwise replaces it.
+ */
+static bool reserve(std::shared_ptr<PSRAMBuffer> &buffer, size_t size) {
+    if (!buffer || buffer.use_count() > 1 || buffer->size() < size) {
+        buffer = std::make_shared<PSRAMBuffer>(size);
+    }
+    return (bool)*buffer;
+}
+
+struct DecodeTarget {
+    CameraFrame *frame;
+    uint16_t *pixels;
+    size_t capacity; /**< In pixels */
+    int width;
+    int height;
+};
+
+static size_t readJpeg(void *arg, size_t index, uint8_t *buf, size_t len) {
+    return static_cast<DecodeTarget *>(arg)->frame->read(index, buf, len);
+}
+
+static bool writePixels(void *arg, uint16_t x, uint16_t y, uint16_t w,
+                        uint16_t h, uint8_t *data) {
+    DecodeTarget *target = static_cast<DecodeTarget *>(arg);
+    if (!data) {
+        // Called with the output size before the first block and again
+        // after the last one
+        if (x == 0 && y == 0) {
+            target->width = w;
+            target->height = h;
+            return (size_t)w * h <= target->capacity;
+        }
+        return true;
+    }
+    if (x + w > target->width || y + h > target->height) {
+        return false;
+    }
+    for (uint16_t row = 0; row < h; row++) {
+        rgb888ToRgb565(data + (size_t)row * w * 3,
+                       target->pixels + (size_t)(y + row) * target->width + x,
+                       w);
+    }
+    return true;
+}
+
+struct EncodeTarget {
+    uint8_t *data;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+};
+
+static size_t writeJpeg(void *arg, size_t index, const void *data,
+                        size_t len) {
+    EncodeTarget *target = static_cast<EncodeTarget *>(arg);
+    if (index + len > target->capacity) {
+        target->overflow = true;
+        return 0;
+    }
+    memcpy(target->data + index, data, len);
+    target->length = max(target->length, index + len);
+    return len;
+}
+
+ThumbnailPipeline::ThumbnailPipeline() : m_decodes(0), m_encodes(0) {
+    for (Slot &slot : m_slots) {
+        slot = {0, 0, 0, nullptr, 0, 0, 0, nullptr};
+    }
+}
+
+ThumbnailPipeline::Slot *ThumbnailPipeline::slotFor(int scale) {
+    jpg_scale_t jpgScale = toJpgScale(scale);
+    return jpgScale == JPG_SCALE_NONE ? nullptr : &m_slots[jpgScale - 1];
+}
+
+bool ThumbnailPipeline::decode(CameraFrame &frame, Slot &slot,
+                               jpg_scale_t scale) {
+    int shift = (int)scale;
+    // Rounded up, the decoder emits partial blocks at the edges
+    size_t capacity = (size_t)((frame.width() + (1 << shift) - 1) >> shift) *
+                      ((frame.height() + (1 << shift) - 1) >> shift);
+    if (!reserve(slot.pixels, capacity * sizeof(uint16_t))) {
+        logger.println("Thumbnail buffer allocation FAILURE.");
+        return false;
+    }
+
+    DecodeTarget target = {&frame, (uint16_t *)slot.pixels->data(), capacity,
+                           0, 0};
+    slot.seq = 0;
+    slot.jpeg_seq = 0;
+    if (esp_jpg_decode(frame.length(), scale, readJpeg, writePixels,
+                       &target) != ESP_OK) {
+        logger.println("Thumbnail decoding FAILURE.");
+        return false;
+    }
+    slot.seq = frame.seq();
+    slot.width = target.width;
+    slot.height = target.height;
+    m_decodes++;
+    return true;
+}
+
+bool ThumbnailPipeline::encode(Slot &slot, int quality) {
+    size_t pixelBytes = (size_t)slot.width * slot.height * sizeof(uint16_t);
+    // A JPEG of a camera frame stays well under two bytes per pixel
+    if (!reserve(slot.jpeg, pixelBytes)) {
+        logger.println("Thumbnail buffer allocation FAILURE.");
+        return false;
+    }
+
+    EncodeTarget target = {slot.jpeg->data(), slot.jpeg->size(), 0, false};
+    slot.jpeg_seq = 0;
+    if (!fmt2jpg_cb(slot.pixels->data(), pixelBytes, slot.width, slot.height,
+                    PIXFORMAT_RGB565, quality, writeJpeg, &target) ||
+        target.overflow) {
+        logger.println("Thumbnail encoding FAILURE.");
+        return false;
+    }
+    slot.jpeg_seq = slot.seq;
+    slot.jpeg_quality = quality;
+    slot.jpeg_length = target.length;
+    m_encodes++;
+    return true;
+}
+
+bool ThumbnailPipeline::output(Slot &slot, ThumbnailFormat format,
+                               int quality, Thumbnail &thumbnail) {
+    if (format == THUMBNAIL_RGB565) {
+        thumbnail = {slot.pixels,
+                     (size_t)slot.width * slot.height * sizeof(uint16_t),
+                     slot.width, slot.height, slot.seq};
+        return true;
+    }
+    if ((slot.jpeg_seq != slot.seq || slot.jpeg_quality != quality) &&
+        !encode(slot, quality)) {
+        return false;
+    }
+    thumbnail = {slot.jpeg, slot.jpeg_length, slot.width, slot.height,
+                 slot.seq};
+    return true;
+}
+
+bool ThumbnailPipeline::cached(uint32_t seq, int scale,
+                               ThumbnailFormat format, int quality,
+                               Thumbnail &thumbnail) {
+    Slot *slot = slotFor(scale);
+    if (!slot || seq == 0 || slot->seq != seq) {
+        return false;
+    }
+    // Re-encoding at another quality only needs the decoded pixels
+    return output(*slot, format, quality, thumbnail);
+}
+
+bool ThumbnailPipeline::render(CameraFrame &frame, int scale,
+                               ThumbnailFormat format, int quality,
+                               Thumbnail &thumbnail) {
+    Slot *slot = slotFor(scale);
+    if (!slot) {
+        return false;
+    }
+    if (slot->seq != frame.seq() && !decode(frame, *slot, toJpgScale(scale))) {
+        return false;
+    }
+    return output(*slot, format, quality, thumbnail);
+}
+
+void processThumbnailRequest(AsyncWebServerRequest *request,
+                             const JsonDocument &doc) {
+    int scale = THUMBNAIL_DEFAULT_SCALE;
+    if (request->hasParam("scale")) {
+        scale = request->getParam("scale")->value().toInt();
+        if (toJpgScale(scale) == JPG_SCALE_NONE) {
+            request->send(400, "text/plain", "Scale must be 2, 4 or 8.");
+            return;
+        }
+    }
+    ThumbnailFormat format = THUMBNAIL_JPEG;
+    if (request->hasParam("format")) {
+        const String &name = request->getParam("format")->value();
+        if (name == "rgb565") {
+            format = THUMBNAIL_RGB565;
+        } else if (name != "jpeg") {
+            request->send(400, "text/plain", "Unknown thumbnail format.");
+            return;
+        }
+    }
+    int quality = THUMBNAIL_DEFAULT_QUALITY;
+    if (request->hasParam("quality")) {
+        quality = request->getParam("quality")->value().toInt();
+        quality = constrain(quality, 1, 100);
+    }
+
+    Thumbnail thumbnail;
+    if (request->hasParam("seq")) {
+        uint32_t seq = request->getParam("seq")->value().toInt();
+        if (!thumbnails.cached(seq, scale, format, quality, thumbnail)) {
+            std::shared_ptr<CameraFrame> frame = frameCache.find(seq);
+            if (!frame) {
+                request->send(404, "text/plain", "Frame no longer available.");
+                return;
+            }
+            if (!thumbnails.render(*frame, scale, format, quality,
+                                   thumbnail)) {
+                request->send(500, "text/plain", "Thumbnail failed.");
+                return;
+            }
+        }
+    } else {
+        std::shared_ptr<CameraFrame> frame = frameCache.get();
+        if (!frame) {
+            request->send(500, "text/plain", "Camera capture failed.");
+            return;
+        }
+        if (!thumbnails.render(*frame, scale, format, quality, thumbnail)) {
+            request->send(500, "text/plain", "Thumbnail failed.");
+            return;
+        }
+    }
+
+    std::shared_ptr<PSRAMBuffer> data = thumbnail.data;
+    size_t length = thumbnail.length;
+    AsyncWebServerResponse *response = request->beginResponse(
+        format == THUMBNAIL_JPEG ? "image/jpeg" : "application/octet-stream",
+        length,
+        [data, length](uint8_t *buffer, size_t maxLen,
+                       size_t index) mutable -> size_t {
+            size_t len = min(length - index, maxLen);
+            memcpy(buffer, data->data() + index, len);
+            if (len + index == length) {
+                data.reset();
+            }
+            return len;
+        });
+    response->addHeader("X-Frame-Seq", String(thumbnail.seq));
+    response->addHeader("X-Width", String(thumbnail.width));
+    response->addHeader("X-Height", String(thumbnail.height));
+    if (format == THUMBNAIL_RGB565) {
+        response->addHeader("X-Pixel-Format", "RGB565BE");
+    }
+    request->send(response);
+}
@@ -0,0 +1,125 @@
+#ifndef __thumbnails_h__
+#define __thumbnails_h__
+
+#include "FrameCache.h"
+#include "audio/PSRAMBuffer.h"
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <esp_jpg_decode.h>
+#include <memory>
+
+/**
+ * @brief Downscaling factor used when the request does not ask for one.
+ */
+#define THUMBNAIL_DEFAULT_SCALE 8
+
+/**
+ * @brief Quality of re-encoded thumbnails, 1-100, higher is better.
+ */
+#define THUMBNAIL_DEFAULT_QUALITY 80
+
+enum ThumbnailFormat { THUMBNAIL_JPEG, THUMBNAIL_RGB565 };
+
+/**
+ * @brief A rendered thumbnail. Holding it keeps its buffer from being reused
+ * for the next frame.
+ */
+struct Thumbnail {
+    std::shared_ptr<PSRAMBuffer> data;
+    size_t length;
+    int width;
+    int height;
+    uint32_t seq; /**< Of the frame it was made from */
+};
+
+/**
+ * @class ThumbnailPipeline
+ * @brief Makes 1/2, 1/4 and 1/8 scale copies of a captured JPEG without
+ * another exposure.
+ *
+ * The decoder scales in the DCT domain, so a 1/8 thumbnail only runs the DC
+ * coefficient of each block through the inverse transform. The decoded
+ * pixels are kept as big-endian RGB565 and re-encoded to JPEG on demand.
+ *
+ * Each scale has one PSRAM buffer for pixels and one for JPEG data, kept
+ * between frames together with the frame sequence number they belong to, so
+ * repeated requests for the same frame are served from them. A buffer is
+ * only replaced when a response is still sending it.
+ *
+ * Not thread safe, it is only used from the web server task.
+ */
+class ThumbnailPipeline {
+  private:
+    struct Slot {
+        uint32_t seq; /**< Frame decoded into `pixels`, 0 if none */
+        int width;
+        int height;
+        std::shared_ptr<PSRAMBuffer> pixels;
+        uint32_t jpeg_seq; /**< Frame encoded into `jpeg`, 0 if none */
+        int jpeg_quality;
+        size_t jpeg_length;
+        std::shared_ptr<PSRAMBuffer> jpeg;
+    };
+
+    Slot m_slots[JPG_SCALE_MAX];
+    uint32_t m_decodes;
+    uint32_t m_encodes;
+
+    Slot *slotFor(int scale);
+    bool decode(CameraFrame &frame, Slot &slot, jpg_scale_t scale);
+    bool encode(Slot &slot, int quality);
+    bool output(Slot &slot, ThumbnailFormat format, int quality,
+                Thumbnail &thumbnail);
+
+  public:
+    ThumbnailPipeline();
+
+    /**
+     * @brief Returns a thumbnail of frame `seq` that has already been made.
+     *
+     * @return `false` if there is none.
+     */
+    bool cached(uint32_t seq, int scale, ThumbnailFormat format, int quality,
+                Thumbnail &thumbnail);
+
+    /**
+     * @brief Makes a thumbnail of `frame`, reusing earlier work on the same
+     * frame.
+     *
+     * @param frame JPEG frame to scale down.
+     * @param scale 2, 4 or 8.
+     * @param format Pixel data or JPEG.
+     * @param quality JPEG quality, 1-100.
+     * @param thumbnail Set to the result.
+     * @return `false` if the scale is not supported, a buffer could not be
+     * allocated or the frame could not be decoded.
+     */
+    bool render(CameraFrame &frame, int scale, ThumbnailFormat format,
+                int quality, Thumbnail &thumbnail);
+
+    uint32_t decodes() { return m_decodes; }
+    uint32_t encodes() { return m_encodes; }
+};
+
+/**
+ * @brief Global thumbnail pipeline used by `/capture/thumb`.
+ */
+extern ThumbnailPipeline thumbnails;
+
+/**
+ * @brief Serves a scaled down copy of a camera frame.
+ *
+ * Query parameters: `scale` (2, 4 or 8, default 8), `format` (`jpeg`, the
+ * default, or `rgb565` for raw big-endian pixels with the size in `X-Width`
+ * and `X-Height`) and `quality` for the JPEG. With `seq` the thumbnail is
+ * made from that frame, answering 404 once it is neither cached nor held,
+ * so a client fetching it together with `/capture` gets the same exposure.
+ * Without it the latest frame is used, shared through `frameCache`.
+ *
+ * @param request Pointer to the AsyncWebServerRequest object.
+ * @param doc Reference to the JsonDocument containing request data (unused).
+ */
+void processThumbnailRequest(AsyncWebServerRequest *request,
+                             const JsonDocument &doc);
+
+#endif
@@ -0,0 +1,384 @@
+#include "TinyCNN.h"
+#include <algorithm>
+#include <string.h>
+
+#if defined(ARDUINO)
+#include <sdkconfig.h>
+#endif
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+#define TINY_CNN_USE_PIE 1
+#else
+#define TINY_CNN_USE_PIE 0
+#endif
+
+static inline size_t alignUp(size_t size) {
+    return (size + TINY_CNN_ALIGNMENT - 1) & ~(size_t)(TINY_CNN_ALIGNMENT - 1);
+}
+
+static inline int8_t saturate(int32_t value, int32_t low) {
+    return (int8_t)(value < low ? low : value > 127 ? 127 : value);
+}
+
+#if TINY_CNN_USE_PIE
+/**
+ * Multiplies 16 pairs of int8 per iteration into the 40-bit ACCX
+ * accumulator. Rows are short enough that the sum always fits 32 bits.
+ */
+static int32_t dotProductPIE(const int8_t *a, const int8_t *b,
+                             size_t blocks) {
+    int32_t result;
+    const int shift = 0;
+    asm volatile("ee.zero.accx\n"
+                 "loopnez %3, 1f\n"
+                 "ee.vld.128.ip q0, %1, 16\n"
+                 "ee.vld.128.ip q1, %2, 16\n"
+                 "ee.vmulas.s8.accx q0, q1\n"
+                 "1:\n"
+                 "ee.srs.accx %0, %4, 0\n"
+                 : "=r"(result), "+r"(a), "+r"(b)
+                 : "r"(blocks), "r"(shift)
+                 : "memory");
+    return result;
+}
+#endif
+
+/**
+ * Both buffers are aligned and `count` is a multiple of the alignment, the
+ * model and the arena are laid out so that this always holds.
+ */
+static int32_t dotProduct(const int8_t *a, const int8_t *b, size_t count) {
+#if TINY_CNN_USE_PIE
+    return dotProductPIE(a, b, count / TINY_CNN_ALIGNMENT);
+#else
+    int32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+/**
+ * `value * multiplier / 2^31 * 2^shift` with the rounding of the TensorFlow
+ * Lite reference kernels, so outputs match the converter bit for bit.
+ */
+static int32_t rescale(int32_t value, int32_t multiplier, int32_t shift) {
+    int left = shift > 0 ? shift : 0;
+    int right = shift > 0 ? 0 : -shift;
+    int32_t shifted = (int32_t)((uint32_t)value << left);
+    if (shifted == INT32_MIN && multiplier == INT32_MIN) {
+        return INT32_MAX;
+    }
+    int64_t product = (int64_t)shifted * multiplier;
+    int64_t nudge = product >= 0 ? (1ll << 30) : 1 - (1ll << 30);
+    int32_t high = (int32_t)((product + nudge) / (1ll << 31));
+    if (right == 0) {
+        return high;
+    }
+    int32_t mask = (int32_t)((1u << right) - 1);
+    int32_t remainder = high & mask;
+    int32_t threshold = (mask >> 1) + (high < 0 ? 1 : 0);
+    return (high >> right) + (remainder > threshold ? 1 : 0);
+}
+
+TinyCNN::TinyCNN() : m_header(nullptr), m_tensor_size(0), m_scratch_size(0) {}
+
+bool TinyCNN::load(const uint8_t *model, size_t size) {
+    m_header = nullptr;
+    m_layers.clear();
+    const TinyCNNHeader *header = (const TinyCNNHeader *)model;
+    if (size < sizeof(TinyCNNHeader) ||
+        ((uintptr_t)model & (TINY_CNN_ALIGNMENT - 1)) != 0 ||
+        memcmp(header->magic, TINY_CNN_MAGIC, 4) != 0 ||
+        header->version != TINY_CNN_VERSION || header->layers == 0 ||
+        header->width == 0 || header->height == 0 || header->channels == 0) {
+        return false;
+    }
+
+    Shape shape = {header->height, header->width, header->channels};
+    int8_t zeroPoint = header->inputZeroPoint;
+    m_tensor_size = alignUp((size_t)shape.height * shape.width *
+                            shape.channels);
+    m_scratch_size = 0;
+    size_t offset = alignUp(sizeof(TinyCNNHeader));
+    for (int i = 0; i < header->layers; i++) {
+        if (offset + sizeof(TinyCNNLayerHeader) > size) {
+            return false;
+        }
+        const TinyCNNLayerHeader *layer =
+            (const TinyCNNLayerHeader *)(model + offset);
+        offset += alignUp(sizeof(TinyCNNLayerHeader));
+        if (layer->dataSize > size - offset ||
+            !addLayer(layer, model + offset, shape, zeroPoint)) {
+            return false;
+        }
+        offset += layer->dataSize;
+        shape = m_layers.back().output;
+        zeroPoint = layer->zeroPoint;
+        m_tensor_size = std::max(
+            m_tensor_size,
+            alignUp((size_t)shape.height * shape.width * shape.channels));
+    }
+    if (shape.height != 1 || shape.width != 1 ||
+        zeroPoint != header->outputZeroPoint) {
+        m_layers.clear();
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+bool TinyCNN::addLayer(const TinyCNNLayerHeader *header, const uint8_t *data,
+                       const Shape &input, int8_t inputZeroPoint) {
+    Layer layer;
+    layer.header = header;
+    layer.input = input;
+    layer.padTop = 0;
+    layer.padLeft = 0;
+    layer.rowLength = 0;
+    layer.weights = nullptr;
+    layer.multipliers = nullptr;
+    layer.shifts = nullptr;
+    layer.inputZeroPoint = inputZeroPoint;
+    int kernel = header->kernel;
+    int stride = header->stride;
+
+    switch (header->type) {
+    case TINY_CNN_CONV2D:
+    case TINY_CNN_MAX_POOL:
+        if (kernel == 0 || stride == 0) {
+            return false;
+        }
+        if (header->flags & TINY_CNN_PADDING_SAME) {
+            layer.output.height = (input.height + stride - 1) / stride;
+            layer.output.width = (input.width + stride - 1) / stride;
+            int padHeight = std::max(
+                (layer.output.height - 1) * stride + kernel - input.height,
+                0);
+            int padWidth = std::max(
+                (layer.output.width - 1) * stride + kernel - input.width, 0);
+            layer.padTop = padHeight / 2;
+            layer.padLeft = padWidth / 2;
+        } else {
+            if (input.height < kernel || input.width < kernel) {
+                return false;
+            }
+            layer.output.height = (input.height - kernel) / stride + 1;
+            layer.output.width = (input.width - kernel) / stride + 1;
+        }
+        layer.output.channels = header->type == TINY_CNN_CONV2D
+                                    ? header->channels
+                                    : input.channels;
+        break;
+    case TINY_CNN_AVERAGE_POOL:
+        layer.output = {1, 1, input.channels};
+        break;
+    case TINY_CNN_DENSE:
+        layer.output = {1, 1, header->channels};
+        break;
+    default:
+        return false;
+    }
+
+    if (header->type == TINY_CNN_MAX_POOL ||
+        header->type == TINY_CNN_AVERAGE_POOL) {
+        // Pooling keeps the quantization of its input
+        if (header->channels != input.channels ||
+            header->zeroPoint != inputZeroPoint || header->dataSize != 0) {
+            return false;
+        }
+        m_layers.push_back(std::move(layer));
+        return true;
+    }
+
+    int channels = layer.output.channels;
+    int inputLength = header->type == TINY_CNN_CONV2D
+                          ? kernel * kernel * input.channels
+                          : input.height * input.width * input.channels;
+    layer.rowLength = alignUp(inputLength);
+    size_t weightsSize = (size_t)layer.rowLength * channels;
+    size_t arraySize = alignUp((size_t)channels * sizeof(int32_t));
+    if (channels == 0 || header->dataSize != weightsSize + 3 * arraySize) {
+        return false;
+    }
+    layer.weights = (const int8_t *)data;
+    const int32_t *bias = (const int32_t *)(data + weightsSize);
+    layer.multipliers = (const int32_t *)(data + weightsSize + arraySize);
+    layer.shifts = (const int32_t *)(data + weightsSize + 2 * arraySize);
+
+    // sum((x - zp) * w) = sum(x * w) - zp * sum(w), the second term is the
+    // same for every input so it goes into the bias
+    layer.bias.resize(channels);
+    for (int channel = 0; channel < channels; channel++) {
+        const int8_t *row = layer.weights + (size_t)channel * layer.rowLength;
+        int32_t sum = 0;
+        for (int i = 0; i < inputLength; i++) {
+            sum += row[i];
+        }
+        layer.bias[channel] = bias[channel] - inputZeroPoint * sum;
+    }
+    if (header->type == TINY_CNN_CONV2D) {
+        m_scratch_size = std::max(m_scratch_size, (size_t)layer.rowLength);
+    }
+    m_layers.push_back(std::move(layer));
+    return true;
+}
+
+uint32_t TinyCNN::macCount() {
+    uint32_t count = 0;
+    for (const Layer &layer : m_layers) {
+        if (layer.weights) {
+            count += (uint32_t)layer.output.height * layer.output.width *
+                     layer.output.channels * layer.rowLength;
+        }
+    }
+    return count;
+}
+
+void TinyCNN::invoke(const uint8_t *pixels, void *arena, int8_t *outputs) {
+    int8_t *current = (int8_t *)arena;
+    int8_t *next = current + m_tensor_size;
+    int8_t *scratch = next + m_tensor_size;
+
+    // With a scale of 1/255 a gray level quantizes to itself plus the zero
+    // point
+    size_t inputSize = (size_t)m_header->width * m_header->height *
+                       m_header->channels;
+    for (size_t i = 0; i < inputSize; i++) {
+        current[i] = saturate(pixels[i] + m_header->inputZeroPoint, -128);
+    }
+    // Dense layers read the whole padded tensor against zero weights
+    memset(current + inputSize, 0, m_tensor_size - inputSize);
+
+    for (const Layer &layer : m_layers) {
+        switch (layer.header->type) {
+        case TINY_CNN_CONV2D:
+            runConv(layer, current, next, scratch);
+            break;
+        case TINY_CNN_MAX_POOL:
+            runMaxPool(layer, current, next);
+            break;
+        case TINY_CNN_AVERAGE_POOL:
+            runAveragePool(layer, current, next);
+            break;
+        case TINY_CNN_DENSE:
+            runDense(layer, current, next);
+            break;
+        }
+        int8_t *swap = current;
+        current = next;
+        next = swap;
+    }
+    memcpy(outputs, current, outputCount());
+}
+
+void TinyCNN::runConv(const Layer &layer, const int8_t *input,
+                      int8_t *output, int8_t *scratch) {
+    const TinyCNNLayerHeader *header = layer.header;
+    int kernel = header->kernel;
+    int inputChannels = layer.input.channels;
+    size_t pixelSize = inputChannels;
+    int32_t zeroPoint = header->zeroPoint;
+    int32_t low = header->flags & TINY_CNN_RELU ? zeroPoint : -128;
+    int inputLength = kernel * kernel * inputChannels;
+    memset(scratch + inputLength, 0, layer.rowLength - inputLength);
+
+    for (int outY = 0; outY < layer.output.height; outY++) {
+        for (int outX = 0; outX < layer.output.width; outX++) {
+            // Gather the patch, outside the input is the zero point
+            int top = outY * header->stride - layer.padTop;
+            int left = outX * header->stride - layer.padLeft;
+            int8_t *patch = scratch;
+            for (int y = top; y < top + kernel; y++) {
+                bool rowInside = y >= 0 && y < layer.input.height;
+                for (int x = left; x < left + kernel; x++) {
+                    if (rowInside && x >= 0 && x < layer.input.width) {
+                        memcpy(patch,
+                               input + ((size_t)y * layer.input.width + x) *
+                                           pixelSize,
+                               pixelSize);
+                    } else {
+                        memset(patch, layer.inputZeroPoint, pixelSize);
+                    }
+                    patch += pixelSize;
+                }
+            }
+
+            const int8_t *weights = layer.weights;
+            for (int channel = 0; channel < layer.output.channels;
+                 channel++, weights += layer.rowLength) {
+                int32_t sum = dotProduct(scratch, weights, layer.rowLength) +
+                              layer.bias[channel];
+                sum = rescale(sum, layer.multipliers[channel],
+                              layer.shifts[channel]);
+                *output++ = saturate(sum + zeroPoint, low);
+            }
+        }
+    }
+    size_t written = (size_t)layer.output.height * layer.output.width *
+                     layer.output.channels;
+    memset(output, 0, m_tensor_size - written);
+}
+
+void TinyCNN::runMaxPool(const Layer &layer, const int8_t *input,
+                         int8_t *output) {
+    const TinyCNNLayerHeader *header = layer.header;
+    int channels = layer.input.channels;
+    for (int outY = 0; outY < layer.output.height; outY++) {
+        int top = outY * header->stride - layer.padTop;
+        int bottom = std::min(top + header->kernel, layer.input.height);
+        top = std::max(top, 0);
+        for (int outX = 0; outX < layer.output.width; outX++) {
+            int left = outX * header->stride - layer.padLeft;
+            int right = std::min(left + header->kernel, layer.input.width);
+            left = std::max(left, 0);
+            for (int channel = 0; channel < channels; channel++) {
+                int8_t best = -128;
+                for (int y = top; y < bottom; y++) {
+                    const int8_t *row =
+                        input + (size_t)y * layer.input.width * channels;
+                    for (int x = left; x < right; x++) {
+                        best = std::max(best, row[x * channels + channel]);
+                    }
+                }
+                *output++ = best;
+            }
+        }
+    }
+    size_t written = (size_t)layer.output.height * layer.output.width *
+                     channels;
+    memset(output, 0, m_tensor_size - written);
+}
+
+void TinyCNN::runAveragePool(const Layer &layer, const int8_t *input,
+                             int8_t *output) {
+    int channels = layer.input.channels;
+    int32_t count = layer.input.height * layer.input.width;
+    for (int channel = 0; channel < channels; channel++) {
+        int32_t sum = 0;
+        for (int32_t i = 0; i < count; i++) {
+            sum += input[(size_t)i * channels + channel];
+        }
+        // Rounded half away from zero
+        sum = sum >= 0 ? (sum + count / 2) / count : (sum - count / 2) / count;
+        output[channel] = saturate(sum, -128);
+    }
+    memset(output + channels, 0, m_tensor_size - channels);
+}
+
+void TinyCNN::runDense(const Layer &layer, const int8_t *input,
+                       int8_t *output) {
+    int32_t zeroPoint = layer.header->zeroPoint;
+    int32_t low = layer.header->flags & TINY_CNN_RELU ? zeroPoint : -128;
+    const int8_t *weights = layer.weights;
+    int channels = layer.output.channels;
+    for (int channel = 0; channel < channels;
+         channel++, weights += layer.rowLength) {
+        int32_t sum = dotProduct(input, weights, layer.rowLength) +
+                      layer.bias[channel];
+        sum = rescale(sum, layer.multipliers[channel], layer.shifts[channel]);
+        output[channel] = saturate(sum + zeroPoint, low);
+    }
+    memset(output + channels, 0, m_tensor_size - channels);
+}
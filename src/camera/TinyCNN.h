@@ -0,0 +1,183 @@
+#ifndef TINY_CNN_H
+#define TINY_CNN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @file TinyCNN.h
+ * @brief Interpreter for small int8 convolutional networks.
+ *
+ * Like the image and audio kernels it only depends on the C and C++
+ * standard libraries, so the same code can be run on a host machine and
+ * checked against the outputs of the reference implementation in
+ * tools/pack_presence_model.py. On the ESP32-S3 the dot products use the
+ * PIE vector instructions, 16 multiply-accumulates per instruction.
+ *
+ * Quantization follows the TensorFlow Lite int8 scheme: activations are
+ * asymmetric with a zero point per tensor, weights are symmetric per output
+ * channel, biases are int32 and every layer output is rescaled by a Q31
+ * multiplier and a power of two shift.
+ */
+
+/**
+ * @brief Alignment of the model and of the arena, which lets every dot
+ * product take the vector path.
+ */
+#define TINY_CNN_ALIGNMENT 16
+
+/**
+ * @brief Magic and version at the start of a model file.
+ */
+#define TINY_CNN_MAGIC "BOBN"
+#define TINY_CNN_VERSION 1
+
+/**
+ * @brief Layout of a model file, every integer little-endian.
+ *
+ * The file starts with a `TinyCNNHeader`, followed by `layers` records, each
+ * a `TinyCNNLayerHeader` and `dataSize` bytes of parameters. Every record
+ * and every array in it starts on a `TINY_CNN_ALIGNMENT` boundary.
+ *
+ * Parameters of convolution and dense layers are, in order:
+ * - int8 weights, one row per output channel in (y, x, input channel)
+ *   order, each row zero padded to a multiple of `TINY_CNN_ALIGNMENT`;
+ * - int32 bias, Q31 multiplier and shift per output channel, each array
+ *   zero padded to a multiple of `TINY_CNN_ALIGNMENT` bytes.
+ */
+struct TinyCNNHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t layers;
+    uint16_t width;  /**< Of the input */
+    uint16_t height; /**< Of the input */
+    uint16_t channels; /**< Of the input */
+    int8_t inputZeroPoint;  /**< Input scale is 1/255 */
+    int8_t outputZeroPoint;
+    float outputScale;
+};
+
+enum TinyCNNLayerType : uint8_t {
+    TINY_CNN_CONV2D = 1,
+    TINY_CNN_MAX_POOL = 2,
+    TINY_CNN_AVERAGE_POOL = 3, /**< Over the whole input */
+    TINY_CNN_DENSE = 4
+};
+
+enum TinyCNNLayerFlags : uint8_t {
+    TINY_CNN_PADDING_SAME = 1, /**< Otherwise valid */
+    TINY_CNN_RELU = 2
+};
+
+struct TinyCNNLayerHeader {
+    uint8_t type;
+    uint8_t kernel;
+    uint8_t stride;
+    uint8_t flags;
+    uint16_t channels; /**< Of the output */
+    int8_t zeroPoint;  /**< Of the output */
+    uint8_t reserved;
+    uint32_t dataSize; /**< Bytes of parameters after this header */
+    uint32_t reserved2;
+};
+
+/**
+ * @class TinyCNN
+ * @brief Runs a model file over one input at a time.
+ *
+ * All memory is owned by the caller: the model stays where it was loaded
+ * from, and activations live in an arena of `arenaSize` bytes passed to
+ * every call, so the interpreter itself allocates nothing per inference.
+ */
+class TinyCNN {
+  private:
+    struct Shape {
+        int height;
+        int width;
+        int channels;
+    };
+
+    struct Layer {
+        const TinyCNNLayerHeader *header;
+        Shape input;
+        Shape output;
+        int padTop;
+        int padLeft;
+        int rowLength; /**< Padded weights per output channel */
+        const int8_t *weights;
+        const int32_t *multipliers;
+        const int32_t *shifts;
+        std::vector<int32_t> bias; /**< With the input zero point folded in */
+        int8_t inputZeroPoint;
+    };
+
+    const TinyCNNHeader *m_header;
+    std::vector<Layer> m_layers;
+    size_t m_tensor_size; /**< Largest activation tensor, padded */
+    size_t m_scratch_size;
+
+    bool addLayer(const TinyCNNLayerHeader *header, const uint8_t *data,
+                  const Shape &input, int8_t inputZeroPoint);
+    void runConv(const Layer &layer, const int8_t *input, int8_t *output,
+                 int8_t *scratch);
+    void runMaxPool(const Layer &layer, const int8_t *input, int8_t *output);
+    void runAveragePool(const Layer &layer, const int8_t *input,
+                        int8_t *output);
+    void runDense(const Layer &layer, const int8_t *input, int8_t *output);
+
+  public:
+    TinyCNN();
+
+    /**
+     * @brief Checks a model file and prepares the layers.
+     *
+     * @param model Model file, `TINY_CNN_ALIGNMENT` aligned. It must outlive
+     * this object, the weights are used in place.
+     * @param size  Length of the file.
+     * @return `false` if the file is malformed or the last layer does not
+     * produce a 1x1 output.
+     */
+    bool load(const uint8_t *model, size_t size);
+
+    bool isLoaded() { return m_header != nullptr; }
+
+    int inputWidth() { return m_header->width; }
+    int inputHeight() { return m_header->height; }
+    int inputChannels() { return m_header->channels; }
+
+    /**
+     * @brief Number of values the model outputs.
+     */
+    int outputCount() { return m_layers.back().output.channels; }
+
+    /**
+     * @brief Bytes of working memory `invoke` needs.
+     */
+    size_t arenaSize() { return 2 * m_tensor_size + m_scratch_size; }
+
+    /**
+     * @brief Multiply-accumulates of one inference.
+     */
+    uint32_t macCount();
+
+    /**
+     * @brief Runs the model.
+     *
+     * @param pixels  Input, `inputWidth * inputHeight * inputChannels`
+     * 8-bit values in row order.
+     * @param arena   Working memory, `arenaSize` bytes,
+     * `TINY_CNN_ALIGNMENT` aligned.
+     * @param outputs Destination, `outputCount` quantized values.
+     */
+    void invoke(const uint8_t *pixels, void *arena, int8_t *outputs);
+
+    /**
+     * @brief Converts a quantized output back to a real value.
+     */
+    float dequantize(int8_t value) {
+        return m_header->outputScale * (value - m_header->outputZeroPoint);
+    }
+};
+
+#endif // TINY_CNN_H
@@ -8,8 +8,13 @@
 #include "Servos.h"
 #include "Startup.h"
 #include "audio/AudioFile.h"
+#include "audio/AudioSocket.h"
 #include "audio/ProcessAudio.h"
 #include "audio/WAVFileReader.h"
+#include "camera/CameraStream.h"
+#include "camera/ChangeDetector.h"
+#include "camera/PresenceDetector.h"
+#include "camera/Thumbnails.h"
 #include "utils/HealthCheck.h"
 #include <ESPAsyncWebServer.h>
 #include <FileList.h>
@@ -29,9 +34,29 @@ void setup() {
     server.on("/file-list", HTTP_GET, [](AsyncWebServerRequest *request) {
         handleRequest(request, nullptr, 0, 0, 0, processFileListRequest);
     });
+    // Before "/capture", which would also match its subpaths
+    server.on("/capture/thumb", HTTP_GET,
+              [](AsyncWebServerRequest *request) {
+                  handleRequest(request, nullptr, 0, 0, 0,
+                                processThumbnailRequest);
+              });
     server.on("/capture", HTTP_GET, [](AsyncWebServerRequest *request) {
         handleRequest(request, nullptr, 0, 0, 0, processCaptureRequest);
     });
+    server.on("/change", HTTP_GET, [](AsyncWebServerRequest *request) {
+        handleRequest(request, nullptr, 0, 0, 0, processChangeRequest);
+    });
+    // Before "/presence", which would also match its subpaths
+    initializePresenceEvents();
+    server.on("/presence", HTTP_GET, [](AsyncWebServerRequest *request) {
+        handleRequest(request, nullptr, 0, 0, 0, processPresenceRequest);
+    });
+    server.on("/stream", HTTP_GET, [](AsyncWebServerRequest *request) {
+        handleRequest(request, nullptr, 0, 0, 0, processStreamRequest);
+    });
+    server.on("/audio/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        handleRequest(request, nullptr, 0, 0, 0, processAudioStatsRequest);
+    });
     server.on(
         "/rotate", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL,
         [](AsyncWebServerRequest *request, uint8_t *data, size_t len,
@@ -46,6 +71,24 @@ void setup() {
             handleRequest(request, data, len, index, total, processMoveRequest);
         });
 
+    // Before "/audio", which would also match these subpaths
+    server.on(
+        "/audio/play", HTTP_POST, [](AsyncWebServerRequest *request) {}, NULL,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len,
+           size_t index, size_t total) {
+            handleRequest(request, data, len, index, total,
+                          processPlayClipRequest);
+        });
+
+    server.on(
+        "/audio/settings", HTTP_POST, [](AsyncWebServerRequest *request) {},
+        NULL,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len,
+           size_t index, size_t total) {
+            handleRequest(request, data, len, index, total,
+                          processAudioSettingsRequest);
+        });
+
     server.on(
         "/audio", HTTP_POST,
         [](AsyncWebServerRequest *request) {
@@ -65,10 +108,15 @@ void setup() {
                           processStopAudioRequest);
         });
 
+    initializeAudioSocket();
+
     initializeStartup();
     // playAudioFile("/sample_music.wav");
     // playAudioFile("/sample_voice.wav");
     // playAudioFile("/uploaded_audio.wav");
 }
 
-void loop() {}
+void loop() {
+    cleanupAudioSocket();
+    delay(1000);
+}
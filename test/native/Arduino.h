@@ -0,0 +1,55 @@
+#ifndef __native_arduino_h__
+#define __native_arduino_h__
+
+/**
+ * @file Arduino.h
+ * @brief The few Arduino and ESP-IDF calls the audio classes make, so they
+ * can be built on the host for the unit tests (`pio test -e native`).
+ */
+
+#include <algorithm>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high)                                              \
+    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void *ps_malloc(size_t size) { return malloc(size); }
+
+inline void *heap_caps_aligned_alloc(size_t alignment, size_t size,
+                                     uint32_t caps) {
+    (void)caps;
+    // aligned_alloc wants a whole number of alignments
+    return aligned_alloc(alignment,
+                         (size + alignment - 1) / alignment * alignment);
+}
+
+inline void heap_caps_free(void *ptr) { free(ptr); }
+
+/**
+ * @brief Serial port, messages go to stderr.
+ */
+struct NativeSerial {
+    void println(const char *message) { fprintf(stderr, "%s\n", message); }
+
+    void printf(const char *format, ...) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+};
+
+inline NativeSerial Serial;
+
+#endif
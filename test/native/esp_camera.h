@@ -0,0 +1,51 @@
+#ifndef __native_esp_camera_h__
+#define __native_esp_camera_h__
+
+/**
+ * @file esp_camera.h
+ * @brief Frame sizes of the camera driver for the host build, which has no
+ * camera: only the types and the resolution table the sensor models use.
+ */
+
+#include <stdint.h>
+
+typedef enum {
+    FRAMESIZE_96X96,
+    FRAMESIZE_QQVGA,
+    FRAMESIZE_QCIF,
+    FRAMESIZE_HQVGA,
+    FRAMESIZE_240X240,
+    FRAMESIZE_QVGA,
+    FRAMESIZE_CIF,
+    FRAMESIZE_HVGA,
+    FRAMESIZE_VGA,
+    FRAMESIZE_SVGA,
+    FRAMESIZE_XGA,
+    FRAMESIZE_HD,
+    FRAMESIZE_SXGA,
+    FRAMESIZE_UXGA,
+    FRAMESIZE_FHD,
+    FRAMESIZE_P_HD,
+    FRAMESIZE_P_3MP,
+    FRAMESIZE_QXGA,
+    FRAMESIZE_QHD,
+    FRAMESIZE_WQXGA,
+    FRAMESIZE_P_FHD,
+    FRAMESIZE_QSXGA,
+    FRAMESIZE_INVALID
+} framesize_t;
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+} resolution_info_t;
+
+inline const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {96, 96},     {160, 120},   {176, 144},   {240, 176},  {240, 240},
+    {320, 240},   {400, 296},   {480, 320},   {640, 480},  {800, 600},
+    {1024, 768},  {1280, 720},  {1280, 1024}, {1600, 1200}, {1920, 1080},
+    {720, 1280},  {864, 1536},  {2048, 1536}, {2560, 1440}, {2560, 1600},
+    {1080, 1920}, {2560, 1920},
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __native_esp_partition_h__
+#define __native_esp_partition_h__
+
+/**
+ * @file esp_partition.h
+ * @brief Partition API for the host build, which has no flash: every
+ * lookup misses.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_NOT_FOUND 0x105
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef enum { ESP_PARTITION_SUBTYPE_ANY = 0xff } esp_partition_subtype_t;
+
+typedef enum {
+    ESP_PARTITION_MMAP_DATA,
+    ESP_PARTITION_MMAP_INST
+} esp_partition_mmap_memory_t;
+
+typedef uint32_t spi_flash_mmap_handle_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+inline const esp_partition_t *
+esp_partition_find_first(esp_partition_type_t type,
+                         esp_partition_subtype_t subtype, const char *label) {
+    (void)type;
+    (void)subtype;
+    (void)label;
+    return nullptr;
+}
+
+inline esp_err_t esp_partition_mmap(const esp_partition_t *partition,
+                                    size_t offset, size_t size,
+                                    esp_partition_mmap_memory_t memory,
+                                    const void **out_ptr,
+                                    spi_flash_mmap_handle_t *out_handle) {
+    (void)partition;
+    (void)offset;
+    (void)size;
+    (void)memory;
+    (void)out_ptr;
+    (void)out_handle;
+    return ESP_ERR_NOT_FOUND;
+}
+
+inline void esp_partition_munmap(spi_flash_mmap_handle_t handle) {
+    (void)handle;
+}
+
+#endif
@@ -0,0 +1,345 @@
+#include "audio/AudioDSP.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+#define MAX_SAMPLES 64
+
+alignas(AUDIO_DSP_ALIGNMENT) static int16_t mono[MAX_SAMPLES];
+alignas(AUDIO_DSP_ALIGNMENT) static int16_t stereo[2 * MAX_SAMPLES + 8];
+
+void setUp() {
+    for (int i = 0; i < MAX_SAMPLES; i++) {
+        mono[i] = (int16_t)(i * 1031 - 32768);
+    }
+    memset(stereo, 0x55, sizeof(stereo));
+}
+
+void tearDown() {}
+
+static void checkExpanded(const int16_t *expected, const int16_t *frames,
+                          size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_INT16(expected[i], frames[2 * i]);
+        TEST_ASSERT_EQUAL_INT16(expected[i], frames[2 * i + 1]);
+    }
+}
+
+void test_expand_duplicates_every_sample() {
+    // Counts around the vector width, aligned and not
+    for (size_t count = 0; count <= 33; count++) {
+        for (size_t offset = 0; offset < 2; offset++) {
+            setUp();
+            expandMonoToStereo(mono + offset, stereo + 2 * offset, count);
+            checkExpanded(mono + offset, stereo + 2 * offset, count);
+        }
+    }
+}
+
+void test_expand_leaves_the_rest_alone() {
+    expandMonoToStereo(mono, stereo, 5);
+    TEST_ASSERT_EQUAL_INT16(0x5555, stereo[10]);
+}
+
+void test_expand_in_place() {
+    for (size_t count = 1; count <= MAX_SAMPLES; count++) {
+        // Samples read into the upper half of the frame buffer
+        memcpy(stereo + count, mono, count * sizeof(int16_t));
+        expandMonoToStereo(stereo + count, stereo, count);
+        checkExpanded(mono, stereo, count);
+    }
+}
+
+void test_mix_saturates_instead_of_wrapping() {
+    int16_t loud[] = {30000, -30000, 20000, -20000, 100};
+    int16_t other[] = {30000, -30000, 20000, -20000, -50};
+    const int16_t *sources[] = {loud, other};
+    int16_t gains[] = {AUDIO_DSP_UNITY_GAIN, AUDIO_DSP_UNITY_GAIN};
+    int16_t output[5];
+    mixSaturate(sources, gains, 2, output, 5);
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, output[0]);
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, output[1]);
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, output[2]);
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, output[3]);
+    TEST_ASSERT_INT_WITHIN(1, 50, output[4]);
+}
+
+void test_mix_many_full_scale_sources() {
+    // Six full-scale sources would wrap a 16-bit sum several times over
+    int16_t samples[8];
+    for (int i = 0; i < 8; i++) {
+        samples[i] = i % 2 ? INT16_MIN : INT16_MAX;
+    }
+    const int16_t *sources[6];
+    int16_t gains[6];
+    for (int i = 0; i < 6; i++) {
+        sources[i] = samples;
+        gains[i] = AUDIO_DSP_UNITY_GAIN;
+    }
+    int16_t output[8];
+    mixSaturate(sources, gains, 6, output, 8);
+    for (int i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_INT16(samples[i], output[i]);
+    }
+}
+
+void test_mix_applies_gains() {
+    int16_t first[] = {16384, -16384, 1000};
+    int16_t second[] = {8192, 8192, -1000};
+    const int16_t *sources[] = {first, second};
+    int16_t gains[] = {16384, 8192}; // 1/2 and 1/4
+    int16_t output[3];
+    mixSaturate(sources, gains, 2, output, 3);
+    TEST_ASSERT_INT_WITHIN(1, 8192 + 2048, output[0]);
+    TEST_ASSERT_INT_WITHIN(1, -8192 + 2048, output[1]);
+    TEST_ASSERT_INT_WITHIN(1, 500 - 250, output[2]);
+}
+
+void test_mix_in_place() {
+    int16_t base[] = {20000, -20000, 0, 32767};
+    int16_t extra[] = {20000, 10000, -5, 100};
+    const int16_t *sources[] = {base, extra};
+    int16_t gains[] = {AUDIO_DSP_UNITY_GAIN, AUDIO_DSP_UNITY_GAIN};
+    mixSaturate(sources, gains, 2, base, 4);
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, base[0]);
+    TEST_ASSERT_INT_WITHIN(1, -10000, base[1]);
+    TEST_ASSERT_INT_WITHIN(1, -5, base[2]);
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, base[3]);
+}
+
+/**
+ * @brief Gain of a linear fade computed the direct way, one 64-bit division
+ * per frame.
+ */
+static int32_t fadeGain(uint32_t position, uint32_t total) {
+    return position >= total ? 32768
+                             : (int32_t)(((uint64_t)position << 15) / total);
+}
+
+void test_fade_steps_like_the_division() {
+    const uint32_t totals[] = {1, 3, 7, 1000, 44100, 70001};
+    for (uint32_t total : totals) {
+        for (uint32_t position : {0u, 1u, total / 2, total - 1, total + 5}) {
+            for (int i = 0; i < MAX_SAMPLES; i++) {
+                mono[i] = INT16_MAX;
+                stereo[i] = 0;
+            }
+            crossfadeSamples(stereo, mono, MAX_SAMPLES / 2, 2, position,
+                             total);
+            fadeSamples(mono, MAX_SAMPLES, 1, position, total, true);
+            for (int i = 0; i < MAX_SAMPLES; i++) {
+                int32_t gain = fadeGain(position + i, total);
+                TEST_ASSERT_EQUAL_INT16((INT16_MAX * gain) >> 15, mono[i]);
+            }
+            for (int i = 0; i < MAX_SAMPLES / 2; i++) {
+                int32_t gain = fadeGain(position + i, total);
+                TEST_ASSERT_EQUAL_INT16((INT16_MAX * gain) >> 15,
+                                        stereo[2 * i]);
+            }
+        }
+    }
+}
+
+void test_soft_clip_bends_only_peaks() {
+    int16_t samples[] = {0,     1000,   AUDIO_DSP_SOFT_CLIP_KNEE,
+                         -24576, 28000, INT16_MAX,
+                         INT16_MIN};
+    softClip(samples, 7);
+    TEST_ASSERT_EQUAL_INT16(0, samples[0]);
+    TEST_ASSERT_EQUAL_INT16(1000, samples[1]);
+    TEST_ASSERT_EQUAL_INT16(AUDIO_DSP_SOFT_CLIP_KNEE, samples[2]);
+    TEST_ASSERT_EQUAL_INT16(-24576, samples[3]);
+    TEST_ASSERT_TRUE(samples[4] > AUDIO_DSP_SOFT_CLIP_KNEE &&
+                     samples[4] < 28000);
+    TEST_ASSERT_INT_WITHIN(1, 28672, samples[5]);
+    TEST_ASSERT_INT_WITHIN(1, -28672, samples[6]);
+}
+
+// The engine's DMA block, stereo
+#define STAGE_FRAMES 512
+
+template <typename Stage>
+static double microsPerBlock(Stage stage, int16_t *block) {
+    const int rounds = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        stage(block, round);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count() *
+           1e6 / rounds;
+}
+
+void test_benchmark_output_stage() {
+    alignas(AUDIO_DSP_ALIGNMENT) static int16_t block[2 * STAGE_FRAMES];
+    // Loud enough for every sample to go through the soft clip curve
+    for (int i = 0; i < 2 * STAGE_FRAMES; i++) {
+        block[i] = i % 2 ? 30000 : -30000;
+    }
+    // A fade long enough that it never ends during the benchmark
+    const uint32_t total = 0x7FFFFFFF;
+
+    double divided = microsPerBlock(
+        [total](int16_t *samples, int round) {
+            uint32_t position = round * STAGE_FRAMES;
+            for (int i = 0; i < STAGE_FRAMES; i++, position++) {
+                int32_t gain = fadeGain(position, total);
+                samples[2 * i] = (int16_t)((samples[2 * i] * gain) >> 15);
+                samples[2 * i + 1] =
+                    (int16_t)((samples[2 * i + 1] * gain) >> 15);
+            }
+        },
+        block);
+    double fade = microsPerBlock(
+        [total](int16_t *samples, int round) {
+            fadeSamples(samples, STAGE_FRAMES, 2, round * STAGE_FRAMES,
+                        total, false);
+        },
+        block);
+    double ramp = microsPerBlock(
+        [](int16_t *samples, int) {
+            rampGain(samples, STAGE_FRAMES, 2, 32000, 32767);
+        },
+        block);
+    double gain = microsPerBlock(
+        [](int16_t *samples, int) {
+            const int16_t *source = samples;
+            int16_t gain = 32000;
+            mixSaturate(&source, &gain, 1, samples, 2 * STAGE_FRAMES);
+        },
+        block);
+    for (int i = 0; i < 2 * STAGE_FRAMES; i++) {
+        block[i] = i % 2 ? 30000 : -30000;
+    }
+    double clip = microsPerBlock(
+        [](int16_t *samples, int) { softClip(samples, 2 * STAGE_FRAMES); },
+        block);
+
+    char message[128];
+    snprintf(message, sizeof(message),
+             "us per %d stereo frames: fade %.2f (divided %.2f), ramp %.2f, "
+             "gain %.2f, soft clip %.2f",
+             STAGE_FRAMES, fade, divided, ramp, gain, clip);
+    TEST_MESSAGE(message);
+}
+
+// Clip and request sizes of the getFrames benchmark, a second of 48 kHz
+// audio read in the blocks the audio engine asks for
+#define CLIP_FRAMES 48000
+#define BLOCK_FRAMES 256
+
+struct Frame {
+    int16_t left;
+    int16_t right;
+};
+
+/**
+ * @brief A clip in memory, read the way WAVFileReader::getFrames reads a
+ * PSRAM clip before and after it was changed to work in blocks.
+ */
+struct ClipReader {
+    std::vector<uint8_t> clip;
+    size_t position;
+    int channels;
+
+    ClipReader(int channelCount)
+        : clip(CLIP_FRAMES * channelCount * sizeof(int16_t)), position(0),
+          channels(channelCount) {
+        for (size_t i = 0; i < clip.size(); i++) {
+            clip[i] = (uint8_t)(i * 7);
+        }
+    }
+
+    // One or two copies and an end check per frame
+    void getFramesPerFrame(Frame *frames, int count) {
+        for (int i = 0; i < count; i++) {
+            if (position >= clip.size()) {
+                position = 0;
+            }
+            memcpy(&frames[i].left, clip.data() + position, sizeof(int16_t));
+            position += sizeof(int16_t);
+            if (channels == 1) {
+                frames[i].right = frames[i].left;
+            } else {
+                memcpy(&frames[i].right, clip.data() + position,
+                       sizeof(int16_t));
+                position += sizeof(int16_t);
+            }
+        }
+    }
+
+    // One copy per block, mono expanded in place
+    void getFramesBlock(Frame *frames, int count) {
+        size_t bytes = count * channels * sizeof(int16_t);
+        if (position + bytes > clip.size()) {
+            position = 0;
+        }
+        uint8_t *destination = (uint8_t *)frames;
+        if (channels == 1) {
+            destination = (uint8_t *)((int16_t *)frames + count);
+        }
+        memcpy(destination, clip.data() + position, bytes);
+        position += bytes;
+        if (channels == 1) {
+            expandMonoToStereo((int16_t *)destination, (int16_t *)frames,
+                               count);
+        }
+    }
+};
+
+template <typename Read>
+static double framesPerSecond(Read read, Frame *frames) {
+    const int rounds = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        read(frames, BLOCK_FRAMES);
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return rounds * BLOCK_FRAMES / seconds;
+}
+
+void test_benchmark_get_frames() {
+    alignas(AUDIO_DSP_ALIGNMENT) static Frame frames[BLOCK_FRAMES];
+    for (int channels = 1; channels <= 2; channels++) {
+        ClipReader before(channels);
+        ClipReader after(channels);
+        double perFrame = framesPerSecond(
+            [&](Frame *f, int n) { before.getFramesPerFrame(f, n); }, frames);
+        double block = framesPerSecond(
+            [&](Frame *f, int n) { after.getFramesBlock(f, n); }, frames);
+        // Both read the same bytes
+        before.position = after.position = 0;
+        Frame expected[BLOCK_FRAMES];
+        before.getFramesPerFrame(expected, BLOCK_FRAMES);
+        after.getFramesBlock(frames, BLOCK_FRAMES);
+        TEST_ASSERT_EQUAL_MEMORY(expected, frames, sizeof(expected));
+
+        char message[96];
+        snprintf(message, sizeof(message),
+                 "%s: %.1f M frames/s per frame, %.1f M frames/s in blocks",
+                 channels == 1 ? "mono" : "stereo", perFrame / 1e6,
+                 block / 1e6);
+        TEST_MESSAGE(message);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_expand_duplicates_every_sample);
+    RUN_TEST(test_expand_leaves_the_rest_alone);
+    RUN_TEST(test_expand_in_place);
+    RUN_TEST(test_mix_saturates_instead_of_wrapping);
+    RUN_TEST(test_mix_many_full_scale_sources);
+    RUN_TEST(test_mix_applies_gains);
+    RUN_TEST(test_mix_in_place);
+    RUN_TEST(test_fade_steps_like_the_division);
+    RUN_TEST(test_soft_clip_bends_only_peaks);
+    RUN_TEST(test_benchmark_output_stage);
+    RUN_TEST(test_benchmark_get_frames);
+    return UNITY_END();
+}
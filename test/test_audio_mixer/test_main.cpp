@@ -0,0 +1,136 @@
+#include "audio/AudioDSP.h"
+#include "audio/AudioMixer.h"
+#include <chrono>
+#include <stdio.h>
+#include <unity.h>
+
+/**
+ * @brief Stereo source playing one level for a fixed number of frames.
+ */
+class ConstantSource : public AudioFile {
+  private:
+    int16_t m_level;
+    int m_remaining;
+    int m_rate;
+
+  public:
+    ConstantSource(int16_t level, int frames, int rate = 16000)
+        : m_level(level), m_remaining(frames), m_rate(rate) {}
+    int sampleRate() { return m_rate; }
+    int getFrames(Frame_t *frames, int number_frames) {
+        int produced = min(number_frames, m_remaining);
+        for (int i = 0; i < number_frames; i++) {
+            int16_t sample = i < produced ? m_level : 0;
+            frames[i] = {sample, sample};
+        }
+        m_remaining -= produced;
+        return produced;
+    }
+    int remainingFrames() { return m_remaining; }
+    bool isComplete() { return m_remaining == 0; }
+};
+
+static Frame_t frames[100];
+
+void setUp() { memset(frames, 0, sizeof(frames)); }
+
+void tearDown() {}
+
+void test_loud_sources_saturate() {
+    AudioMixer mixer(32);
+    TEST_ASSERT_TRUE(mixer.addSource(new ConstantSource(30000, 100),
+                                     AUDIO_DSP_UNITY_GAIN));
+    TEST_ASSERT_TRUE(mixer.addSource(new ConstantSource(30000, 100),
+                                     AUDIO_DSP_UNITY_GAIN));
+    TEST_ASSERT_EQUAL_INT(100, mixer.getFrames(frames, 100));
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL_INT16(INT16_MAX, frames[i].left);
+        TEST_ASSERT_EQUAL_INT16(INT16_MAX, frames[i].right);
+    }
+    TEST_ASSERT_EQUAL_INT(0, mixer.sourceCount());
+}
+
+void test_quiet_sources_add_up() {
+    AudioMixer mixer(32);
+    mixer.addSource(new ConstantSource(-1000, 100), AUDIO_DSP_UNITY_GAIN);
+    mixer.addSource(new ConstantSource(-2000, 40), AUDIO_DSP_UNITY_GAIN);
+    TEST_ASSERT_EQUAL_INT(100, mixer.getFrames(frames, 100));
+    TEST_ASSERT_INT_WITHIN(2, -3000, frames[0].left);
+    TEST_ASSERT_INT_WITHIN(2, -3000, frames[39].right);
+    // The shorter source ended and was dropped
+    TEST_ASSERT_INT_WITHIN(1, -1000, frames[40].left);
+    TEST_ASSERT_INT_WITHIN(1, -1000, frames[99].right);
+}
+
+void test_mix_into_saturates_existing_audio() {
+    for (int i = 0; i < 100; i++) {
+        frames[i] = {-30000, 30000};
+    }
+    AudioMixer mixer(32);
+    mixer.addSource(new ConstantSource(-30000, 50), AUDIO_DSP_UNITY_GAIN);
+    mixer.mixInto(frames, 100);
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, frames[0].left);
+    TEST_ASSERT_INT_WITHIN(1, 0, frames[0].right);
+    // Past the end of the source the existing audio is left as it was
+    TEST_ASSERT_INT_WITHIN(1, -30000, frames[60].left);
+    TEST_ASSERT_INT_WITHIN(1, 30000, frames[60].right);
+}
+
+void test_full_mixer_rejects_a_source() {
+    AudioMixer mixer(32);
+    for (int i = 0; i < AUDIO_MIXER_MAX_SOURCES; i++) {
+        TEST_ASSERT_TRUE(mixer.addSource(new ConstantSource(1, 10), 1));
+    }
+    TEST_ASSERT_FALSE(mixer.addSource(new ConstantSource(1, 10), 1));
+    TEST_ASSERT_EQUAL_INT(AUDIO_MIXER_MAX_SOURCES, mixer.sourceCount());
+}
+
+// Block the audio engine mixes its effects into, AUDIO_ENGINE_DMA_FRAMES
+#define BENCHMARK_BLOCK_FRAMES 512
+#define BENCHMARK_RATE 48000
+#define BENCHMARK_SOURCES 4
+
+void test_benchmark_four_sources() {
+    static Frame_t block[BENCHMARK_BLOCK_FRAMES];
+    const int seconds = 2;
+    AudioMixer mixer(BENCHMARK_BLOCK_FRAMES);
+    for (int i = 0; i < BENCHMARK_SOURCES; i++) {
+        TEST_ASSERT_TRUE(mixer.addSource(
+            new ConstantSource(1000 * (i + 1), seconds * BENCHMARK_RATE,
+                               BENCHMARK_RATE),
+            AUDIO_DSP_UNITY_GAIN / 2));
+    }
+
+    int blocks = seconds * BENCHMARK_RATE / BENCHMARK_BLOCK_FRAMES;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < blocks; i++) {
+        mixer.getFrames(block, BENCHMARK_BLOCK_FRAMES);
+    }
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    TEST_ASSERT_EQUAL_INT(BENCHMARK_SOURCES, mixer.sourceCount());
+    TEST_ASSERT_INT_WITHIN(8, 5000, block[0].left);
+
+    // Share of one core spent mixing, includes rendering the sources
+    double share = elapsed / seconds;
+    char message[96];
+    snprintf(message, sizeof(message),
+             "%d sources at %d Hz: %.2f us per block, %.3f%% of a core",
+             BENCHMARK_SOURCES, BENCHMARK_RATE, elapsed * 1e6 / blocks,
+             share * 100);
+    TEST_MESSAGE(message);
+    // Generous enough for sanitizer builds, a regression to per-sample
+    // floating point or per-frame calls would still be far off
+    TEST_ASSERT_TRUE(share < 0.05);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_loud_sources_saturate);
+    RUN_TEST(test_quiet_sources_add_up);
+    RUN_TEST(test_mix_into_saturates_existing_audio);
+    RUN_TEST(test_full_mixer_rejects_a_source);
+    RUN_TEST(test_benchmark_four_sources);
+    return UNITY_END();
+}
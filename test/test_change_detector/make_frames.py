@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Writes the frame set of the change detector benchmark.
+
+Each frame is what ChangeDetector::analyze gets from CameraFrame::decodeGray
+for a VGA capture: 80x60 grayscale, every pixel the mean of an 8x8 block
+(the DC coefficient). The scene is synthetic: a lit room with furniture,
+sensor noise on every frame, an auto exposure step and someone walking
+through. Frames recorded from the camera can replace them, as long as the
+expected verdicts in test_main.cpp are updated to match.
+
+Usage:
+    python test/test_change_detector/make_frames.py
+"""
+
+import math
+import os
+import random
+
+WIDTH, HEIGHT = 640, 480
+BLOCK = 8
+
+# Per frame: brightness offset and left edge of the person, None if absent
+SEQUENCE = [(0, None)] * 5 + [(18, None)] * 3 + \
+    [(18, x) for x in (-60, 60, 200, 340)] + [(18, None)] * 4
+
+
+def scene(x, y):
+    """Background luma: a window-lit gradient, a shelf, a table, texture."""
+    value = 70 + 80 * x / WIDTH + 20 * math.sin(y / 37.0)
+    if 420 <= x < 600 and 60 <= y < 300:
+        value = 150 + 30 * ((x // 30 + y // 40) % 2)
+    if 80 <= x < 360 and 330 <= y < 380:
+        value = 45
+    value += 8 * math.sin(x / 5.0) * math.sin(y / 7.0)
+    return value
+
+
+def person(x, y, left):
+    """Darker figure, a head over a body, 120 pixels wide."""
+    if left is None:
+        return None
+    center = left + 60
+    if (x - center) ** 2 + (y - 110) ** 2 < 35 ** 2:
+        return 95
+    if abs(x - center) < 60 and 150 <= y < 470:
+        return 55 + 10 * ((y // 24) % 2)
+    return None
+
+
+def frame(offset, left, rng):
+    pixels = bytearray()
+    for by in range(HEIGHT // BLOCK):
+        for bx in range(WIDTH // BLOCK):
+            total = 0
+            for y in range(by * BLOCK, (by + 1) * BLOCK, 2):
+                for x in range(bx * BLOCK, (bx + 1) * BLOCK, 2):
+                    covered = person(x, y, left)
+                    total += scene(x, y) if covered is None else covered
+            value = total / (BLOCK * BLOCK / 4) + offset + rng.gauss(0, 1.5)
+            pixels.append(max(0, min(255, int(round(value)))))
+    return pixels
+
+
+def main():
+    rng = random.Random(24)
+    directory = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             "frames")
+    os.makedirs(directory, exist_ok=True)
+    for index, (offset, left) in enumerate(SEQUENCE):
+        path = os.path.join(directory, "%02d.pgm" % index)
+        with open(path, "wb") as output:
+            output.write(b"P5\n%d %d\n255\n" % (WIDTH // BLOCK,
+                                                HEIGHT // BLOCK))
+            output.write(frame(offset, left, rng))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,131 @@
+#include "camera/ChangeModel.h"
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+/**
+ * @brief Whether each frame of frames/, written by make_frames.py, should
+ * count as a change. The first one builds the background.
+ */
+enum Verdict { STILL, MOVED, EITHER };
+
+static const Verdict EXPECTED[] = {
+    EITHER, STILL, STILL, STILL, STILL,           // Still scene with noise
+    STILL,  STILL, STILL,                         // Exposure step
+    MOVED,  MOVED, MOVED, MOVED,                  // Someone walks through
+    STILL,  STILL,  STILL,  STILL,                // Gone again
+};
+
+#define FRAME_COUNT (sizeof(EXPECTED) / sizeof(EXPECTED[0]))
+
+struct Frame {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+};
+
+static std::vector<Frame> frames;
+
+static std::string frameDirectory() {
+    std::string path = __FILE__;
+    return path.substr(0, path.find_last_of("/\\") + 1) + "frames/";
+}
+
+static bool readPGM(const std::string &path, Frame &frame) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    int maximum = 0;
+    bool read = fscanf(file, "P5 %d %d %d", &frame.width, &frame.height,
+                       &maximum) == 3 &&
+                maximum == 255 && fgetc(file) != EOF;
+    if (read) {
+        frame.pixels.resize(frame.width * frame.height);
+        read = fread(frame.pixels.data(), 1, frame.pixels.size(), file) ==
+               frame.pixels.size();
+    }
+    fclose(file);
+    return read;
+}
+
+/**
+ * @brief Runs the model over the whole set, as ChangeDetector::analyze
+ * does once per decoded frame.
+ *
+ * @param scores Score of each frame, 0-100.
+ */
+static void runDetector(int *scores) {
+    ChangeModel model;
+    for (size_t i = 0; i < frames.size(); i++) {
+        const Frame &frame = frames[i];
+        scores[i] =
+            model.update(frame.pixels.data(), frame.width, frame.height);
+    }
+}
+
+void setUp() {
+    if (!frames.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < FRAME_COUNT; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%02d.pgm", (int)i);
+        Frame frame;
+        if (!readPGM(frameDirectory() + name, frame)) {
+            frames.clear();
+            return;
+        }
+        frames.push_back(frame);
+    }
+}
+
+void tearDown() {}
+
+void test_verdicts() {
+    TEST_ASSERT_EQUAL_INT(FRAME_COUNT, frames.size());
+    int scores[FRAME_COUNT];
+    runDetector(scores);
+    for (size_t i = 0; i < FRAME_COUNT; i++) {
+        char message[64];
+        snprintf(message, sizeof(message), "frame %d score %d", (int)i,
+                 scores[i]);
+        TEST_MESSAGE(message);
+        bool moved = scores[i] >= CHANGE_DETECTOR_MIN_SCORE;
+        if (EXPECTED[i] != EITHER) {
+            TEST_ASSERT_TRUE_MESSAGE(moved == (EXPECTED[i] == MOVED),
+                                     message);
+        }
+    }
+}
+
+/**
+ * @brief Times the model on frames that are already decoded. The JPEG decode
+ * in front of it needs the camera driver, the robot reports its cost as
+ * `decodeUs` next to `analysisUs` in `/change`.
+ */
+void test_benchmark() {
+    TEST_ASSERT_EQUAL_INT(FRAME_COUNT, frames.size());
+    const int rounds = 2000;
+    int scores[FRAME_COUNT];
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        runDetector(scores);
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    char message[64];
+    snprintf(message, sizeof(message), "%.2f us per frame on the host",
+             elapsed / (rounds * FRAME_COUNT));
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_verdicts);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
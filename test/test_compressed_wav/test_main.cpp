@@ -0,0 +1,305 @@
+#include "audio/CompressedWAVReader.h"
+#include <math.h>
+#include <unity.h>
+#include <vector>
+
+static const int STEPS[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int INDEX_ADJUST[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+/**
+ * @brief Reference IMA-ADPCM encoder. It tracks the decoder state, so the
+ * samples it reconstructs are exactly what a decoder has to produce.
+ */
+struct AdpcmEncoder {
+    int predictor = 0;
+    int index = 0;
+
+    uint8_t encode(int sample) {
+        int step = STEPS[index];
+        int difference = sample - predictor;
+        uint8_t nibble = 0;
+        if (difference < 0) {
+            nibble = 8;
+            difference = -difference;
+        }
+        int delta = step >> 3;
+        for (int bit = 4; bit > 0; bit >>= 1, step >>= 1) {
+            if (difference >= step) {
+                nibble |= bit;
+                difference -= step;
+                delta += step;
+            }
+        }
+        predictor += nibble & 8 ? -delta : delta;
+        predictor = predictor > 32767 ? 32767 : predictor;
+        predictor = predictor < -32768 ? -32768 : predictor;
+        index += INDEX_ADJUST[nibble & 7];
+        index = index < 0 ? 0 : index > 88 ? 88 : index;
+        return nibble;
+    }
+};
+
+static void put16(std::vector<uint8_t> &file, uint16_t value) {
+    file.push_back(value);
+    file.push_back(value >> 8);
+}
+
+static void put32(std::vector<uint8_t> &file, uint32_t value) {
+    put16(file, value);
+    put16(file, value >> 16);
+}
+
+/**
+ * @brief Builds a WAV file around `data` and parses it into a reader.
+ */
+static CompressedWAVReader *makeReader(uint16_t audioFormat, int channels,
+                                       uint16_t blockAlign,
+                                       uint16_t samplesPerBlock,
+                                       const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> file;
+    file.insert(file.end(), {'R', 'I', 'F', 'F'});
+    put32(file, 4 + 28 + 8 + data.size());
+    file.insert(file.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put32(file, 20);
+    put16(file, audioFormat);
+    put16(file, channels);
+    put32(file, 8000);
+    put32(file, 8000 * blockAlign);
+    put16(file, blockAlign);
+    put16(file, audioFormat == WAV_FORMAT_IMA_ADPCM ? 4 : 8);
+    put16(file, 2);
+    put16(file, samplesPerBlock);
+    file.insert(file.end(), {'d', 'a', 't', 'a'});
+    put32(file, data.size());
+    file.insert(file.end(), data.begin(), data.end());
+
+    std::shared_ptr<PSRAMBuffer> buffer =
+        std::make_shared<PSRAMBuffer>(file.size());
+    memcpy(buffer->data(), file.data(), file.size());
+    wav_format_t format;
+    if (!parseWAVFormat(buffer->data(), buffer->size(), format) ||
+        !CompressedWAVReader::supports(format)) {
+        return nullptr;
+    }
+    return new CompressedWAVReader(buffer, format);
+}
+
+/**
+ * @brief Reads every sample, in odd-sized pieces to cross block boundaries.
+ */
+static std::vector<int16_t> readAll(CompressedWAVReader *reader) {
+    std::vector<int16_t> samples;
+    int channels = reader->numChannels();
+    int16_t block[2 * 37];
+    while (!reader->isComplete()) {
+        int produced = channels == 1 ? reader->getSamples(block, 37)
+                                     : reader->getFrames((Frame_t *)block, 37);
+        samples.insert(samples.end(), block, block + produced * channels);
+    }
+    return samples;
+}
+
+static std::vector<int16_t> decodeG711(uint16_t audioFormat) {
+    std::vector<uint8_t> data;
+    for (int i = 0; i < 256; i++) {
+        data.push_back(i);
+    }
+    CompressedWAVReader *reader = makeReader(audioFormat, 1, 1, 0, data);
+    std::vector<int16_t> samples = readAll(reader);
+    delete reader;
+    return samples;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_mu_law_reference_values() {
+    std::vector<int16_t> samples = decodeG711(WAV_FORMAT_MULAW);
+    TEST_ASSERT_EQUAL_INT(256, samples.size());
+    TEST_ASSERT_EQUAL_INT16(-32124, samples[0x00]);
+    TEST_ASSERT_EQUAL_INT16(0, samples[0x7F]);
+    TEST_ASSERT_EQUAL_INT16(32124, samples[0x80]);
+    TEST_ASSERT_EQUAL_INT16(0, samples[0xFF]);
+    TEST_ASSERT_EQUAL_INT16(-8, samples[0x7E]);
+    TEST_ASSERT_EQUAL_INT16(8, samples[0xFE]);
+}
+
+void test_a_law_reference_values() {
+    std::vector<int16_t> samples = decodeG711(WAV_FORMAT_ALAW);
+    TEST_ASSERT_EQUAL_INT(256, samples.size());
+    TEST_ASSERT_EQUAL_INT16(-32256, samples[0x2A]);
+    TEST_ASSERT_EQUAL_INT16(-8, samples[0x55]);
+    TEST_ASSERT_EQUAL_INT16(32256, samples[0xAA]);
+    TEST_ASSERT_EQUAL_INT16(8, samples[0xD5]);
+}
+
+/**
+ * @brief Reference G.711 expansions, as in the Sun g711.c that most codecs,
+ * and Python's audioop, follow.
+ */
+static int16_t referenceMuLaw(uint8_t code) {
+    code = ~code;
+    int magnitude = (((code & 0x0F) << 3) + 0x84) << ((code & 0x70) >> 4);
+    return code & 0x80 ? 0x84 - magnitude : magnitude - 0x84;
+}
+
+static int16_t referenceALaw(uint8_t code) {
+    code ^= 0x55;
+    int magnitude = (code & 0x0F) << 4;
+    int segment = (code & 0x70) >> 4;
+    if (segment == 0) {
+        magnitude += 8;
+    } else {
+        magnitude = (magnitude + 0x108) << (segment - 1);
+    }
+    return code & 0x80 ? magnitude : -magnitude;
+}
+
+void test_g711_matches_the_reference_decoder() {
+    std::vector<int16_t> muLaw = decodeG711(WAV_FORMAT_MULAW);
+    std::vector<int16_t> aLaw = decodeG711(WAV_FORMAT_ALAW);
+    TEST_ASSERT_EQUAL_INT(256, muLaw.size());
+    TEST_ASSERT_EQUAL_INT(256, aLaw.size());
+    for (int code = 0; code < 256; code++) {
+        TEST_ASSERT_EQUAL_INT16(referenceMuLaw(code), muLaw[code]);
+        TEST_ASSERT_EQUAL_INT16(referenceALaw(code), aLaw[code]);
+    }
+}
+
+void test_g711_tables_are_symmetric_and_monotonic() {
+    for (uint16_t audioFormat : {WAV_FORMAT_MULAW, WAV_FORMAT_ALAW}) {
+        std::vector<int16_t> samples = decodeG711(audioFormat);
+        // The top bit is the sign, the other bits grow the magnitude once
+        // mu-law codes are inverted or A-law codes have every other bit
+        // flipped
+        int previous = -1;
+        for (int magnitude = 0; magnitude < 128; magnitude++) {
+            int code = audioFormat == WAV_FORMAT_MULAW
+                           ? 0xFF - magnitude
+                           : (0x80 | magnitude) ^ 0x55;
+            TEST_ASSERT_GREATER_THAN(previous, samples[code]);
+            previous = samples[code];
+        }
+        for (int i = 0; i < 256; i++) {
+            TEST_ASSERT_EQUAL_INT16(-samples[i], samples[i ^ 0x80]);
+        }
+    }
+}
+
+static std::vector<int16_t> testSignal(int frames, int channels) {
+    std::vector<int16_t> samples;
+    for (int i = 0; i < frames; i++) {
+        for (int channel = 0; channel < channels; channel++) {
+            // A rising sweep, getting louder up to almost full scale
+            double level = 1000 + 30 * i;
+            samples.push_back((int16_t)lrint(
+                min(level, 30000.0) * sin(0.00002 * i * i * (channel + 1))));
+        }
+    }
+    return samples;
+}
+
+/**
+ * @brief Encodes `input` into IMA-ADPCM blocks of `blockAlign` bytes and
+ * returns the samples a decoder must reconstruct.
+ */
+static std::vector<int16_t> encodeAdpcm(const std::vector<int16_t> &input,
+                                        int channels, int blockAlign,
+                                        std::vector<uint8_t> &data) {
+    int samplesPerBlock = (blockAlign - 4 * channels) * 2 / channels + 1;
+    int frames = input.size() / channels;
+    std::vector<int16_t> expected;
+    AdpcmEncoder encoders[2];
+    for (int first = 0; first < frames; first += samplesPerBlock) {
+        int count = min(samplesPerBlock, frames - first);
+        for (int channel = 0; channel < channels; channel++) {
+            AdpcmEncoder &encoder = encoders[channel];
+            encoder.predictor = input[first * channels + channel];
+            put16(data, encoder.predictor);
+            data.push_back(encoder.index);
+            data.push_back(0);
+        }
+        std::vector<int16_t> block(count * channels);
+        for (int channel = 0; channel < channels; channel++) {
+            block[channel] = input[first * channels + channel];
+        }
+        // Groups of 8 nibbles per channel, low nibble first
+        for (int group = 1; group < count; group += 8) {
+            for (int channel = 0; channel < channels; channel++) {
+                for (int i = 0; i < 8; i += 2) {
+                    uint8_t byte = 0;
+                    for (int half = 0; half < 2; half++) {
+                        int frame = group + i + half;
+                        if (frame >= count) {
+                            continue;
+                        }
+                        uint8_t nibble = encoders[channel].encode(
+                            input[(first + frame) * channels + channel]);
+                        byte |= nibble << (4 * half);
+                        block[frame * channels + channel] =
+                            encoders[channel].predictor;
+                    }
+                    data.push_back(byte);
+                }
+            }
+        }
+        expected.insert(expected.end(), block.begin(), block.end());
+    }
+    return expected;
+}
+
+static void checkAdpcm(int channels, int frames) {
+    const int blockAlign = 256 * channels;
+    std::vector<int16_t> input = testSignal(frames, channels);
+    std::vector<uint8_t> data;
+    std::vector<int16_t> expected =
+        encodeAdpcm(input, channels, blockAlign, data);
+
+    CompressedWAVReader *reader =
+        makeReader(WAV_FORMAT_IMA_ADPCM, channels, blockAlign, 0, data);
+    TEST_ASSERT_NOT_NULL(reader);
+    TEST_ASSERT_EQUAL_INT(frames, reader->remainingFrames());
+    std::vector<int16_t> samples = readAll(reader);
+    delete reader;
+
+    TEST_ASSERT_EQUAL_INT(expected.size(), samples.size());
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expected.data(), samples.data(),
+                                  expected.size());
+    // And the codec actually follows the signal
+    for (size_t i = 0; i < input.size(); i++) {
+        TEST_ASSERT_INT_WITHIN(3000, input[i], samples[i]);
+    }
+}
+
+void test_ima_adpcm_mono() {
+    // Two whole blocks of 505 frames and a partial one
+    checkAdpcm(1, 2 * 505 + 17);
+}
+
+void test_ima_adpcm_stereo() {
+    // A partial block has to end on a whole group of 8 nibbles, otherwise
+    // the padding is decoded as samples
+    checkAdpcm(2, 505 + 1 + 8 * 12);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_mu_law_reference_values);
+    RUN_TEST(test_a_law_reference_values);
+    RUN_TEST(test_g711_matches_the_reference_decoder);
+    RUN_TEST(test_g711_tables_are_symmetric_and_monotonic);
+    RUN_TEST(test_ima_adpcm_mono);
+    RUN_TEST(test_ima_adpcm_stereo);
+    return UNITY_END();
+}
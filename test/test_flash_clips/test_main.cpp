@@ -0,0 +1,211 @@
+#include "audio/FlashClipReader.h"
+#include "audio/FlashClipTable.h"
+#include <unity.h>
+
+#define PACK_SIZE 1024
+
+alignas(FLASH_CLIP_ALIGNMENT) static uint8_t pack[PACK_SIZE];
+
+static flash_clip_header_t *header = (flash_clip_header_t *)pack;
+static flash_clip_entry_t *entries =
+    (flash_clip_entry_t *)(pack + sizeof(flash_clip_header_t));
+
+// Offset of the first clip, just past a table of two entries
+static const uint32_t FIRST_CLIP =
+    (sizeof(flash_clip_header_t) + 2 * sizeof(flash_clip_entry_t) +
+     FLASH_CLIP_ALIGNMENT - 1) /
+    FLASH_CLIP_ALIGNMENT * FLASH_CLIP_ALIGNMENT;
+
+/**
+ * @brief Packs a mono clip of 10 frames and a stereo clip of 6 frames the
+ * way tools/pack_clips.py lays them out.
+ */
+void setUp() {
+    memset(pack, 0xFF, sizeof(pack)); // Like erased flash
+    memcpy(header->magic, FLASH_CLIP_MAGIC, 4);
+    header->version = FLASH_CLIP_VERSION;
+    header->clip_count = 2;
+    memset(header->reserved, 0, sizeof(header->reserved));
+
+    const char *names[2] = {"/mono.wav", "/stereo.wav"};
+    uint32_t offset = FIRST_CLIP;
+    for (int i = 0; i < 2; i++) {
+        flash_clip_entry_t &entry = entries[i];
+        memset(entry.name, 0, FLASH_CLIP_NAME_LENGTH);
+        strcpy(entry.name, names[i]);
+        entry.num_channels = i + 1;
+        entry.data_offset = offset;
+        entry.data_bytes = (i ? 6 : 10) * 2 * entry.num_channels;
+        entry.sample_rate = i ? 44100 : 16000;
+        entry.bit_depth = 16;
+        int16_t *samples = (int16_t *)(pack + offset);
+        for (uint32_t j = 0; j < entry.data_bytes / 2; j++) {
+            samples[j] = (int16_t)(100 * (i + 1) + j);
+        }
+        offset += 64;
+    }
+}
+
+void tearDown() {}
+
+void test_finds_packed_clips() {
+    FlashClipTable table;
+    TEST_ASSERT_TRUE(table.load(pack, sizeof(pack)));
+    TEST_ASSERT_EQUAL_INT(2, table.clipCount());
+    TEST_ASSERT_NOT_NULL(table.find("/mono.wav"));
+    TEST_ASSERT_EQUAL_INT(44100, table.find("/stereo.wav")->sample_rate);
+    TEST_ASSERT_NULL(table.find("/missing.wav"));
+    TEST_ASSERT_NULL(table.open("/missing.wav"));
+}
+
+void test_host_has_no_partition() {
+    FlashClipTable table;
+    TEST_ASSERT_FALSE(table.begin());
+    TEST_ASSERT_EQUAL_INT(0, table.clipCount());
+}
+
+void test_mono_clip() {
+    FlashClipTable table;
+    TEST_ASSERT_TRUE(table.load(pack, sizeof(pack)));
+    AudioFile *clip = table.open("/mono.wav");
+    TEST_ASSERT_NOT_NULL(clip);
+    TEST_ASSERT_EQUAL_INT(16000, clip->sampleRate());
+    TEST_ASSERT_EQUAL_INT(1, clip->numChannels());
+    TEST_ASSERT_EQUAL_INT(10, clip->remainingFrames());
+
+    int16_t samples[4];
+    TEST_ASSERT_EQUAL_INT(4, clip->getSamples(samples, 4));
+    const int16_t expected[4] = {100, 101, 102, 103};
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expected, samples, 4);
+    TEST_ASSERT_FALSE(clip->isComplete());
+
+    // Mono is expanded into frames, then padded with silence at the end
+    Frame_t frames[8];
+    TEST_ASSERT_EQUAL_INT(6, clip->getFrames(frames, 8));
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL_INT16(104 + i, frames[i].left);
+        TEST_ASSERT_EQUAL_INT16(104 + i, frames[i].right);
+    }
+    TEST_ASSERT_EQUAL_INT16(0, frames[6].left);
+    TEST_ASSERT_EQUAL_INT16(0, frames[7].right);
+    TEST_ASSERT_TRUE(clip->isComplete());
+    TEST_ASSERT_EQUAL_INT(0, clip->remainingFrames());
+    TEST_ASSERT_EQUAL_INT(0, clip->getSamples(samples, 4));
+    delete clip;
+}
+
+void test_stereo_clip() {
+    FlashClipTable table;
+    TEST_ASSERT_TRUE(table.load(pack, sizeof(pack)));
+    AudioFile *clip = table.open("/stereo.wav");
+    TEST_ASSERT_NOT_NULL(clip);
+    TEST_ASSERT_EQUAL_INT(2, clip->numChannels());
+    TEST_ASSERT_EQUAL_INT(6, clip->remainingFrames());
+
+    // Stereo sources are only read as frames
+    int16_t samples[2] = {1, 1};
+    TEST_ASSERT_EQUAL_INT(0, clip->getSamples(samples, 2));
+    TEST_ASSERT_EQUAL_INT16(0, samples[0]);
+
+    Frame_t frames[4];
+    TEST_ASSERT_EQUAL_INT(4, clip->getFrames(frames, 4));
+    TEST_ASSERT_EQUAL_INT16(200, frames[0].left);
+    TEST_ASSERT_EQUAL_INT16(201, frames[0].right);
+    TEST_ASSERT_EQUAL_INT16(207, frames[3].right);
+    TEST_ASSERT_EQUAL_INT(2, clip->getFrames(frames, 4));
+    TEST_ASSERT_EQUAL_INT16(211, frames[1].right);
+    TEST_ASSERT_EQUAL_INT16(0, frames[2].left);
+    TEST_ASSERT_TRUE(clip->isComplete());
+    delete clip;
+}
+
+void test_empty_clip_is_complete() {
+    FlashClipReader reader(nullptr, 0, 1, 16000);
+    TEST_ASSERT_TRUE(reader.isComplete());
+    Frame_t frames[2] = {{1, 1}, {1, 1}};
+    TEST_ASSERT_EQUAL_INT(0, reader.getFrames(frames, 2));
+    TEST_ASSERT_EQUAL_INT16(0, frames[1].left);
+}
+
+static bool loads() {
+    FlashClipTable table;
+    return table.load(pack, sizeof(pack));
+}
+
+void test_rejects_bad_headers() {
+    TEST_ASSERT_TRUE(loads());
+    // Erased flash
+    memset(pack, 0xFF, sizeof(flash_clip_header_t));
+    TEST_ASSERT_FALSE(loads());
+
+    setUp();
+    header->version = FLASH_CLIP_VERSION + 1;
+    TEST_ASSERT_FALSE(loads());
+
+    setUp();
+    header->clip_count = PACK_SIZE / sizeof(flash_clip_entry_t);
+    TEST_ASSERT_FALSE(loads());
+
+    setUp();
+    FlashClipTable table;
+    TEST_ASSERT_FALSE(table.load(pack, sizeof(flash_clip_header_t) - 1));
+
+    // A rejected pack does not leave the previous one half loaded
+    TEST_ASSERT_TRUE(table.load(pack, sizeof(pack)));
+    header->version = 0;
+    TEST_ASSERT_FALSE(table.load(pack, sizeof(pack)));
+    TEST_ASSERT_EQUAL_INT(0, table.clipCount());
+    TEST_ASSERT_NULL(table.find("/mono.wav"));
+}
+
+void test_rejects_bad_entries() {
+    entries[1].data_offset = sizeof(flash_clip_header_t);
+    TEST_ASSERT_FALSE(loads()); // Inside the table
+
+    setUp();
+    entries[1].data_offset += 2;
+    TEST_ASSERT_FALSE(loads()); // Unaligned
+
+    setUp();
+    entries[1].data_bytes = PACK_SIZE - entries[1].data_offset + 1;
+    TEST_ASSERT_FALSE(loads()); // Past the end
+
+    setUp();
+    entries[1].data_offset = PACK_SIZE + 0x1000;
+    entries[1].data_bytes = 4;
+    TEST_ASSERT_FALSE(loads()); // Starts past the end
+
+    setUp();
+    entries[1].data_offset = 0xFFFFFFF0;
+    TEST_ASSERT_FALSE(loads()); // Erased entry
+
+    setUp();
+    entries[0].bit_depth = 8;
+    TEST_ASSERT_FALSE(loads());
+
+    setUp();
+    entries[0].num_channels = 3;
+    TEST_ASSERT_FALSE(loads());
+
+    setUp();
+    memset(entries[0].name, 'a', FLASH_CLIP_NAME_LENGTH);
+    TEST_ASSERT_FALSE(loads()); // Not terminated
+}
+
+void test_accepts_a_clip_ending_at_the_end() {
+    entries[1].data_bytes = PACK_SIZE - entries[1].data_offset;
+    TEST_ASSERT_TRUE(loads());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_finds_packed_clips);
+    RUN_TEST(test_host_has_no_partition);
+    RUN_TEST(test_mono_clip);
+    RUN_TEST(test_stereo_clip);
+    RUN_TEST(test_empty_clip_is_complete);
+    RUN_TEST(test_rejects_bad_headers);
+    RUN_TEST(test_rejects_bad_entries);
+    RUN_TEST(test_accepts_a_clip_ending_at_the_end);
+    return UNITY_END();
+}
@@ -0,0 +1,99 @@
+#include "camera/RateModel.h"
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+
+/**
+ * @brief Sensor whose JPEG size follows the model's form, with a slope and
+ * a size per pixel the model does not start from, plus noise.
+ */
+struct SimulatedSensor {
+    float bytesPerPixel;
+    float slope;
+    float noise; /**< Relative, uniform */
+    uint32_t random;
+    SensorSettings last;
+    size_t bytes;
+    int frames;
+
+    SimulatedSensor(float bpp, float s, float n)
+        : bytesPerPixel(bpp), slope(s), noise(n), random(0x5EED),
+          last({FRAMESIZE_INVALID, 0, false}), bytes(0), frames(0) {}
+
+    static size_t capture(void *context, const SensorSettings &settings) {
+        SimulatedSensor *sensor = (SimulatedSensor *)context;
+        sensor->random = sensor->random * 1664525 + 1013904223;
+        float jitter = (sensor->random >> 8) / (float)(1 << 24) * 2 - 1;
+        const resolution_info_t &size = resolution[settings.frameSize];
+        float pixels = (float)size.width * size.height;
+        sensor->last = settings;
+        sensor->bytes = pixels * sensor->bytesPerPixel *
+                        expf(sensor->slope * (settings.quality - 12)) *
+                        (1 + sensor->noise * jitter);
+        sensor->frames++;
+        return sensor->bytes;
+    }
+};
+
+static const SensorSettings FULL = {FRAMESIZE_UXGA, 12, false};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_meets_budgets() {
+    RateModel model;
+    SimulatedSensor sensor(0.25f, -0.03f, 0.05f);
+    const size_t budgets[] = {100000, 30000, 60000, 3000, 10000,
+                              100000, 5000,  20000, 40000, 3000};
+    int requests = 0;
+    for (int round = 0; round < 3; round++) {
+        for (size_t budget : budgets) {
+            int before = sensor.frames;
+            int iterations =
+                model.meetBudget(budget, FULL, SimulatedSensor::capture,
+                                 &sensor);
+            TEST_ASSERT_EQUAL_INT(sensor.frames - before, iterations);
+            TEST_ASSERT_TRUE(iterations <= RATE_CONTROL_MAX_ITERATIONS);
+            TEST_ASSERT_TRUE(sensor.bytes <= budget);
+            TEST_ASSERT_TRUE(sensor.last.quality >= FULL.quality);
+            requests++;
+        }
+    }
+    char message[64];
+    snprintf(message, sizeof(message), "%.2f frames per request",
+             (float)sensor.frames / requests);
+    TEST_MESSAGE(message);
+}
+
+void test_stops_at_the_limits() {
+    RateModel model;
+    SimulatedSensor sensor(0.2f, -0.06f, 0);
+    // Smaller than the smallest frame at the worst quality
+    int iterations =
+        model.meetBudget(100, FULL, SimulatedSensor::capture, &sensor);
+    TEST_ASSERT_TRUE(iterations <= RATE_CONTROL_MAX_ITERATIONS);
+    TEST_ASSERT_EQUAL_INT(FRAMESIZE_QQVGA, sensor.last.frameSize);
+    TEST_ASSERT_EQUAL_INT(RATE_CONTROL_MAX_QUALITY, sensor.last.quality);
+}
+
+static size_t failingCapture(void *context, const SensorSettings &) {
+    (*(int *)context)++;
+    return 0;
+}
+
+void test_stops_when_a_capture_fails() {
+    RateModel model;
+    int calls = 0;
+    TEST_ASSERT_EQUAL_INT(1,
+                          model.meetBudget(1000, FULL, failingCapture, &calls));
+    TEST_ASSERT_EQUAL_INT(1, calls);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_meets_budgets);
+    RUN_TEST(test_stops_at_the_limits);
+    RUN_TEST(test_stops_when_a_capture_fails);
+    return UNITY_END();
+}
@@ -0,0 +1,240 @@
+#include "audio/Resampler.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+#include <vector>
+
+#define OUTPUT_RATE 48000
+
+/**
+ * @brief Source playing a generated signal, mono or stereo.
+ */
+class SignalSource : public AudioFile {
+  private:
+    std::vector<int16_t> m_samples;
+    int m_channels;
+    int m_rate;
+    size_t m_position; /**< In samples */
+
+    int read(int16_t *destination, int frames) {
+        int available = (m_samples.size() - m_position) / m_channels;
+        int produced = min(frames, available);
+        memcpy(destination, m_samples.data() + m_position,
+               produced * m_channels * sizeof(int16_t));
+        memset(destination + produced * m_channels, 0,
+               (frames - produced) * m_channels * sizeof(int16_t));
+        m_position += produced * m_channels;
+        return produced;
+    }
+
+  public:
+    SignalSource(std::vector<int16_t> samples, int channels, int rate)
+        : m_samples(samples), m_channels(channels), m_rate(rate),
+          m_position(0) {}
+    int sampleRate() { return m_rate; }
+    int numChannels() { return m_channels; }
+    int getFrames(Frame_t *frames, int number_frames) {
+        return read((int16_t *)frames, number_frames);
+    }
+    int getSamples(int16_t *samples, int number_samples) {
+        return read(samples, number_samples);
+    }
+    int remainingFrames() {
+        return (m_samples.size() - m_position) / m_channels;
+    }
+    bool isComplete() { return m_position == m_samples.size(); }
+};
+
+static std::vector<int16_t> tone(int rate, int frames, double frequency,
+                                 double amplitude) {
+    std::vector<int16_t> samples(frames);
+    for (int i = 0; i < frames; i++) {
+        samples[i] = (int16_t)lrint(
+            amplitude * sin(2 * M_PI * frequency * i / rate));
+    }
+    return samples;
+}
+
+/**
+ * @brief Plays a whole mono source through a resampler.
+ */
+static std::vector<int16_t> resample(int rate, std::vector<int16_t> input) {
+    Resampler resampler(new SignalSource(input, 1, rate), OUTPUT_RATE);
+    std::vector<int16_t> output;
+    int16_t block[100];
+    while (!resampler.isComplete()) {
+        int produced = resampler.getSamples(block, 100);
+        output.insert(output.end(), block, block + produced);
+    }
+    return output;
+}
+
+// The rates with a polyphase table, and one that falls back to linear
+// interpolation
+static const int TABLE_RATES[] = {8000, 16000, 22050, 24000, 32000, 44100};
+static const int RATES[] = {8000,  16000, 22050, 24000,
+                            32000, 44100, 11025};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_length_follows_the_ratio() {
+    for (int rate : RATES) {
+        int frames = rate / 10;
+        std::vector<int16_t> output =
+            resample(rate, std::vector<int16_t>(frames, 1000));
+        // Plus half the filter of delay at the end
+        int expected = (int64_t)frames * OUTPUT_RATE / rate;
+        TEST_ASSERT_INT_WITHIN_MESSAGE(
+            RESAMPLER_TAPS * OUTPUT_RATE / rate, expected, output.size(),
+            "output frames");
+        TEST_ASSERT_GREATER_THAN(expected - 1, (int)output.size());
+    }
+}
+
+void test_tables_keep_a_constant_level() {
+    // Each phase of a table has to sum to unity gain, or a constant input
+    // comes out with a ripple at the phase rate
+    for (int rate : RATES) {
+        std::vector<int16_t> output =
+            resample(rate, std::vector<int16_t>(rate / 10, 20000));
+        for (size_t i = OUTPUT_RATE / 100; i < output.size() / 2; i++) {
+            TEST_ASSERT_INT_WITHIN_MESSAGE(60, 20000, output[i], "level");
+        }
+    }
+}
+
+void test_tables_pass_a_tone() {
+    for (int rate : TABLE_RATES) {
+        std::vector<int16_t> output =
+            resample(rate, tone(rate, rate / 5, 1000, 10000));
+        // RMS of the steady state, which only depends on the gain
+        double sum = 0;
+        size_t count = 0;
+        for (size_t i = OUTPUT_RATE / 100; i < output.size() / 2; i++) {
+            sum += (double)output[i] * output[i];
+            count++;
+        }
+        double rms = sqrt(sum / count);
+        TEST_ASSERT_INT_WITHIN_MESSAGE(25, 10000 / M_SQRT2, lrint(rms),
+                                       "tone RMS");
+    }
+}
+
+void test_tables_stop_images() {
+    // Upsampling leaves a mirror image of every tone above the input
+    // Nyquist frequency, the filter has to remove it
+    for (int rate : {8000, 16000}) {
+        std::vector<int16_t> output =
+            resample(rate, tone(rate, rate / 5, rate * 0.3, 10000));
+        double image = rate - rate * 0.3;
+        double re = 0;
+        double im = 0;
+        size_t count = 0;
+        for (size_t i = OUTPUT_RATE / 100; i < output.size() / 2; i++) {
+            double phase = 2 * M_PI * image * i / OUTPUT_RATE;
+            re += output[i] * cos(phase);
+            im += output[i] * sin(phase);
+            count++;
+        }
+        double amplitude = 2 * sqrt(re * re + im * im) / count;
+        TEST_ASSERT_LESS_THAN(100.0, amplitude);
+    }
+}
+
+void test_stereo_channels_stay_apart() {
+    std::vector<int16_t> samples;
+    for (int i = 0; i < 1600; i++) {
+        samples.push_back(8000);
+        samples.push_back(-12000);
+    }
+    Resampler resampler(new SignalSource(samples, 2, 16000), OUTPUT_RATE);
+    TEST_ASSERT_EQUAL_INT(2, resampler.numChannels());
+    Frame_t frames[480];
+    TEST_ASSERT_EQUAL_INT(480, resampler.getFrames(frames, 480));
+    for (int i = 100; i < 480; i++) {
+        TEST_ASSERT_INT_WITHIN(30, 8000, frames[i].left);
+        TEST_ASSERT_INT_WITHIN(30, -12000, frames[i].right);
+    }
+}
+
+/**
+ * @brief Signal to noise ratio of a resampled tone, in dB.
+ *
+ * Fits a sine and a cosine at the tone frequency to the steady state by
+ * least squares, which absorbs the delay of the filter, and counts whatever
+ * the fit leaves as noise.
+ */
+static double toneSNR(const std::vector<int16_t> &output, double frequency) {
+    size_t first = OUTPUT_RATE / 100;
+    size_t last = output.size() / 2;
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for (size_t i = first; i < last; i++) {
+        double phase = 2 * M_PI * frequency * i / OUTPUT_RATE;
+        double s = sin(phase);
+        double c = cos(phase);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        ys += output[i] * s;
+        yc += output[i] * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    double signal = 0;
+    double noise = 0;
+    for (size_t i = first; i < last; i++) {
+        double phase = 2 * M_PI * frequency * i / OUTPUT_RATE;
+        double fit = a * sin(phase) + b * cos(phase);
+        signal += fit * fit;
+        noise += (output[i] - fit) * (output[i] - fit);
+    }
+    return 10 * log10(signal / noise);
+}
+
+void test_benchmark_snr_and_time() {
+    // Output samples per getSamples call, the engine's DMA block
+    const int block = 512;
+    for (int rate : RATES) {
+        int frames = rate / 2;
+        std::vector<int16_t> input = tone(rate, frames, 1000, 16000);
+        double snr = toneSNR(resample(rate, input), 1000);
+
+        Resampler resampler(new SignalSource(input, 1, rate), OUTPUT_RATE);
+        std::vector<int16_t> output(block);
+        int blocks = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (!resampler.isComplete()) {
+            resampler.getSamples(output.data(), block);
+            blocks++;
+        }
+        double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        bool table = rate != 11025;
+        char message[96];
+        snprintf(message, sizeof(message),
+                 "%d Hz (%s): %.1f dB SNR, %.2f us per %d samples", rate,
+                 table ? "table" : "linear", snr, elapsed * 1e6 / blocks,
+                 block);
+        TEST_MESSAGE(message);
+        // Rounding the output to 16 bits alone limits this half scale tone
+        // to about 92 dB
+        TEST_ASSERT_GREATER_THAN(table ? 75 : 30, (int)snr);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_length_follows_the_ratio);
+    RUN_TEST(test_tables_keep_a_constant_level);
+    RUN_TEST(test_tables_pass_a_tone);
+    RUN_TEST(test_tables_stop_images);
+    RUN_TEST(test_stereo_channels_stay_apart);
+    RUN_TEST(test_benchmark_snr_and_time);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+#include "camera/TinyCNN.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+/**
+ * @file test_main.cpp
+ * @brief Checks TinyCNN against the reference implementation in
+ * tools/pack_presence_model.py. Both files next to this one come from
+ *
+ *     python tools/pack_presence_model.py --random 3 --cases 6 \
+ *         --golden test/test_tiny_cnn/golden.bin test/test_tiny_cnn/model.bin
+ *
+ * and have to be regenerated when the file format changes.
+ */
+
+static std::vector<uint8_t> readFile(const char *name) {
+    std::string path = __FILE__;
+    path = path.substr(0, path.find_last_of("/\\") + 1) + name;
+    std::vector<uint8_t> data;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file != nullptr) {
+        int c;
+        while ((c = fgetc(file)) != EOF) {
+            data.push_back(c);
+        }
+        fclose(file);
+    }
+    return data;
+}
+
+/**
+ * @brief Copy with the alignment the interpreter expects.
+ */
+static uint8_t *alignedCopy(const std::vector<uint8_t> &data) {
+    size_t size = (data.size() + TINY_CNN_ALIGNMENT - 1) /
+                  TINY_CNN_ALIGNMENT * TINY_CNN_ALIGNMENT;
+    uint8_t *copy = (uint8_t *)aligned_alloc(TINY_CNN_ALIGNMENT, size);
+    memcpy(copy, data.data(), data.size());
+    return copy;
+}
+
+static std::vector<uint8_t> modelFile;
+static std::vector<uint8_t> golden;
+static uint8_t *model;
+
+void setUp() {
+    modelFile = readFile("model.bin");
+    golden = readFile("golden.bin");
+    model = modelFile.empty() ? nullptr : alignedCopy(modelFile);
+}
+
+void tearDown() { free(model); }
+
+void test_loads_the_model() {
+    TEST_ASSERT_NOT_NULL(model);
+    TinyCNN cnn;
+    TEST_ASSERT_TRUE(cnn.load(model, modelFile.size()));
+    TEST_ASSERT_EQUAL_INT(64, cnn.inputWidth());
+    TEST_ASSERT_EQUAL_INT(48, cnn.inputHeight());
+    TEST_ASSERT_EQUAL_INT(1, cnn.inputChannels());
+    TEST_ASSERT_EQUAL_INT(1, cnn.outputCount());
+    TEST_ASSERT_GREATER_THAN(0, cnn.macCount());
+}
+
+void test_matches_the_reference() {
+    TEST_ASSERT_NOT_NULL(model);
+    TEST_ASSERT_GREATER_THAN(10, golden.size());
+    TEST_ASSERT_EQUAL_MEMORY("BOBG", golden.data(), 4);
+    uint16_t cases = golden[4] | golden[5] << 8;
+    uint16_t inputSize = golden[6] | golden[7] << 8;
+    uint16_t outputs = golden[8] | golden[9] << 8;
+    TEST_ASSERT_EQUAL_INT(10 + cases * (inputSize + outputs), golden.size());
+
+    TinyCNN cnn;
+    TEST_ASSERT_TRUE(cnn.load(model, modelFile.size()));
+    TEST_ASSERT_EQUAL_INT(cnn.inputWidth() * cnn.inputHeight(), inputSize);
+    TEST_ASSERT_EQUAL_INT(cnn.outputCount(), outputs);
+    size_t arenaSize = (cnn.arenaSize() + TINY_CNN_ALIGNMENT - 1) /
+                       TINY_CNN_ALIGNMENT * TINY_CNN_ALIGNMENT;
+    void *arena = aligned_alloc(TINY_CNN_ALIGNMENT, arenaSize);
+
+    const uint8_t *record = golden.data() + 10;
+    for (int i = 0; i < cases; i++, record += inputSize + outputs) {
+        int8_t result[2];
+        cnn.invoke(record, arena, result);
+        // Bit exact, the interpreter follows the reference rounding
+        TEST_ASSERT_EQUAL_INT8_ARRAY((const int8_t *)(record + inputSize),
+                                     result, outputs);
+    }
+    free(arena);
+}
+
+void test_rejects_malformed_models() {
+    TEST_ASSERT_NOT_NULL(model);
+    TinyCNN cnn;
+    TEST_ASSERT_FALSE(cnn.load(model, modelFile.size() - TINY_CNN_ALIGNMENT));
+    TEST_ASSERT_FALSE(cnn.load(model, sizeof(TinyCNNHeader) - 1));
+    model[0] = 'X';
+    TEST_ASSERT_FALSE(cnn.load(model, modelFile.size()));
+    TEST_ASSERT_FALSE(cnn.isLoaded());
+}
+
+void test_benchmark() {
+    TEST_ASSERT_NOT_NULL(model);
+    TinyCNN cnn;
+    TEST_ASSERT_TRUE(cnn.load(model, modelFile.size()));
+    size_t arenaSize = (cnn.arenaSize() + TINY_CNN_ALIGNMENT - 1) /
+                       TINY_CNN_ALIGNMENT * TINY_CNN_ALIGNMENT;
+    void *arena = aligned_alloc(TINY_CNN_ALIGNMENT, arenaSize);
+    std::vector<uint8_t> input(cnn.inputWidth() * cnn.inputHeight());
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = (uint8_t)(i * 37);
+    }
+
+    const int rounds = 200;
+    int8_t result[2];
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        cnn.invoke(input.data(), arena, result);
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    free(arena);
+
+    char message[96];
+    snprintf(message, sizeof(message),
+             "%.1f us per inference on the host, %u MACs",
+             elapsed / rounds, (unsigned)cnn.macCount());
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_loads_the_model);
+    RUN_TEST(test_matches_the_reference);
+    RUN_TEST(test_rejects_malformed_models);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,428 @@
+#include "audio/WAVFormat.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+/**
+ * @brief Builds RIFF/WAVE files chunk by chunk.
+ */
+class WAVBuilder {
+  private:
+    std::vector<uint8_t> m_file;
+
+  public:
+    WAVBuilder() {
+        m_file = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E'};
+    }
+
+    WAVBuilder &put16(uint16_t value) {
+        m_file.push_back(value);
+        m_file.push_back(value >> 8);
+        return *this;
+    }
+
+    WAVBuilder &put32(uint32_t value) {
+        return put16(value).put16(value >> 16);
+    }
+
+    WAVBuilder &chunk(const char *id, const std::vector<uint8_t> &body,
+                      bool pad = true) {
+        m_file.insert(m_file.end(), id, id + 4);
+        put32(body.size());
+        m_file.insert(m_file.end(), body.begin(), body.end());
+        if (pad && body.size() % 2) {
+            m_file.push_back(0);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Adds a `fmt ` chunk of `size` bytes, 16, 18, 20 or 40.
+     */
+    WAVBuilder &format(uint16_t audioFormat, uint16_t channels,
+                       uint32_t rate, uint16_t bitDepth, size_t size = 16) {
+        uint16_t blockAlign = bitDepth / 8 * channels;
+        WAVBuilder body;
+        body.m_file.clear();
+        body.put16(size == 40 ? WAV_FORMAT_EXTENSIBLE : audioFormat)
+            .put16(channels)
+            .put32(rate)
+            .put32(rate * blockAlign)
+            .put16(blockAlign)
+            .put16(bitDepth);
+        if (size > 16) {
+            body.put16(size - 18);
+        }
+        if (size == 20) {
+            body.put16(0);
+        }
+        if (size == 40) {
+            // Valid bits, channel mask, then the sub-format GUID
+            body.put16(bitDepth).put32(3).put16(audioFormat);
+            const uint8_t guid[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                      0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+            body.m_file.insert(body.m_file.end(), guid, guid + 14);
+        }
+        return chunk("fmt ", body.m_file);
+    }
+
+    std::vector<uint8_t> build() {
+        std::vector<uint8_t> file = m_file;
+        uint32_t riffSize = file.size() - 8;
+        memcpy(file.data() + 4, &riffSize, 4);
+        return file;
+    }
+};
+
+static std::vector<uint8_t> samples16(std::initializer_list<int16_t> values) {
+    std::vector<uint8_t> bytes;
+    for (int16_t value : values) {
+        bytes.push_back(value);
+        bytes.push_back((uint16_t)value >> 8);
+    }
+    return bytes;
+}
+
+static const std::vector<uint8_t> PCM = samples16({1, -2, 3, -4});
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_canonical_file() {
+    std::vector<uint8_t> file =
+        WAVBuilder().format(WAV_FORMAT_PCM, 2, 16000, 16).chunk("data", PCM)
+            .build();
+    wav_format_t format;
+    TEST_ASSERT_TRUE(parseWAVFormat(file.data(), file.size(), format));
+    TEST_ASSERT_EQUAL_INT(WAV_FORMAT_PCM, format.audio_format);
+    TEST_ASSERT_EQUAL_INT(2, format.num_channels);
+    TEST_ASSERT_EQUAL_INT(16000, format.sample_rate);
+    TEST_ASSERT_EQUAL_INT(4, format.block_align);
+    TEST_ASSERT_EQUAL_INT(16, format.bit_depth);
+    TEST_ASSERT_EQUAL_INT(WAV_CANONICAL_HEADER_SIZE, format.data_offset);
+    TEST_ASSERT_EQUAL_INT(PCM.size(), format.data_length);
+    TEST_ASSERT_TRUE(isNativeWAVFormat(format));
+}
+
+void test_skips_other_chunks() {
+    // An odd-sized chunk is followed by a pad byte that is not counted in
+    // its size
+    std::vector<uint8_t> list = {'I', 'N', 'F', 'O', 'x'};
+    std::vector<uint8_t> file = WAVBuilder()
+                                    .chunk("LIST", list)
+                                    .format(WAV_FORMAT_PCM, 1, 8000, 16, 18)
+                                    .chunk("fact", {4, 0, 0, 0})
+                                    .chunk("data", PCM)
+                                    .build();
+    wav_format_t format;
+    TEST_ASSERT_TRUE(parseWAVFormat(file.data(), file.size(), format));
+    TEST_ASSERT_EQUAL_INT(1, format.num_channels);
+    TEST_ASSERT_EQUAL_INT(file.size() - PCM.size(), format.data_offset);
+    TEST_ASSERT_EQUAL_MEMORY(PCM.data(), file.data() + format.data_offset,
+                             PCM.size());
+}
+
+void test_resolves_extensible() {
+    std::vector<uint8_t> file = WAVBuilder()
+                                    .format(WAV_FORMAT_PCM, 2, 48000, 24, 40)
+                                    .chunk("data", {1, 2, 3, 4, 5, 6})
+                                    .build();
+    wav_format_t format;
+    TEST_ASSERT_TRUE(parseWAVFormat(file.data(), file.size(), format));
+    TEST_ASSERT_EQUAL_INT(WAV_FORMAT_PCM, format.audio_format);
+    TEST_ASSERT_EQUAL_INT(24, format.bit_depth);
+    TEST_ASSERT_FALSE(isNativeWAVFormat(format));
+    TEST_ASSERT_TRUE(canConvertToNativeWAV(format));
+}
+
+void test_clamps_data_to_the_file() {
+    std::vector<uint8_t> file =
+        WAVBuilder().format(WAV_FORMAT_PCM, 1, 8000, 16).chunk("data", PCM)
+            .build();
+    // Streams written on the fly leave the size at 0 or -1
+    for (uint32_t size : {0u, 0xFFFFFFFFu, 1000u}) {
+        memcpy(file.data() + WAV_CANONICAL_HEADER_SIZE - 4, &size, 4);
+        wav_format_t format;
+        TEST_ASSERT_TRUE(parseWAVFormat(file.data(), file.size(), format));
+        TEST_ASSERT_EQUAL_INT(PCM.size(), format.data_length);
+    }
+}
+
+void test_rejects_malformed_files() {
+    wav_format_t format;
+    std::vector<uint8_t> noData =
+        WAVBuilder().format(WAV_FORMAT_PCM, 1, 8000, 16).build();
+    TEST_ASSERT_FALSE(parseWAVFormat(noData.data(), noData.size(), format));
+
+    std::vector<uint8_t> dataFirst = WAVBuilder()
+                                         .chunk("data", PCM)
+                                         .format(WAV_FORMAT_PCM, 1, 8000, 16)
+                                         .build();
+    TEST_ASSERT_FALSE(
+        parseWAVFormat(dataFirst.data(), dataFirst.size(), format));
+
+    std::vector<uint8_t> noChannels =
+        WAVBuilder().format(WAV_FORMAT_PCM, 0, 8000, 16).chunk("data", PCM)
+            .build();
+    TEST_ASSERT_FALSE(
+        parseWAVFormat(noChannels.data(), noChannels.size(), format));
+
+    // A chunk claiming more than the file holds ends the walk
+    std::vector<uint8_t> longChunk = WAVBuilder()
+                                         .chunk("LIST", {0, 0, 0, 0})
+                                         .format(WAV_FORMAT_PCM, 1, 8000, 16)
+                                         .chunk("data", PCM)
+                                         .build();
+    uint32_t huge = 0x7FFFFFF0;
+    memcpy(longChunk.data() + 16, &huge, 4);
+    TEST_ASSERT_FALSE(
+        parseWAVFormat(longChunk.data(), longChunk.size(), format));
+
+    std::vector<uint8_t> file =
+        WAVBuilder().format(WAV_FORMAT_PCM, 1, 8000, 16).chunk("data", PCM)
+            .build();
+    file[8] = 'X';
+    TEST_ASSERT_FALSE(parseWAVFormat(file.data(), file.size(), format));
+    // Cut inside the header
+    TEST_ASSERT_FALSE(parseWAVFormat(file.data(), 11, format));
+}
+
+/**
+ * @brief Reader over a buffer that counts the bytes it hands out.
+ */
+struct CountingReader {
+    const std::vector<uint8_t> *file;
+    size_t bytes;
+
+    static size_t read(void *context, size_t offset, uint8_t *destination,
+                       size_t bytes) {
+        CountingReader *reader = (CountingReader *)context;
+        size_t available =
+            offset < reader->file->size() ? reader->file->size() - offset : 0;
+        bytes = bytes < available ? bytes : available;
+        memcpy(destination, reader->file->data() + offset, bytes);
+        reader->bytes += bytes;
+        return bytes;
+    }
+};
+
+void test_walker_reads_only_headers() {
+    std::vector<uint8_t> big(10000, 0x11);
+    std::vector<uint8_t> file = WAVBuilder()
+                                    .chunk("LIST", big)
+                                    .format(WAV_FORMAT_PCM, 2, 44100, 16)
+                                    .chunk("data", big)
+                                    .build();
+    CountingReader reader = {&file, 0};
+    wav_format_t format;
+    TEST_ASSERT_TRUE(walkWAVChunks(CountingReader::read, &reader,
+                                   file.size(), format));
+    TEST_ASSERT_EQUAL_INT(44100, format.sample_rate);
+    TEST_ASSERT_EQUAL_INT(big.size(), format.data_length);
+    // RIFF header, three chunk headers and the format
+    TEST_ASSERT_EQUAL_INT(12 + 3 * 8 + 16, reader.bytes);
+}
+
+void test_converts_24_bit() {
+    std::vector<uint8_t> data = {
+        0x80, 0x34, 0x12, // 0x123480 rounds up to 0x1235
+        0x00, 0x00, 0x80, // Full scale negative
+        0xFF, 0xFF, 0x7F, // Full scale positive, saturates
+        0x7F, 0x00, 0x00, // Rounds down to 0
+    };
+    std::vector<uint8_t> file = WAVBuilder()
+                                    .chunk("LIST", {1, 2, 3, 4, 5, 6})
+                                    .format(WAV_FORMAT_PCM, 2, 48000, 24)
+                                    .chunk("data", data)
+                                    .build();
+    wav_format_t format;
+    TEST_ASSERT_TRUE(parseWAVFormat(file.data(), file.size(), format));
+    size_t size = convertToNativeWAV(file.data(), format);
+    TEST_ASSERT_EQUAL_INT(WAV_CANONICAL_HEADER_SIZE + 8, size);
+
+    wav_format_t converted;
+    TEST_ASSERT_TRUE(parseWAVFormat(file.data(), size, converted));
+    TEST_ASSERT_TRUE(isNativeWAVFormat(converted));
+    TEST_ASSERT_EQUAL_INT(2, converted.num_channels);
+    TEST_ASSERT_EQUAL_INT(48000, converted.sample_rate);
+    int16_t samples[4];
+    memcpy(samples, file.data() + converted.data_offset, sizeof(samples));
+    const int16_t expected[4] = {0x1235, INT16_MIN, INT16_MAX, 0};
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expected, samples, 4);
+}
+
+void test_converts_float() {
+    const float values[] = {0.5f, -1.5f, 2.0f, NAN, -0.25f, 0.0f};
+    std::vector<uint8_t> data(sizeof(values));
+    memcpy(data.data(), values, sizeof(values));
+    std::vector<uint8_t> file =
+        WAVBuilder().format(WAV_FORMAT_IEEE_FLOAT, 1, 22050, 32)
+            .chunk("data", data)
+            .build();
+    wav_format_t format;
+    TEST_ASSERT_TRUE(parseWAVFormat(file.data(), file.size(), format));
+    size_t size = convertToNativeWAV(file.data(), format);
+    TEST_ASSERT_EQUAL_INT(WAV_CANONICAL_HEADER_SIZE + 12, size);
+    int16_t samples[6];
+    memcpy(samples, file.data() + WAV_CANONICAL_HEADER_SIZE, sizeof(samples));
+    const int16_t expected[6] = {16384, INT16_MIN, INT16_MAX, 0, -8192, 0};
+    TEST_ASSERT_EQUAL_INT16_ARRAY(expected, samples, 6);
+}
+
+void test_refuses_formats_it_cannot_convert() {
+    std::vector<uint8_t> file =
+        WAVBuilder().format(WAV_FORMAT_PCM, 1, 8000, 16).chunk("data", PCM)
+            .build();
+    wav_format_t format;
+    TEST_ASSERT_TRUE(parseWAVFormat(file.data(), file.size(), format));
+    TEST_ASSERT_FALSE(canConvertToNativeWAV(format));
+    TEST_ASSERT_EQUAL_INT(0, convertToNativeWAV(file.data(), format));
+}
+
+/**
+ * @brief Reader over a buffer that notes any read past its end.
+ */
+struct CheckedReader {
+    const std::vector<uint8_t> *file;
+    bool overrun;
+
+    static size_t read(void *context, size_t offset, uint8_t *destination,
+                       size_t bytes) {
+        CheckedReader *reader = (CheckedReader *)context;
+        size_t size = reader->file->size();
+        if (offset > size || bytes > size - offset) {
+            reader->overrun = true;
+            return 0;
+        }
+        memcpy(destination, reader->file->data() + offset, bytes);
+        return bytes;
+    }
+};
+
+void test_walker_survives_mutations() {
+    std::vector<std::vector<uint8_t>> seeds = {
+        WAVBuilder().format(WAV_FORMAT_PCM, 2, 16000, 16).chunk("data", PCM)
+            .build(),
+        WAVBuilder()
+            .chunk("LIST", {'I', 'N', 'F', 'O', 'x'})
+            .format(WAV_FORMAT_PCM, 1, 8000, 16, 18)
+            .chunk("fact", {4, 0, 0, 0})
+            .chunk("data", PCM)
+            .build(),
+        WAVBuilder().format(WAV_FORMAT_PCM, 2, 48000, 24, 40)
+            .chunk("data", {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12})
+            .build(),
+        WAVBuilder().format(WAV_FORMAT_IEEE_FLOAT, 1, 22050, 32, 20)
+            .chunk("data", {0, 0, 0, 63, 0, 0, 128, 191})
+            .build(),
+    };
+    // Sizes that make chunk arithmetic overflow or point past the end
+    const uint32_t sizes[] = {0, 1, 15, 16, 0x7FFFFFFF, 0xFFFFFFF8,
+                              0xFFFFFFFF};
+
+    // Fixed seed, a failure replays the same way every run
+    uint32_t random = 0x5EED;
+    auto next = [&random]() {
+        random = random * 1664525 + 1013904223;
+        return random >> 8;
+    };
+    for (int round = 0; round < 50000; round++) {
+        std::vector<uint8_t> file = seeds[next() % seeds.size()];
+        for (int mutations = 1 + next() % 4; mutations > 0; mutations--) {
+            size_t at = next() % file.size();
+            switch (next() % 4) {
+            case 0:
+                file[at] ^= 1 << (next() % 8);
+                break;
+            case 1:
+                file[at] = next();
+                break;
+            case 2:
+                if (at + 4 <= file.size()) {
+                    uint32_t size = sizes[next() % 7];
+                    memcpy(file.data() + at, &size, 4);
+                }
+                break;
+            default:
+                file.resize(at);
+                break;
+            }
+            if (file.empty()) {
+                break;
+            }
+        }
+        // Exactly sized, so the sanitizers catch any read past the end
+        file.shrink_to_fit();
+
+        wav_format_t format;
+        CheckedReader reader = {&file, false};
+        bool walked =
+            walkWAVChunks(CheckedReader::read, &reader, file.size(), format);
+        TEST_ASSERT_FALSE(reader.overrun);
+        wav_format_t parsed;
+        TEST_ASSERT_EQUAL(walked,
+                          parseWAVFormat(file.data(), file.size(), parsed));
+        if (!walked) {
+            continue;
+        }
+        TEST_ASSERT_TRUE(format.data_offset <= file.size());
+        TEST_ASSERT_TRUE(format.data_length <=
+                         file.size() - format.data_offset);
+        TEST_ASSERT_TRUE(format.num_channels == 1 ||
+                         format.num_channels == 2);
+        // Converting in place has to stay inside the file and leave a
+        // native one behind
+        size_t size = convertToNativeWAV(file.data(), format);
+        if (size > 0) {
+            TEST_ASSERT_TRUE(size <= file.size());
+            wav_format_t converted;
+            TEST_ASSERT_TRUE(parseWAVFormat(file.data(), size, converted));
+            TEST_ASSERT_TRUE(isNativeWAVFormat(converted));
+        }
+    }
+}
+
+void test_benchmark_walk() {
+    std::vector<uint8_t> file = WAVBuilder()
+                                    .chunk("LIST", std::vector<uint8_t>(64))
+                                    .format(WAV_FORMAT_PCM, 2, 44100, 16)
+                                    .chunk("fact", {4, 0, 0, 0})
+                                    .chunk("data", PCM)
+                                    .build();
+    const int rounds = 200000;
+    int found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        wav_format_t format;
+        found += parseWAVFormat(file.data(), file.size(), format);
+    }
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    TEST_ASSERT_EQUAL_INT(rounds, found);
+
+    char message[64];
+    snprintf(message, sizeof(message), "%.1f ns per parse on the host",
+             elapsed * 1e9 / rounds);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_canonical_file);
+    RUN_TEST(test_skips_other_chunks);
+    RUN_TEST(test_resolves_extensible);
+    RUN_TEST(test_clamps_data_to_the_file);
+    RUN_TEST(test_rejects_malformed_files);
+    RUN_TEST(test_walker_reads_only_headers);
+    RUN_TEST(test_converts_24_bit);
+    RUN_TEST(test_converts_float);
+    RUN_TEST(test_refuses_formats_it_cannot_convert);
+    RUN_TEST(test_walker_survives_mutations);
+    RUN_TEST(test_benchmark_walk);
+    return UNITY_END();
+}
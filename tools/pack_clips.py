@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Packs WAV clips into an image for the raw `clips` flash partition.
+
+The firmware maps the partition and plays the clips straight from flash, see
+src/audio/FlashClipTable.h for the layout. Clips are looked up by the same
+path they would have on SPIFFS, e.g. data/silence.wav becomes /silence.wav.
+
+Usage:
+    python tools/pack_clips.py clips.bin data/silence.wav data/sample_voice.wav
+    esptool.py --chip esp32s3 write_flash 0xE00000 clips.bin
+
+Only 16-bit PCM mono or stereo clips are accepted.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import wave
+
+MAGIC = b"BOBC"
+VERSION = 1
+NAME_LENGTH = 32
+ALIGNMENT = 16
+PARTITION_SIZE = 0x200000
+
+HEADER = struct.Struct("<4sHH8x")
+ENTRY = struct.Struct("<%dsIIIHH" % NAME_LENGTH)
+
+
+def align(offset):
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def read_clip(path):
+    with wave.open(path, "rb") as wav:
+        if wav.getcomptype() != "NONE" or wav.getsampwidth() != 2:
+            raise ValueError("%s is not 16-bit PCM" % path)
+        if wav.getnchannels() not in (1, 2):
+            raise ValueError("%s must be mono or stereo" % path)
+        return (wav.getframerate(), wav.getnchannels(),
+                wav.readframes(wav.getnframes()))
+
+
+def pack(paths, partition_size):
+    clips = []
+    for path in paths:
+        name = "/" + os.path.basename(path)
+        if len(name.encode()) >= NAME_LENGTH:
+            raise ValueError("%s: name longer than %d bytes"
+                             % (name, NAME_LENGTH - 1))
+        clips.append((name,) + read_clip(path))
+
+    offset = align(HEADER.size + ENTRY.size * len(clips))
+    table = HEADER.pack(MAGIC, VERSION, len(clips))
+    body = b""
+    for name, rate, channels, data in clips:
+        table += ENTRY.pack(name.encode(), offset, len(data), rate, channels,
+                            16)
+        padding = align(len(data)) - len(data)
+        body += data + b"\0" * padding
+        offset += len(data) + padding
+
+    image = table + b"\0" * (align(len(table)) - len(table)) + body
+    if len(image) > partition_size:
+        raise ValueError("%d bytes of clips do not fit the %d byte partition"
+                         % (len(image), partition_size))
+    return image
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="image to write")
+    parser.add_argument("clips", nargs="+", help="WAV files to pack")
+    parser.add_argument("--partition-size", type=lambda v: int(v, 0),
+                        default=PARTITION_SIZE,
+                        help="size of the clips partition (default 0x%X)"
+                        % PARTITION_SIZE)
+    args = parser.parse_args()
+
+    try:
+        image = pack(args.clips, args.partition_size)
+    except (ValueError, wave.Error) as error:
+        sys.exit("pack_clips: %s" % error)
+
+    with open(args.output, "wb") as output:
+        output.write(image)
+    print("Packed %d clips, %d of %d bytes used"
+          % (len(args.clips), len(image), args.partition_size))
+
+
+if __name__ == "__main__":
+    main()
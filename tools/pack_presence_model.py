@@ -0,0 +1,321 @@
+#!/usr/bin/env python3
+"""Packs a quantized CNN into the model file of the presence detector.
+
+The firmware loads /presence.bin from SPIFFS and runs it with the interpreter
+in src/camera/TinyCNN.cpp, see src/camera/TinyCNN.h for the layout. The model
+is described in JSON, with the int8 parameters as exported from a TensorFlow
+Lite int8 model:
+
+    {"input": {"width": 64, "height": 48, "channels": 1, "zeroPoint": -128},
+     "output": {"scale": 0.0625, "zeroPoint": 0},
+     "layers": [
+       {"type": "conv2d", "kernel": 3, "stride": 2, "padding": "same",
+        "relu": true, "zeroPoint": -128,
+        "weights": [[...], ...], "bias": [...],
+        "multiplier": [...], "shift": [...]},
+       {"type": "maxpool", "kernel": 2, "stride": 2},
+       {"type": "avgpool"},
+       {"type": "dense", "zeroPoint": 0, "weights": [[...]], ...}]}
+
+Convolution weights are one list per output channel in (y, x, input channel)
+order. The input is grayscale with a scale of 1/255. The last layer must
+output one value (presence logit) or two (absent and present logits).
+
+Usage:
+    python tools/pack_presence_model.py model.json data/presence.bin
+    pio run --target uploadfs
+
+--random packs a model of the default shape with random weights, to measure
+inference time before a trained model exists. --golden writes test inputs
+with the outputs of the reference implementation below, which a host build
+of TinyCNN.cpp must reproduce exactly. The native unit test uses
+
+    python tools/pack_presence_model.py --random 3 --cases 6 \
+        --golden test/test_tiny_cnn/golden.bin test/test_tiny_cnn/model.bin
+    pio test -e native -f test_tiny_cnn
+"""
+
+import argparse
+import json
+import math
+import random
+import struct
+import sys
+
+MAGIC = b"BOBN"
+VERSION = 1
+ALIGNMENT = 16
+
+HEADER = struct.Struct("<4sHHHHHbbf")
+LAYER = struct.Struct("<BBBBHbxI4x")
+GOLDEN = struct.Struct("<4sHHH")
+
+CONV2D, MAX_POOL, AVERAGE_POOL, DENSE = 1, 2, 3, 4
+PADDING_SAME, RELU = 1, 2
+TYPES = {"conv2d": CONV2D, "maxpool": MAX_POOL, "avgpool": AVERAGE_POOL,
+         "dense": DENSE}
+
+
+def align(offset):
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def padded(data):
+    return data + b"\0" * (align(len(data)) - len(data))
+
+
+def out_shape(layer, shape):
+    """Returns the output shape and the top and left padding of a layer."""
+    height, width, channels = shape
+    kind = layer["type"]
+    if kind in ("avgpool", "dense"):
+        return (1, 1, channels if kind == "avgpool"
+                else len(layer["weights"])), 0, 0
+    kernel, stride = layer["kernel"], layer["stride"]
+    if kind == "conv2d":
+        channels = len(layer["weights"])
+    if layer.get("padding") == "same":
+        out_h = (height + stride - 1) // stride
+        out_w = (width + stride - 1) // stride
+        pad_h = max((out_h - 1) * stride + kernel - height, 0)
+        pad_w = max((out_w - 1) * stride + kernel - width, 0)
+        return (out_h, out_w, channels), pad_h // 2, pad_w // 2
+    if height < kernel or width < kernel:
+        raise ValueError("%s layer larger than its input" % kind)
+    return ((height - kernel) // stride + 1, (width - kernel) // stride + 1,
+            channels), 0, 0
+
+
+def pack(spec):
+    source = spec["input"]
+    shape = (source["height"], source["width"], source["channels"])
+    zero_point = source["zeroPoint"]
+    body = b""
+    for index, layer in enumerate(spec["layers"]):
+        kind = layer["type"]
+        if kind not in TYPES:
+            raise ValueError("layer %d: unknown type %s" % (index, kind))
+        output, _, _ = out_shape(layer, shape)
+        flags = ((PADDING_SAME if layer.get("padding") == "same" else 0) |
+                 (RELU if layer.get("relu") else 0))
+        data = b""
+        if kind in ("conv2d", "dense"):
+            length = (layer["kernel"] ** 2 * shape[2] if kind == "conv2d"
+                      else shape[0] * shape[1] * shape[2])
+            for row in layer["weights"]:
+                if len(row) != length:
+                    raise ValueError("layer %d: %d weights per channel, "
+                                     "expected %d" % (index, len(row), length))
+                data += padded(struct.pack("<%db" % length, *row))
+            for name in ("bias", "multiplier", "shift"):
+                values = layer[name]
+                if len(values) != output[2]:
+                    raise ValueError("layer %d: %d %s values, expected %d"
+                                     % (index, len(values), name, output[2]))
+                data += padded(struct.pack("<%di" % len(values), *values))
+            layer_zero_point = layer["zeroPoint"]
+        else:
+            layer_zero_point = zero_point
+        body += LAYER.pack(TYPES[kind], layer.get("kernel", 0),
+                           layer.get("stride", 0), flags, output[2],
+                           layer_zero_point, len(data)) + data
+        shape, zero_point = output, layer_zero_point
+
+    result = spec["output"]
+    if shape[:2] != (1, 1) or shape[2] not in (1, 2):
+        raise ValueError("the model must end in one or two values")
+    if zero_point != result["zeroPoint"]:
+        raise ValueError("output zero point does not match the last layer")
+    header = HEADER.pack(MAGIC, VERSION, len(spec["layers"]),
+                         source["width"], source["height"],
+                         source["channels"], source["zeroPoint"],
+                         result["zeroPoint"], result["scale"])
+    return padded(header) + body
+
+
+def rescale(value, multiplier, shift):
+    """TensorFlow Lite's MultiplyByQuantizedMultiplier, in C semantics."""
+    value = value << max(shift, 0)
+    value = (value + 2 ** 31) % 2 ** 32 - 2 ** 31
+    if value == multiplier == -2 ** 31:
+        return 2 ** 31 - 1
+    product = value * multiplier
+    product += 1 << 30 if product >= 0 else 1 - (1 << 30)
+    high = abs(product) // 2 ** 31 * (1 if product >= 0 else -1)
+    right = max(-shift, 0)
+    if right == 0:
+        return high
+    mask = (1 << right) - 1
+    threshold = (mask >> 1) + (1 if high < 0 else 0)
+    return (high >> right) + (1 if high & mask > threshold else 0)
+
+
+def clamp(value, low):
+    return max(low, min(127, value))
+
+
+def run(spec, pixels):
+    """Reference inference, returns the quantized outputs."""
+    source = spec["input"]
+    height, width, channels = (source["height"], source["width"],
+                               source["channels"])
+    zero_point = source["zeroPoint"]
+    tensor = [clamp(p + zero_point, -128) for p in pixels]
+    for layer in spec["layers"]:
+        kind = layer["type"]
+        (out_h, out_w, out_c), top, left = out_shape(
+            layer, (height, width, channels))
+        output = []
+        if kind == "conv2d" or kind == "maxpool":
+            kernel, stride = layer["kernel"], layer["stride"]
+            for y in range(out_h):
+                for x in range(out_w):
+                    patch = []
+                    for ky in range(kernel):
+                        for kx in range(kernel):
+                            sy = y * stride - top + ky
+                            sx = x * stride - left + kx
+                            inside = 0 <= sy < height and 0 <= sx < width
+                            base = (sy * width + sx) * channels
+                            for c in range(channels):
+                                patch.append(tensor[base + c] if inside
+                                             else None)
+                    if kind == "maxpool":
+                        for c in range(channels):
+                            values = [v for v in patch[c::channels]
+                                      if v is not None]
+                            output.append(max(values + [-128]))
+                        continue
+                    patch = [zero_point if v is None else v for v in patch]
+                    output += dense(layer, patch, zero_point)
+        elif kind == "avgpool":
+            count = height * width
+            for c in range(channels):
+                total = sum(tensor[c::channels])
+                total += count // 2 if total >= 0 else -(count // 2)
+                mean = abs(total) // count * (1 if total >= 0 else -1)
+                output.append(clamp(mean, -128))
+        else:
+            output = dense(layer, tensor, zero_point)
+        if kind in ("conv2d", "dense"):
+            zero_point = layer["zeroPoint"]
+        tensor = output
+        height, width, channels = out_h, out_w, out_c
+    return tensor
+
+
+def dense(layer, values, zero_point):
+    low = layer["zeroPoint"] if layer.get("relu") else -128
+    output = []
+    for row, bias, multiplier, shift in zip(layer["weights"], layer["bias"],
+                                            layer["multiplier"],
+                                            layer["shift"]):
+        total = bias + sum((v - zero_point) * w for v, w in zip(values, row))
+        output.append(clamp(rescale(total, multiplier, shift) +
+                            layer["zeroPoint"], low))
+    return output
+
+
+def quantize_multiplier(real):
+    mantissa, exponent = math.frexp(real)
+    multiplier = int(round(mantissa * 2 ** 31))
+    if multiplier == 2 ** 31:
+        multiplier //= 2
+        exponent += 1
+    return multiplier, exponent
+
+
+def random_layer(rng, kind, length, channels, relu, zero_point, **extra):
+    multiplier, shift = quantize_multiplier(1.0 / (150 * math.sqrt(length)))
+    layer = {"type": kind, "relu": relu, "zeroPoint": zero_point,
+             "weights": [[rng.randint(-127, 127) for _ in range(length)]
+                         for _ in range(channels)],
+             "bias": [rng.randint(-2000, 2000) for _ in range(channels)],
+             "multiplier": [multiplier] * channels,
+             "shift": [shift] * channels}
+    layer.update(extra)
+    return layer
+
+
+def random_spec(seed):
+    """Default shape: three strided 3x3 convolutions, pooling, one logit."""
+    rng = random.Random(seed)
+    conv = {"kernel": 3, "stride": 2, "padding": "same"}
+    return {
+        "input": {"width": 64, "height": 48, "channels": 1,
+                  "zeroPoint": -128},
+        "output": {"scale": 0.0625, "zeroPoint": 0},
+        "layers": [
+            random_layer(rng, "conv2d", 9, 8, True, -128, **conv),
+            random_layer(rng, "conv2d", 72, 16, True, -128, **conv),
+            random_layer(rng, "conv2d", 144, 32, True, -128, **conv),
+            {"type": "avgpool"},
+            random_layer(rng, "dense", 32, 1, False, 0),
+        ],
+    }
+
+
+def plain_inputs(width, height, channels):
+    """Black, white and a bright disc on a dark ground. Random noise averages
+    out to nearly the same output every time, these spread it."""
+    disc = bytes(200 if (x - width // 2) ** 2 + (y - height // 2) ** 2 <
+                 (min(width, height) // 4) ** 2 else 30
+                 for y in range(height) for x in range(width)
+                 for _ in range(channels))
+    size = width * height * channels
+    return [bytes(size), bytes([255]) * size, disc]
+
+
+def write_golden(spec, path, cases, seed):
+    """Writes `cases` inputs, plain images then random ones, each followed by
+    its outputs."""
+    rng = random.Random(seed)
+    source = spec["input"]
+    size = source["width"] * source["height"] * source["channels"]
+    plain = plain_inputs(source["width"], source["height"], source["channels"])
+    shape = (source["height"], source["width"], source["channels"])
+    for layer in spec["layers"]:
+        shape, _, _ = out_shape(layer, shape)
+    outputs = shape[2]
+    with open(path, "wb") as golden:
+        golden.write(GOLDEN.pack(b"BOBG", cases, size, outputs))
+        for case in range(cases):
+            pixels = (plain[case] if case < len(plain)
+                      else bytes(rng.randrange(256) for _ in range(size)))
+            golden.write(pixels)
+            golden.write(struct.pack("<%db" % outputs, *run(spec, pixels)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("spec", nargs="?", help="JSON model description")
+    parser.add_argument("output", help="model file to write")
+    parser.add_argument("--random", type=int, metavar="SEED",
+                        help="pack random weights instead of a spec")
+    parser.add_argument("--golden", metavar="FILE",
+                        help="also write reference inputs and outputs")
+    parser.add_argument("--cases", type=int, default=8,
+                        help="number of golden cases (default 8)")
+    args = parser.parse_args()
+    if (args.spec is None) == (args.random is None):
+        parser.error("give either a spec or --random")
+
+    try:
+        if args.spec is not None:
+            with open(args.spec) as source:
+                spec = json.load(source)
+        else:
+            spec = random_spec(args.random)
+        model = pack(spec)
+        if args.golden:
+            write_golden(spec, args.golden, args.cases, args.random or 0)
+    except (ValueError, KeyError, OSError) as error:
+        sys.exit("pack_presence_model: %s" % error)
+
+    with open(args.output, "wb") as output:
+        output.write(model)
+    print("Packed %d layers, %d bytes" % (len(spec["layers"]), len(model)))
+
+
+if __name__ == "__main__":
+    main()